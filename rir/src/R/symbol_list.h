@@ -86,6 +86,20 @@
     V(all, "all")                                                              \
     V(FUN, "FUN")                                                              \
     V(forceAndCall, "forceAndCall")                                            \
-    V(Recall, "Recall")
+    V(Recall, "Recall")                                                        \
+    V(tryCatch, "tryCatch")                                                    \
+    V(expr, "expr")                                                            \
+    V(finally, "finally")                                                      \
+    V(AllMTable, ".AllMTable")                                                 \
+    V(SigArgs, ".SigArgs")                                                     \
+    V(SigLength, ".SigLength")                                                 \
+    V(generic, "generic")                                                      \
+    V(targetAttr, "target")                                                    \
+    V(definedAttr, "defined")                                                  \
+    V(nextMethodAttr, "nextMethod")                                            \
+    V(dotTarget, ".target")                                                    \
+    V(dotDefined, ".defined")                                                  \
+    V(dotNextMethod, ".nextMethod")                                            \
+    V(dotMethod, ".Method")
 
 #endif // SYMBOLS_LIST_H_
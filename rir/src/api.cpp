@@ -11,15 +11,18 @@
 #include "compiler/parameter.h"
 #include "compiler/test/PirCheck.h"
 #include "compiler/test/PirTests.h"
+#include "interpreter/instance.h"
 #include "interpreter/interp_incl.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
+#include "runtime/FeedbackProfile.h"
 
 #include <cassert>
 #include <cstdio>
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 using namespace rir;
 
@@ -327,6 +330,37 @@ SEXP pirCompile(SEXP what, const Context& assumptions, const std::string& name,
     return what;
 }
 
+rir::Function* pirCompileRegion(SEXP what, Opcode* start, Opcode* end,
+                                size_t stackSize,
+                                const pir::DebugOptions& debug) {
+    Protect p(what);
+    Function* res = nullptr;
+
+    pir::Module* m = new pir::Module;
+    pir::StreamLogger logger(debug);
+    logger.title("Compiling region");
+    pir::Compiler cmp(m, logger);
+    {
+        // The native code is only ready after the backend is gone
+        pir::Backend backend(logger, "region");
+        cmp.compileRegion(what, "", start, end, stackSize,
+                          [&](pir::ClosureVersion* c) {
+                              logger.flush();
+                              cmp.optimizeModule();
+                              res = backend.getOrCompile(c);
+                              p(res->container());
+                          },
+                          [&]() {
+                              if (debug.includes(
+                                      pir::DebugFlag::ShowWarnings))
+                                  std::cerr << "Compilation failed\n";
+                          });
+    }
+
+    delete m;
+    return res;
+}
+
 REXPORT SEXP rirInvocationCount(SEXP what) {
     if (!isValidClosureSEXP(what)) {
         Rf_error("not a compiled closure");
@@ -441,6 +475,13 @@ SEXP rirOptDefaultOptsDryrun(SEXP closure, const Context& assumptions,
         return closure;
 }
 
+Function* rirOptRegionDefaultOpts(SEXP closure, Opcode* start, Opcode* end,
+                                  size_t stackSize) {
+    if (PirDebug.includes(pir::DebugFlag::DryRun))
+        return nullptr;
+    return pirCompileRegion(closure, start, end, stackSize, PirDebug);
+}
+
 REXPORT SEXP rirSerialize(SEXP data, SEXP fileSexp) {
     oldPreserve = pir::Parameter::RIR_PRESERVE;
     pir::Parameter::RIR_PRESERVE = true;
@@ -470,6 +511,109 @@ REXPORT SEXP rirDeserialize(SEXP fileSexp) {
     return res;
 }
 
+REXPORT SEXP rirExportFeedback(SEXP fileSexp, SEXP envs) {
+    if (TYPEOF(fileSexp) != STRSXP)
+        Rf_error("must provide a string path");
+    size_t written;
+    if (auto error =
+            FeedbackProfile::exportTo(CHAR(Rf_asChar(fileSexp)), envs, written))
+        Rf_error("%s", error);
+    R_Visible = (Rboolean) false;
+    return Rf_ScalarInteger(written);
+}
+
+REXPORT SEXP rirImportFeedback(SEXP fileSexp) {
+    if (TYPEOF(fileSexp) != STRSXP)
+        Rf_error("must provide a string path");
+    auto stats = FeedbackProfile::importFrom(CHAR(Rf_asChar(fileSexp)));
+    if (stats.error)
+        Rf_error("%s", stats.error);
+    if (stats.warning)
+        Rf_warning("%s", stats.warning);
+    SEXP res = PROTECT(Rf_allocVector(INTSXP, 3));
+    INTEGER(res)[0] = stats.restored;
+    INTEGER(res)[1] = stats.stale;
+    INTEGER(res)[2] = stats.unbound;
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, 3));
+    SET_STRING_ELT(names, 0, Rf_mkChar("restored"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("stale"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("unbound"));
+    Rf_setAttrib(res, R_NamesSymbol, names);
+    UNPROTECT(2);
+    R_Visible = (Rboolean) false;
+    return res;
+}
+
+static Context contextFromSexp(SEXP ctx) {
+    if (TYPEOF(ctx) != INTSXP || LENGTH(ctx) != 2)
+        Rf_error("a context should be an Integer Array of size 2");
+    Context res;
+    auto p = (int*)((void*)&res);
+    p[0] = INTEGER(ctx)[0];
+    p[1] = INTEGER(ctx)[1];
+    return res;
+}
+
+REXPORT SEXP rirCompileNamespace(SEXP env, SEXP profile, SEXP contexts) {
+    if (TYPEOF(env) != ENVSXP)
+        Rf_error("must provide an environment");
+    if (profile != R_NilValue && TYPEOF(profile) != STRSXP)
+        Rf_error("profile must be a path or NULL");
+    if (contexts != R_NilValue && TYPEOF(contexts) != VECSXP)
+        Rf_error("contexts must be a list");
+    int nContexts = contexts == R_NilValue ? 0 : LENGTH(contexts);
+    for (int i = 0; i < nContexts; ++i)
+        contextFromSexp(VECTOR_ELT(contexts, i));
+
+    // Baseline compile everything, lazy loaded bindings are forced. The
+    // closures are kept in an R vector, evaluating and compiling can fail.
+    auto syms = PROTECT(R_lsInternal3(env, TRUE, FALSE));
+    auto closures = PROTECT(Rf_allocVector(VECSXP, LENGTH(syms)));
+    for (int i = 0; i < LENGTH(syms); ++i) {
+        auto sym = Rf_installChar(STRING_ELT(syms, i));
+        auto v = Rf_findVarInFrame(env, sym);
+        if (TYPEOF(v) == PROMSXP)
+            v = Rf_eval(v, env);
+        if (TYPEOF(v) != CLOSXP)
+            continue;
+        rirCompile(v, env);
+        SET_VECTOR_ELT(closures, i, v);
+    }
+
+    size_t optimized = 0;
+    FeedbackProfile::Stats stats;
+    if (profile != R_NilValue) {
+        stats = FeedbackProfile::importFrom(CHAR(Rf_asChar(profile)), env,
+                                            true);
+        optimized += stats.optimized;
+    }
+
+    for (int i = 0; i < LENGTH(syms); ++i) {
+        auto cls = VECTOR_ELT(closures, i);
+        if (cls == R_NilValue)
+            continue;
+        auto sym = Rf_installChar(STRING_ELT(syms, i));
+        auto before = DispatchTable::unpack(BODY(cls))->size();
+        for (int j = 0; j < nContexts; ++j)
+            globalContext()->closureOptimizer(
+                cls, contextFromSexp(VECTOR_ELT(contexts, j)), sym);
+        // A context set by rir.setUserContext is compiled for even if no
+        // context was asked for
+        auto table = DispatchTable::unpack(BODY(cls));
+        if (!nContexts && !table->userDefinedContext().empty())
+            globalContext()->closureOptimizer(cls, Context(), sym);
+        optimized += DispatchTable::unpack(BODY(cls))->size() - before;
+    }
+    UNPROTECT(2);
+
+    if (stats.error)
+        Rf_error("%s", stats.error);
+    if (stats.warning)
+        Rf_warning("%s", stats.warning);
+    R_Visible = (Rboolean) false;
+    return Rf_ScalarInteger(optimized);
+}
+
 REXPORT SEXP rirEnableLoopPeeling() {
     Compiler::loopPeelingEnabled = true;
     return R_NilValue;
@@ -480,6 +624,12 @@ REXPORT SEXP rirDisableLoopPeeling() {
     return R_NilValue;
 }
 
+REXPORT SEXP rirSplitInnerFeedback(SEXP n) {
+    auto old = pir::Parameter::SPLIT_INNER_FEEDBACK;
+    pir::Parameter::SPLIT_INNER_FEEDBACK = Rf_asInteger(n);
+    return Rf_ScalarInteger(old);
+}
+
 REXPORT SEXP rirPrintBuiltinIds() {
     FUNTAB* finger = R_FunTab;
     int i = 0;
@@ -516,15 +666,7 @@ REXPORT SEXP rirSetUserContext(SEXP f, SEXP userContext) {
         rirCompile(f, CLOENV(f));
     }
 
-    if (TYPEOF(userContext) != INTSXP || LENGTH(userContext) != 2)
-        Rf_error("userDefinedContext should be an Integer Array of size 2");
-
-    Context newContext;
-    auto p = (int*)((void*)&newContext);
-    *p = INTEGER(userContext)[0];
-    p++;
-    *p = INTEGER(userContext)[1];
-
+    auto newContext = contextFromSexp(userContext);
     auto tbl = DispatchTable::unpack(BODY(f));
     auto newTbl = tbl->newWithUserContext(newContext);
     SET_BODY(f, newTbl->container());
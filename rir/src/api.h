@@ -8,6 +8,11 @@
 
 #define REXPORT extern "C"
 
+namespace rir {
+struct Function;
+enum class Opcode : uint8_t;
+} // namespace rir
+
 extern int R_ENABLE_JIT;
 extern rir::pir::DebugOptions PirDebug;
 
@@ -23,8 +28,17 @@ SEXP pirCompile(SEXP closure, const rir::Context& assumptions,
 extern SEXP rirOptDefaultOpts(SEXP closure, const rir::Context&, SEXP name);
 extern SEXP rirOptDefaultOptsDryrun(SEXP closure, const rir::Context&,
                                     SEXP name);
+rir::Function* pirCompileRegion(SEXP closure, rir::Opcode* start,
+                                rir::Opcode* end, size_t stackSize,
+                                const rir::pir::DebugOptions& debug);
+extern rir::Function* rirOptRegionDefaultOpts(SEXP closure, rir::Opcode* start,
+                                              rir::Opcode* end,
+                                              size_t stackSize);
 REXPORT SEXP rirSerialize(SEXP data, SEXP file);
 REXPORT SEXP rirDeserialize(SEXP file);
+REXPORT SEXP rirExportFeedback(SEXP file, SEXP envs);
+REXPORT SEXP rirImportFeedback(SEXP file);
+REXPORT SEXP rirCompileNamespace(SEXP env, SEXP profile, SEXP contexts);
 
 REXPORT SEXP rirSetUserContext(SEXP f, SEXP udc);
 REXPORT SEXP rirCreateSimpleIntContext();
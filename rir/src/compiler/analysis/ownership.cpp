@@ -0,0 +1,146 @@
+#include "ownership.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/BuiltinIds.h"
+#include "cfg.h"
+
+namespace rir {
+namespace pir {
+
+static bool isSubassign(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Subassign1_1D:
+    case Tag::Subassign2_1D:
+    case Tag::Subassign1_2D:
+    case Tag::Subassign2_2D:
+    case Tag::Subassign1_3D:
+        return true;
+    default: {}
+    }
+    return false;
+}
+
+static bool isCast(Instruction* i) { return i->followCasts() != i; }
+
+// Allocations which return a vector nobody else refers to
+static bool isFresh(Instruction* i) {
+    if (auto fused = FusedVectorOp::Cast(i))
+        return fused->reduction == FusedVectorOp::Reduction::None;
+    int builtinId;
+    if (auto b = CallBuiltin::Cast(i))
+        builtinId = b->builtinId;
+    else if (auto b = CallSafeBuiltin::Cast(i))
+        builtinId = b->builtinId;
+    else
+        return false;
+    return builtinId == blt("vector") || builtinId == blt("c");
+}
+
+static bool onlyArg(Instruction* i, Instruction* v, size_t pos) {
+    for (size_t a = 0; a < i->nargs(); ++a)
+        if (a != pos && i->arg(a).val() == v)
+            return false;
+    return i->arg(pos).val() == v;
+}
+
+// Uses which neither retain the vector nor reuse it for their result. Deopt
+// branches leave the native code before any subassign could run.
+static bool onlyReads(Instruction* use, Instruction* v) {
+    if (use->bb()->isDeopt())
+        return true;
+    switch (use->tag) {
+    case Tag::FrameState:
+    case Tag::Return:
+    case Tag::Length:
+    case Tag::IsType:
+    case Tag::Is:
+        return true;
+    case Tag::Extract1_1D:
+    case Tag::Extract2_1D:
+    case Tag::Extract1_2D:
+    case Tag::Extract2_2D:
+    case Tag::Extract1_3D:
+        return !v->type.maybeObj() && onlyArg(use, v, 0);
+    default: {}
+    }
+    return false;
+}
+
+VectorOwnership::VectorOwnership(Code* code,
+                                 const NeedsRefcountAdjustment& refcount) {
+    UsesTree uses(code);
+
+    // Values used after being overridden need a copy
+    std::unordered_set<Instruction*> overridden;
+    for (auto& a : refcount.atCreation)
+        if (a.second == NeedsRefcountAdjustment::SetShared)
+            overridden.insert(a.first);
+    for (auto& u : refcount.beforeUse)
+        for (auto& a : u.second)
+            if (a.second == NeedsRefcountAdjustment::SetShared)
+                overridden.insert(a.first);
+
+    std::unordered_set<Instruction*> seen;
+    Visitor::run(code->entry, [&](Instruction* start) {
+        if (!isSubassign(start) || seen.count(start))
+            return;
+
+        bool ok = true;
+        std::vector<Instruction*> web;
+        auto add = [&](Value* v) {
+            auto i = Instruction::Cast(v);
+            if (!i) {
+                ok = false;
+                return;
+            }
+            if (seen.insert(i).second)
+                web.push_back(i);
+        };
+        add(start);
+
+        for (size_t n = 0; n < web.size(); ++n) {
+            auto i = web[n];
+            if (overridden.count(i))
+                ok = false;
+
+            if (auto phi = Phi::Cast(i)) {
+                phi->eachArg([&](BB*, Value* v) { add(v); });
+            } else if (isCast(i)) {
+                add(i->arg(0).val());
+            } else if (isSubassign(i)) {
+                add(i->arg(1).val());
+            } else if (!isFresh(i)) {
+                ok = false;
+            }
+
+            for (auto use : uses.at(i)) {
+                if (Phi::Cast(use) || isCast(use))
+                    add(use);
+                else if (isSubassign(use) && !i->type.maybeObj() &&
+                         onlyArg(use, i, 1))
+                    add(use);
+                else if (!onlyReads(use, i))
+                    ok = false;
+            }
+        }
+
+        if (ok)
+            owned_.insert(web.begin(), web.end());
+    });
+}
+
+void VectorOwnership::apply(NeedsRefcountAdjustment& refcount) const {
+    for (auto& a : refcount.atCreation)
+        if (owned(a.first))
+            a.second = NeedsRefcountAdjustment::None;
+    for (auto& u : refcount.beforeUse)
+        for (auto& a : u.second)
+            if (owned(a.first))
+                a.second = NeedsRefcountAdjustment::None;
+    for (auto i : owned_)
+        if (isSubassign(i))
+            refcount.inPlace.insert(i);
+}
+
+} // namespace pir
+} // namespace rir
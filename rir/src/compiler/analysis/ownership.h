@@ -0,0 +1,37 @@
+#ifndef PIR_OWNERSHIP_H
+#define PIR_OWNERSHIP_H
+
+#include "compiler/analysis/reference_count.h"
+#include "compiler/pir/pir.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// Proves that the vector updated by a subassign is not referenced from
+// anywhere outside of the code. Phis, casts and subassigns (which return their
+// vector when updating in place) connect values into webs. A web is owned if
+// all of its values start at fresh allocations, are otherwise only read or
+// returned, and the reference count analysis does not need to preserve any of
+// them after being overridden.
+//
+// Subassigns in owned webs can update in place without checking the named
+// count, and the adjustments which only protect the web against reuse by its
+// readers are not needed.
+class VectorOwnership {
+  public:
+    VectorOwnership(Code* code, const NeedsRefcountAdjustment& refcount);
+
+    bool owned(Instruction* i) const { return owned_.count(i); }
+
+    void apply(NeedsRefcountAdjustment& refcount) const;
+
+  private:
+    std::unordered_set<Instruction*> owned_;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
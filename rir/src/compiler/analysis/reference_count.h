@@ -5,12 +5,13 @@
 #include "dead.h"
 #include "generic_static_analysis.h"
 #include "utils/Map.h"
+#include "utils/Set.h"
 
 namespace rir {
 namespace pir {
 
 struct NeedsRefcountAdjustment {
-    enum Kind { EnsureNamed, SetShared };
+    enum Kind { None, EnsureNamed, SetShared };
 
     // Not needed since we do not use the state in the analysis
     bool changed() { return false; }
@@ -19,6 +20,10 @@ struct NeedsRefcountAdjustment {
     SmallMap<Instruction*, Kind> atCreation;
     SmallMap<Instruction*, SmallMap<Instruction*, Kind>> beforeUse;
 
+    // Subassigns which can update their vector without checking whether it is
+    // shared, see VectorOwnership
+    SmallSet<Instruction*> inPlace;
+
     void print(std::ostream& out, bool tty) const {
         out << "Adjust at creation:\n";
         for (auto r : atCreation) {
@@ -38,6 +43,13 @@ struct NeedsRefcountAdjustment {
             out << "\n";
         }
         out << "\n";
+
+        out << "Update in place:\n";
+        for (auto i : inPlace) {
+            i->printRef(out);
+            out << ",  ";
+        }
+        out << "\n";
     }
 };
 
@@ -292,6 +304,7 @@ class StaticReferenceCount
         case Tag::Extract2_2D:
         case Tag::ColonCastLhs:
         case Tag::ColonCastRhs:
+        case Tag::FusedVectorOp:
             break;
 
         // Those may override the vector (which is arg 1)
@@ -3,6 +3,7 @@
 #include "analysis/dead.h"
 #include "compiler/analysis/cfg.h"
 #include "compiler/analysis/last_env.h"
+#include "compiler/analysis/ownership.h"
 #include "compiler/analysis/reference_count.h"
 #include "compiler/analysis/verifier.h"
 #include "compiler/native/pir_jit_llvm.h"
@@ -18,6 +19,7 @@
 #include "runtime/DispatchTable.h"
 #include "simple_instruction_list.h"
 #include "utils/FunctionWriter.h"
+#include "utils/Pool.h"
 #include "utils/measuring.h"
 
 #include <algorithm>
@@ -36,6 +38,8 @@ static void approximateRefcount(ClosureVersion* cls, Code* code,
     StaticReferenceCount refcountAnalysis(cls, code, log.out());
     refcountAnalysis();
     refcount = refcountAnalysis.getGlobalState();
+    VectorOwnership ownership(code, refcount);
+    ownership.apply(refcount);
 }
 
 static void approximateNeedsLdVarForUpdate(
@@ -403,6 +407,9 @@ rir::Function* Backend::doCompile(ClosureVersion* cls,
     function.finalize(body, signature, cls->context());
 
     function.function()->inheritFlags(cls->owner()->rirFunction());
+    for (auto idx : jit.selfCallTargets)
+        Pool::patch(idx, function.function()->container());
+    jit.selfCallTargets.clear();
     return function.function();
 }
 
@@ -72,10 +72,46 @@ void Compiler::compileFunction(rir::DispatchTable* src, const std::string& name,
                    fail, outerFeedback);
 }
 
+void Compiler::compileRegion(SEXP closure, const std::string& name,
+                             Opcode* start, Opcode* end, size_t stackSize,
+                             MaybeCls success, Maybe fail) {
+    assert(isValidClosureSEXP(closure));
+
+    DispatchTable* tbl = DispatchTable::unpack(BODY(closure));
+    auto fun = tbl->baseline();
+    auto pirClosure = module->getOrDeclareRirClosure(name, closure, fun,
+                                                     tbl->userDefinedContext());
+
+    auto version = pirClosure->declareVersion(Context(), true, fun);
+    Builder builder(version);
+    auto& log = logger.begin(version);
+    Rir2Pir rir2pir(*this, version, log, pirClosure->name(), {});
+
+    if (rir2pir.tryCompileRegion(start, end, stackSize, builder)) {
+        log.compilationEarlyPir(version);
+#ifdef FULLVERIFIER
+        Verify::apply(version, "Error after initial translation", true);
+#else
+#ifndef NDEBUG
+        Verify::apply(version, "Error after initial translation");
+#endif
+#endif
+        log.flush();
+        return success(version);
+    }
+
+    log.failed("rir2pir aborted");
+    log.flush();
+    logger.close(version);
+    pirClosure->erase(Context());
+    return fail();
+}
+
 void Compiler::compileClosure(Closure* closure, rir::Function* optFunction,
-                              const Context& ctx, bool root, MaybeCls success,
+                              const Context& ctx_, bool root, MaybeCls success,
                               Maybe fail,
                               std::list<PirTypeFeedback*> outerFeedback) {
+    Context ctx = ctx_;
 
     if (!ctx.includes(minimalContext)) {
         for (const auto a : minimalContext) {
@@ -88,16 +124,12 @@ void Compiler::compileClosure(Closure* closure, rir::Function* optFunction,
         }
     }
 
-    // Currently dots args are not supported in PIR. Unless if we statically
-    // matched all arguments correctly and are therefore guaranteed to receive a
-    // `...` list as DOTSXP in the correct location, we can support them.
-    // TODO: extend call instruction to do the necessary argument shuffling to
-    // support it in all cases
-    if (!ctx.includes(Assumption::StaticallyArgmatched) &&
-        closure->formals().hasDots()) {
-        logger.warn("no support for ...");
-        return fail();
-    }
+    // PIR expects to receive the `...` list as DOTSXP in the correct location.
+    // Calls which are not statically argmatched by the caller are matched at
+    // runtime before entering an optimized version (see
+    // rirCallRuntimeArgmatched), thus we can always assume it.
+    if (closure->formals().hasDots())
+        ctx.add(Assumption::StaticallyArgmatched);
 
     if (closure->rirFunction()->body()->codeSize > Parameter::MAX_INPUT_SIZE) {
         closure->rirFunction()->flags.set(Function::NotOptimizable);
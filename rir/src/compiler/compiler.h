@@ -36,6 +36,11 @@ class Compiler {
                          SEXP formals, SEXP srcRef, const Context& ctx,
                          MaybeCls success, Maybe fail,
                          std::list<PirTypeFeedback*> outerFeedback);
+    // Compiles the code between start and end of the closure body (see
+    // CodeRegions), to run in the environment of the closure invocation.
+    void compileRegion(SEXP, const std::string& name, Opcode* start,
+                       Opcode* end, size_t stackSize, MaybeCls success,
+                       Maybe fail);
     void optimizeModule();
 
     bool seenC = false;
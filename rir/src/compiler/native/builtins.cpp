@@ -1,6 +1,8 @@
 #include "builtins.h"
 
+#include "compiler/native/matrix_kernels.h"
 #include "compiler/native/types_llvm.h"
+#include "compiler/native/vector_kernels.h"
 #include "compiler/parameter.h"
 #include "interpreter/cache.h"
 #include "interpreter/call_context.h"
@@ -14,6 +16,9 @@
 #include "R/Symbols.h"
 #include <R_ext/RS.h> /* for Memzero */
 
+#include <complex>
+#include <vector>
+
 #include "llvm/IR/Attributes.h"
 
 namespace rir {
@@ -110,6 +115,18 @@ SEXP ldvarForUpdateImpl(SEXP sym, SEXP env) {
     return res;
 }
 
+SEXP ldddvarImpl(SEXP sym, SEXP env) {
+    auto res = Rf_ddfindVar(sym, env);
+    if (res == R_UnboundValue) {
+        Rf_error("object \"%s\" not found", CHAR(PRINTNAME(sym)));
+    } else if (res == R_MissingArg) {
+        Rf_error("argument \"%s\" is missing, with no default",
+                 CHAR(PRINTNAME(sym)));
+    }
+    ENSURE_NAMED(res);
+    return res;
+}
+
 SEXP ldvarImpl(SEXP a, SEXP b) {
     auto res = Rf_findVar(a, b);
     // std::cout << CHAR(PRINTNAME(a)) << "=";
@@ -373,7 +390,231 @@ SEXP createClosureImpl(SEXP body, SEXP formals, SEXP env, SEXP srcref) {
     SET_FORMALS(res, formals);
     SET_BODY(res, body);
     SET_CLOENV(res, env);
-    Rf_setAttrib(res, Rf_install("srcref"), srcref);
+    if (srcref != R_NilValue)
+        Rf_setAttrib(res, symbol::srcref, srcref);
+    return res;
+}
+
+// Inner functions created repeatedly in the same environment, e.g. in a loop,
+// are all equal. Only sites whose closures are just called are given a cache
+// (see LowerFunctionLLVM), as otherwise sharing the closure would be
+// observable. Closures being debugged or traced are never reused. The cache
+// holds the last closure in a weak reference keyed on its environment, the
+// environment of the last miss, and hit and miss counters. The weak reference
+// is only allocated once a closure is created twice in the same environment,
+// and sites where the environment keeps changing stop caching.
+static const int CLOSURE_CACHE_MAX_MISSES = 8;
+SEXP createClosureCachedImpl(SEXP body, SEXP formals, SEXP env, SEXP srcref,
+                             SEXP cache) {
+    if (cache != R_NilValue) {
+        auto last = VECTOR_ELT(cache, 0);
+        if (last != R_NilValue && R_WeakRefKey(last) == env) {
+            auto cls = R_WeakRefValue(last);
+            if (TYPEOF(cls) == CLOSXP && !RDEBUG(cls) && !RSTEP(cls) &&
+                !RTRACE(cls)) {
+                INTEGER(VECTOR_ELT(cache, 1))[0]++;
+                return cls;
+            }
+        }
+    }
+
+    if (pir::Parameter::SPLIT_INNER_FEEDBACK)
+        body = innerFunctionInstance(body, formals, env, globalContext());
+    PROTECT(body);
+    auto res = createClosureImpl(body, formals, env, srcref);
+    UNPROTECT(1);
+    if (cache == R_NilValue || TYPEOF(env) != ENVSXP)
+        return res;
+    auto counters = INTEGER(VECTOR_ELT(cache, 1));
+    if (counters[1] > counters[0] + CLOSURE_CACHE_MAX_MISSES)
+        return res;
+
+    counters[1]++;
+    // Only compared, never dereferenced, thus not traced
+    auto lastEnv = reinterpret_cast<SEXP*>(RAW(VECTOR_ELT(cache, 2)));
+    if (*lastEnv != env) {
+        *lastEnv = env;
+        return res;
+    }
+    PROTECT(res);
+    ENSURE_NAMEDMAX(res);
+    SET_VECTOR_ELT(cache, 0, R_MakeWeakRef(env, res, R_NilValue, FALSE));
+    UNPROTECT(1);
+    return res;
+}
+
+// match(x, table) on attribute-free atomic vectors of the same type, with the
+// hash index of the table cached at the call site. Usually the table is a
+// loop-invariant lookup vector, so the index is built only once. The cache
+// holds on to the table and marks it shared, thus the table cannot be
+// modified in place while cached and the index stays valid as long as the
+// same vector comes back. Sites where the table keeps changing stop caching.
+// Returns nullptr if the arguments are not supported.
+static const int MATCH_CACHE_MAX_MISSES = 8;
+
+// The call site caches live as long as the native code, but R cannot weakly
+// reference vectors. Instead all caches holding a table are dropped by the
+// finalizer of an otherwise unreachable sentinel, i.e. at the next garbage
+// collection which frees it. Thus a table is kept alive by a cache at most
+// until that collection.
+static std::vector<SEXP> matchCachesInUse;
+static bool matchCacheSentinelArmed = false;
+
+static void clearMatchCaches(SEXP) {
+    for (auto cache : matchCachesInUse) {
+        SET_VECTOR_ELT(cache, 0, R_NilValue);
+        SET_VECTOR_ELT(cache, 1, R_NilValue);
+        // Filling the cache again is not a miss
+        INTEGER(VECTOR_ELT(cache, 2))[1]--;
+    }
+    matchCachesInUse.clear();
+    matchCacheSentinelArmed = false;
+}
+
+static void armMatchCacheSentinel() {
+    if (matchCacheSentinelArmed)
+        return;
+    auto sentinel = R_MakeExternalPtr(nullptr, R_NilValue, R_NilValue);
+    PROTECT(sentinel);
+    R_RegisterCFinalizerEx(sentinel, clearMatchCaches, FALSE);
+    UNPROTECT(1);
+    matchCacheSentinelArmed = true;
+}
+
+static RIR_INLINE uint64_t matchHash(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static RIR_INLINE uint64_t matchKeyInt(SEXP v, R_xlen_t i) {
+    return (uint32_t)INTEGER(v)[i];
+}
+
+static RIR_INLINE uint64_t matchKeyReal(SEXP v, R_xlen_t i) {
+    // -0 matches 0, NA and NaN are different from each other
+    double d = REAL(v)[i];
+    if (d == 0)
+        d = 0;
+    else if (R_IsNA(d))
+        d = NA_REAL;
+    else if (ISNAN(d))
+        d = R_NaN;
+    uint64_t k;
+    memcpy(&k, &d, sizeof(d));
+    return k;
+}
+
+static RIR_INLINE uint64_t matchKeyStr(SEXP v, R_xlen_t i) {
+    // Only used for ASCII tables, where equal strings are the same CHARSXP
+    return (uintptr_t)STRING_ELT(v, i);
+}
+
+template <typename Key>
+static SEXP buildMatchIndex(SEXP table, Key key) {
+    auto n = XLENGTH(table);
+    size_t size = 16;
+    while (size < 2 * (size_t)n)
+        size <<= 1;
+    auto index = Rf_allocVector(INTSXP, size);
+    auto entries = INTEGER(index);
+    memset(entries, 0, size * sizeof(int));
+    auto mask = size - 1;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        auto k = key(table, i);
+        auto h = matchHash(k) & mask;
+        while (entries[h] && key(table, entries[h] - 1) != k)
+            h = (h + 1) & mask;
+        // the first occurrence wins
+        if (!entries[h])
+            entries[h] = i + 1;
+    }
+    return index;
+}
+
+template <typename Key>
+static SEXP lookupMatchIndex(SEXP x, SEXP table, SEXP index, int nomatch,
+                             Key key) {
+    auto n = XLENGTH(x);
+    auto entries = INTEGER(index);
+    auto mask = (size_t)XLENGTH(index) - 1;
+    auto res = Rf_allocVector(INTSXP, n);
+    for (R_xlen_t i = 0; i < n; ++i) {
+        auto k = key(x, i);
+        auto h = matchHash(k) & mask;
+        while (entries[h] && key(table, entries[h] - 1) != k)
+            h = (h + 1) & mask;
+        INTEGER(res)[i] = entries[h] ? entries[h] : nomatch;
+    }
+    return res;
+}
+
+SEXP matchCachedImpl(SEXP x, SEXP table, SEXP nomatch, SEXP incomparables,
+                     SEXP cache) {
+    auto type = TYPEOF(table);
+    if (TYPEOF(x) != type ||
+        (type != INTSXP && type != REALSXP && type != STRSXP) ||
+        OBJECT(x) || OBJECT(table) || XLENGTH(table) >= INT_MAX / 4)
+        return nullptr;
+    if (incomparables != R_NilValue &&
+        !(IS_SIMPLE_SCALAR(incomparables, LGLSXP) &&
+          LOGICAL(incomparables)[0] == 0))
+        return nullptr;
+    if (XLENGTH(nomatch) != 1 ||
+        (TYPEOF(nomatch) != INTSXP && TYPEOF(nomatch) != LGLSXP &&
+         TYPEOF(nomatch) != REALSXP))
+        return nullptr;
+    if (type == STRSXP && VECTOR_ELT(cache, 0) != table) {
+        for (R_xlen_t i = 0; i < XLENGTH(table); ++i) {
+            auto s = STRING_ELT(table, i);
+            if (s != NA_STRING && !IS_ASCII(s))
+                return nullptr;
+        }
+    }
+    int nm = Rf_asInteger(nomatch);
+
+    auto counters = INTEGER(VECTOR_ELT(cache, 2));
+    auto index = VECTOR_ELT(cache, 1);
+    if (VECTOR_ELT(cache, 0) == table) {
+        counters[0]++;
+    } else {
+        switch (type) {
+        case INTSXP:
+            index = buildMatchIndex(table, matchKeyInt);
+            break;
+        case REALSXP:
+            index = buildMatchIndex(table, matchKeyReal);
+            break;
+        default:
+            index = buildMatchIndex(table, matchKeyStr);
+        }
+        if (counters[1] <= counters[0] + MATCH_CACHE_MAX_MISSES) {
+            PROTECT(index);
+            armMatchCacheSentinel();
+            UNPROTECT(1);
+            if (VECTOR_ELT(cache, 0) == R_NilValue)
+                matchCachesInUse.push_back(cache);
+            counters[1]++;
+            ENSURE_NAMEDMAX(table);
+            SET_VECTOR_ELT(cache, 0, table);
+            SET_VECTOR_ELT(cache, 1, index);
+        }
+    }
+
+    PROTECT(index);
+    SEXP res;
+    switch (type) {
+    case INTSXP:
+        res = lookupMatchIndex(x, table, index, nm, matchKeyInt);
+        break;
+    case REALSXP:
+        res = lookupMatchIndex(x, table, index, nm, matchKeyReal);
+        break;
+    default:
+        res = lookupMatchIndex(x, table, index, nm, matchKeyStr);
+    }
+    UNPROTECT(1);
     return res;
 }
 
@@ -393,6 +634,56 @@ SEXP newIntFromRealImpl(double d) {
 SEXP newRealImpl(double i) { return ScalarReal(i); }
 SEXP newRealFromIntImpl(int i) { return ScalarReal(i == NA_INTEGER ? NAN : i); }
 
+SEXP newComplexImpl(double re, double im) {
+    Rcomplex z;
+    z.r = re;
+    z.i = im;
+    return ScalarComplex(z);
+}
+
+SEXP newRawImpl(int i) { return ScalarRaw((Rbyte)i); }
+
+int stringEqImpl(SEXP a, SEXP b) { return charsxpEq(a, b); }
+
+// Multiplication and division of unboxed complex scalars, following what
+// arithmetic.c in R does for complex vectors.
+SEXP complexBinopImpl(double ar, double ai, double br, double bi, int kind) {
+    Rcomplex z;
+    switch ((BinopKind)kind) {
+    case BinopKind::MUL: {
+        auto res = std::complex<double>(ar, ai) * std::complex<double>(br, bi);
+        z.r = res.real();
+        z.i = res.imag();
+        break;
+    }
+    case BinopKind::DIV: {
+        // complex_div from complex.c, such that the results match R exactly
+        double ratio, den;
+        double abr, abi;
+
+        if ((abr = br) < 0)
+            abr = -abr;
+        if ((abi = bi) < 0)
+            abi = -abi;
+        if (abr <= abi) {
+            ratio = br / bi;
+            den = bi * (1 + ratio * ratio);
+            z.r = (ar * ratio + ai) / den;
+            z.i = (ai * ratio - ar) / den;
+        } else {
+            ratio = bi / br;
+            den = br * (1 + ratio * ratio);
+            z.r = (ar + ai * ratio) / den;
+            z.i = (ai - ar * ratio) / den;
+        }
+        break;
+    }
+    default:
+        assert(false);
+    }
+    return ScalarComplex(z);
+}
+
 #define OPERATION_FALLBACK(op)                                                 \
     do {                                                                       \
         static SEXP prim = NULL;                                               \
@@ -535,6 +826,9 @@ static SEXP notImpl(SEXP argument) {
 
 static SEXP binopEnvImpl(SEXP lhs, SEXP rhs, SEXP env, Immediate srcIdx,
                          BinopKind kind) {
+    if (auto res = VectorKernels::binop(lhs, rhs, kind))
+        return res;
+
     SEXP res = nullptr;
     SEXP arglist;
     FAKE_ARGS2(arglist, lhs, rhs);
@@ -598,6 +892,9 @@ static SEXP binopEnvImpl(SEXP lhs, SEXP rhs, SEXP env, Immediate srcIdx,
 
 bool debugBinopImpl = false;
 static SEXP binopImpl(SEXP lhs, SEXP rhs, BinopKind kind) {
+    if (auto res = VectorKernels::binop(lhs, rhs, kind))
+        return res;
+
     SEXP res = nullptr;
 
     SEXP arglist;
@@ -784,6 +1081,9 @@ void deoptImpl(Code* c, SEXP cls, DeoptMetadata* m, R_bcstack_t* args) {
             // always recompiling would just blow testing time...
             auto dt = DispatchTable::unpack(BODY(cls));
             dt->remove(c);
+            // Keep the deopt history on the baseline, it outlives the
+            // optimized versions and drives the recompilation back-off
+            dt->baseline()->registerDeopt();
         } else {
             // In some cases we don't know the callee here, so we can't properly
             // remove the deoptimized code. But we can kill the native code,
@@ -1228,6 +1528,8 @@ static SEXP nativeCallTrampolineImpl(ArglistOrder::CallId callId, rir::Code* c,
 
 SEXP subassign11Impl(SEXP vector, SEXP index, SEXP value, SEXP env,
                      Immediate srcIdx) {
+    if (auto grown = appendScalar(vector, index, value, false))
+        return grown;
     if (MAYBE_SHARED(vector))
         vector = Rf_shallow_duplicate(vector);
     PROTECT(vector);
@@ -1251,6 +1553,56 @@ SEXP subassign11Impl(SEXP vector, SEXP index, SEXP value, SEXP env,
     return res;
 }
 
+// Materializes an ALTREP vector for loops that access its data directly
+void* altrepDataPtrImpl(SEXP v) { return DATAPTR(v); }
+
+// `x <- c(x, v)`, where the old value of x is dead afterwards. Appends v to x
+// in place if x is unshared (see growVector). Returns nullptr otherwise.
+SEXP appendInPlaceImpl(SEXP x, SEXP v) {
+    auto type = TYPEOF(x);
+    if (TYPEOF(v) != type || MAYBE_SHARED(x) || ALTREP(x) ||
+        ATTRIB(x) != R_NilValue || ATTRIB(v) != R_NilValue ||
+        (type != LGLSXP && type != INTSXP && type != REALSXP &&
+         type != STRSXP))
+        return nullptr;
+    auto n = XLENGTH(x);
+    auto m = XLENGTH(v);
+    if (m == 0)
+        return x;
+    x = growVector(x, n + m);
+    switch (type) {
+    case LGLSXP:
+    case INTSXP:
+        for (R_xlen_t i = 0; i < m; ++i)
+            INTEGER(x)[n + i] = INTEGER(v)[i];
+        break;
+    case REALSXP:
+        for (R_xlen_t i = 0; i < m; ++i)
+            REAL(x)[n + i] = REAL(v)[i];
+        break;
+    case STRSXP:
+        for (R_xlen_t i = 0; i < m; ++i)
+            SET_STRING_ELT(x, n + i, STRING_ELT(v, i));
+        break;
+    }
+    return x;
+}
+
+// Checks if vec[pos] can be assigned in place. Assigning one past the end
+// grows the vector, which then needs to be protected.
+static RIR_INLINE bool assignableAt(SEXP& vec, R_xlen_t pos, int& prot) {
+    if (pos < 0)
+        return false;
+    if (pos < XLENGTH(vec))
+        return true;
+    if (pos != XLENGTH(vec) || ATTRIB(vec) != R_NilValue)
+        return false;
+    vec = growVector(vec, pos + 1);
+    PROTECT(vec);
+    prot++;
+    return true;
+}
+
 SEXP subassign21Impl(SEXP vec, SEXP idx, SEXP val, SEXP env, Immediate srcIdx) {
     int prot = 0;
     if (MAYBE_SHARED(vec)) {
@@ -1270,30 +1622,23 @@ SEXP subassign21Impl(SEXP vec, SEXP idx, SEXP val, SEXP env, Immediate srcIdx) {
         }
         if (pos != (R_xlen_t)-1) {
             if (IS_SIMPLE_SCALAR(val, INTSXP) && TYPEOF(vec) == INTSXP) {
-                if (XLENGTH(vec) > pos ||
-                    (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                    if (XLENGTH(vec) == pos)
-                        SETLENGTH(vec, pos + 1);
+                if (assignableAt(vec, pos, prot)) {
                     INTEGER(vec)[pos] = *INTEGER(val);
                     UNPROTECT(prot);
                     return vec;
                 }
             }
             if (IS_SIMPLE_SCALAR(val, REALSXP) && TYPEOF(vec) == REALSXP) {
-                if (XLENGTH(vec) > pos ||
-                    (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                    if (XLENGTH(vec) == pos)
-                        SETLENGTH(vec, pos + 1);
+                if (assignableAt(vec, pos, prot)) {
                     REAL(vec)[pos] = *REAL(val);
                     UNPROTECT(prot);
                     return vec;
                 }
             }
-            if (TYPEOF(vec) == VECSXP) {
-                if (XLENGTH(vec) > pos ||
-                    (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                    if (XLENGTH(vec) == pos)
-                        SETLENGTH(vec, pos + 1);
+            // x[[i]] <- NULL deletes the element, and x[[i]] <- x needs a copy
+            // of x to not create a cycle
+            if (TYPEOF(vec) == VECSXP && val != R_NilValue && val != vec) {
+                if (assignableAt(vec, pos, prot)) {
                     SET_VECTOR_ELT(vec, pos, val);
                     UNPROTECT(prot);
                     return vec;
@@ -1335,20 +1680,14 @@ SEXP subassign21rrImpl(SEXP vec, double idx, double val, SEXP env,
         auto pos = (R_xlen_t)(idx - 1);
 
         if (TYPEOF(vec) == REALSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 REAL(vec)[pos] = val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == VECSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 SET_VECTOR_ELT(vec, pos, ScalarReal(val));
                 UNPROTECT(prot);
                 return vec;
@@ -1375,20 +1714,14 @@ SEXP subassign21irImpl(SEXP vec, int idx, double val, SEXP env,
         auto pos = (idx - 1);
 
         if (TYPEOF(vec) == REALSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 REAL(vec)[pos] = val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == VECSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 SET_VECTOR_ELT(vec, pos, ScalarReal(val));
                 UNPROTECT(prot);
                 return vec;
@@ -1415,30 +1748,21 @@ SEXP subassign21riImpl(SEXP vec, double idx, int val, SEXP env,
         auto pos = (R_xlen_t)(idx - 1);
 
         if (TYPEOF(vec) == INTSXP || TYPEOF(vec) == LGLSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 INTEGER(vec)[pos] = val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == REALSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 REAL(vec)[pos] = val == NA_INTEGER ? NAN : val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == VECSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 SET_VECTOR_ELT(vec, pos, ScalarInteger(val));
                 UNPROTECT(prot);
                 return vec;
@@ -1464,30 +1788,21 @@ SEXP subassign21iiImpl(SEXP vec, int idx, int val, SEXP env, Immediate srcIdx) {
         auto pos = idx - 1;
 
         if (TYPEOF(vec) == INTSXP || TYPEOF(vec) == LGLSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 INTEGER(vec)[pos] = val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == REALSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 REAL(vec)[pos] = val == NA_INTEGER ? NAN : val;
                 UNPROTECT(prot);
                 return vec;
             }
         }
         if (TYPEOF(vec) == VECSXP) {
-            if (XLENGTH(vec) > pos ||
-                (XLENGTH(vec) >= pos && XTRUELENGTH(vec) > pos)) {
-                if (XLENGTH(vec) == pos)
-                    SETLENGTH(vec, pos + 1);
+            if (assignableAt(vec, pos, prot)) {
                 SET_VECTOR_ELT(vec, pos, ScalarInteger(val));
                 UNPROTECT(prot);
                 return vec;
@@ -1907,6 +2222,13 @@ static void endClosureContextImpl(RCNTXT* cntxt, SEXP result) {
     Rf_endcontext(cntxt);
 }
 
+static void initLoopContextImpl(RCNTXT* cntxt, SEXP env) {
+    Rf_begincontext(cntxt, CTXT_LOOP, R_NilValue, env, R_BaseEnv, R_NilValue,
+                    R_NilValue);
+}
+
+static void endLoopContextImpl(RCNTXT* cntxt) { Rf_endcontext(cntxt); }
+
 int ncolsImpl(SEXP v) { return getMatrixDim(v).col; }
 
 int nrowsImpl(SEXP v) { return getMatrixDim(v).row; }
@@ -1924,39 +2246,9 @@ SEXP makeVectorImpl(int mode, size_t len) {
     return s;
 }
 
-double prodrImpl(SEXP v) {
-    double res = 1;
-    auto len = XLENGTH(v);
-    if (TYPEOF(v) == REALSXP) {
-        for (R_xlen_t i = 0; i < len; ++i) {
-            res *= REAL(v)[i];
-        }
-    } else if (TYPEOF(v) == INTSXP) {
-        for (R_xlen_t i = 0; i < len; ++i) {
-            res *= INTEGER(v)[i];
-        }
-    } else {
-        assert(false);
-    }
-    return res;
-}
+double prodrImpl(SEXP v) { return VectorKernels::prod(v); }
 
-double sumrImpl(SEXP v) {
-    double res = 0;
-    auto len = XLENGTH(v);
-    if (TYPEOF(v) == REALSXP) {
-        for (R_xlen_t i = 0; i < len; ++i) {
-            res += REAL(v)[i];
-        }
-    } else if (TYPEOF(v) == INTSXP) {
-        for (R_xlen_t i = 0; i < len; ++i) {
-            res += INTEGER(v)[i];
-        }
-    } else {
-        assert(false);
-    }
-    return res;
-}
+double sumrImpl(SEXP v) { return VectorKernels::sum(v); }
 
 SEXP namesImpl(SEXP val) { return Rf_getAttrib(val, R_NamesSymbol); }
 
@@ -1969,6 +2261,21 @@ SEXP setNamesImpl(SEXP val, SEXP names) {
 
 size_t xlengthImpl(SEXP val) { return Rf_xlength(val); }
 
+// Element access through the ALTREP class, which does not materialize the
+// vector like DATAPTR would
+int altrepIntEltImpl(SEXP val, size_t i) {
+    assert(ALTREP(val));
+    if (TYPEOF(val) == LGLSXP)
+        return LOGICAL_ELT(val, i);
+    assert(TYPEOF(val) == INTSXP);
+    return INTEGER_ELT(val, i);
+}
+
+double altrepRealEltImpl(SEXP val, size_t i) {
+    assert(ALTREP(val) && TYPEOF(val) == REALSXP);
+    return REAL_ELT(val, i);
+}
+
 SEXP getAttribImpl(SEXP val, SEXP sym) { return Rf_getAttrib(val, sym); }
 
 void nonLocalReturnImpl(SEXP res, SEXP env) {
@@ -2031,6 +2338,7 @@ void NativeBuiltins::initializeBuiltins() {
         "ldvarCacheMiss", (void*)&ldvarCachedImpl,
         llvm::FunctionType::get(t::SEXP, {t::SEXP, t::SEXP, t::SEXP_ptr},
                                 false)};
+    get_(Id::ldddvar) = {"ldddvar", (void*)&ldddvarImpl, t::sexp_sexpsexp};
     get_(Id::stvarSuper) = {"stvarSuper", (void*)&stvarSuperImpl,
                             t::void_sexpsexpsexp};
     get_(Id::stvar) = {"stvar", (void*)&stvarImpl, t::void_sexpsexpsexp};
@@ -2105,6 +2413,19 @@ void NativeBuiltins::initializeBuiltins() {
         "createClosure", (void*)&createClosureImpl,
         llvm::FunctionType::get(t::SEXP, {t::SEXP, t::SEXP, t::SEXP, t::SEXP},
                                 false)};
+    get_(Id::createClosureCached) = {
+        "createClosureCached", (void*)&createClosureCachedImpl,
+        llvm::FunctionType::get(
+            t::SEXP, {t::SEXP, t::SEXP, t::SEXP, t::SEXP, t::SEXP}, false)};
+    get_(Id::appendInPlace) = {"appendInPlace", (void*)&appendInPlaceImpl,
+                               t::sexp_sexpsexp};
+    get_(Id::altrepDataPtr) = {
+        "altrepDataPtr", (void*)&altrepDataPtrImpl,
+        llvm::FunctionType::get(t::voidPtr, {t::SEXP}, false)};
+    get_(Id::matchCached) = {
+        "matchCached", (void*)&matchCachedImpl,
+        llvm::FunctionType::get(
+            t::SEXP, {t::SEXP, t::SEXP, t::SEXP, t::SEXP, t::SEXP}, false)};
     get_(Id::newIntFromReal) = {
         "newIntFromReal", (void*)&newIntFromRealImpl,
         llvm::FunctionType::get(t::SEXP, {t::Double}, false)};
@@ -2118,6 +2439,17 @@ void NativeBuiltins::initializeBuiltins() {
         llvm::FunctionType::get(t::SEXP, {t::Int, t::i64}, false)};
     get_(Id::newReal) = {"newReal", (void*)&newRealImpl,
                          llvm::FunctionType::get(t::SEXP, {t::Double}, false)};
+    get_(Id::newComplex) = {
+        "newComplex", (void*)&newComplexImpl,
+        llvm::FunctionType::get(t::SEXP, {t::Double, t::Double}, false)};
+    get_(Id::newRaw) = {"newRaw", (void*)&newRawImpl,
+                        llvm::FunctionType::get(t::SEXP, {t::Int}, false)};
+    get_(Id::stringEq) = {"stringEq", (void*)&stringEqImpl, t::int_sexpsexp};
+    get_(Id::complexBinop) = {
+        "complexBinop", (void*)&complexBinopImpl,
+        llvm::FunctionType::get(
+            t::SEXP, {t::Double, t::Double, t::Double, t::Double, t::Int},
+            false)};
     get_(Id::unopEnv) = {"unopEnv", (void*)&unopEnvImpl, t::sexp_sexp2int2};
     get_(Id::unop) = {"unop", (void*)&unopImpl, t::sexp_sexpint};
     get_(Id::notEnv) = {"notEnv", (void*)&notEnvImpl, t::sexp_sexpsexpint};
@@ -2266,6 +2598,12 @@ void NativeBuiltins::initializeBuiltins() {
     get_(Id::endClosureContext) = {
         "endClosureContext", (void*)&endClosureContextImpl,
         llvm::FunctionType::get(t::t_void, {t::RCNTXT_ptr, t::SEXP}, false)};
+    get_(Id::initLoopContext) = {
+        "initLoopContext", (void*)&initLoopContextImpl,
+        llvm::FunctionType::get(t::t_void, {t::RCNTXT_ptr, t::SEXP}, false)};
+    get_(Id::endLoopContext) = {
+        "endLoopContext", (void*)&endLoopContextImpl,
+        llvm::FunctionType::get(t::t_void, {t::RCNTXT_ptr}, false)};
     get_(Id::matrixNcols) = {"ncols",
                              (void*)ncolsImpl,
                              t::int_sexp,
@@ -2291,6 +2629,16 @@ void NativeBuiltins::initializeBuiltins() {
         (void*)sumrImpl,
         llvm::FunctionType::get(t::Double, {t::SEXP}, false),
         {llvm::Attribute::ReadOnly, llvm::Attribute::Speculatable}};
+    get_(Id::matprod) = {"matprod", (void*)&MatrixKernels::matprod,
+                         t::sexp_sexpsexp};
+    get_(Id::crossprod) = {"crossprod", (void*)&MatrixKernels::crossprod,
+                           t::sexp_sexpsexp};
+    get_(Id::transpose) = {"transpose", (void*)&MatrixKernels::transpose,
+                           t::sexp_sexp};
+    get_(Id::rowSums) = {"rowSums", (void*)&MatrixKernels::rowSums,
+                         t::sexp_sexpsexpsexpsexp};
+    get_(Id::colSums) = {"colSums", (void*)&MatrixKernels::colSums,
+                         t::sexp_sexpsexpsexpsexp};
     get_(Id::colonInputEffects) = {
         "colonInputEffects", (void*)rir::colonInputEffects,
         llvm::FunctionType::get(t::Int, {t::SEXP, t::SEXP, t::Int}, false)};
@@ -2311,6 +2659,12 @@ void NativeBuiltins::initializeBuiltins() {
                          (void*)&xlengthImpl,
                          llvm::FunctionType::get(t::i64, {t::SEXP}, false),
                          {}};
+    get_(Id::altrepIntElt) = {
+        "altrepIntElt", (void*)&altrepIntEltImpl,
+        llvm::FunctionType::get(t::Int, {t::SEXP, t::i64}, false)};
+    get_(Id::altrepRealElt) = {
+        "altrepRealElt", (void*)&altrepRealEltImpl,
+        llvm::FunctionType::get(t::Double, {t::SEXP, t::i64}, false)};
     get_(Id::getAttrb) = {
         "getAttrib",
         (void*)&getAttribImpl,
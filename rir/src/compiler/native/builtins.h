@@ -66,6 +66,7 @@ struct NativeBuiltins {
         ldvar,
         ldvarGlobal,
         ldvarCacheMiss,
+        ldddvar,
         stvarSuper,
         stvar,
         stvari,
@@ -89,11 +90,19 @@ struct NativeBuiltins {
         createPromiseNoEnv,
         createPromiseEager,
         createClosure,
+        createClosureCached,
+        matchCached,
+        appendInPlace,
+        altrepDataPtr,
         newIntFromReal,
         newRealFromInt,
         newInt,
         newIntDebug,
         newReal,
+        newComplex,
+        newRaw,
+        complexBinop,
+        stringEq,
         unopEnv,
         unop,
         notEnv,
@@ -135,17 +144,26 @@ struct NativeBuiltins {
         forSeqSize,
         initClosureContext,
         endClosureContext,
+        initLoopContext,
+        endLoopContext,
         matrixNcols,
         matrixNrows,
         makeVector,
         prodr,
         sumr,
+        matprod,
+        crossprod,
+        transpose,
+        rowSums,
+        colSums,
         colonInputEffects,
         colonCastLhs,
         colonCastRhs,
         names,
         setNames,
         xlength,
+        altrepIntElt,
+        altrepRealElt,
         getAttrb,
         nonLocalReturn,
         clsEq,
@@ -23,6 +23,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cfloat>
 #include <cstdlib>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/GlobalObject.h>
@@ -46,6 +47,89 @@ extern "C" size_t R_NodesInUse;
 static_assert(sizeof(unsigned long) == sizeof(uint64_t),
               "sizeof(unsigned long) and sizeof(uint64_t) should match");
 
+// Recognizes `x <- c(x, v)`, where the old value of x is not used anywhere
+// else and nothing between the call and the store can observe x. Like for
+// subassigns, x can then be updated in place if it is not shared.
+static bool isAppendToSelf(CallSafeBuiltin* b) {
+    if (b->builtinId != blt("c") || b->nCallArgs() != 2)
+        return false;
+    auto st = StVar::Cast(b->hasSingleUse());
+    if (!st || st->isStArg || st->val() != b || st->bb() != b->bb())
+        return false;
+
+    Instruction* user = b;
+    auto v = b->callArg(0).val();
+    LdVar* ld = nullptr;
+    while (!ld) {
+        auto i = Instruction::Cast(v);
+        if (!i || i->hasSingleUse() != user)
+            return false;
+        ld = LdVar::Cast(i);
+        if (!ld) {
+            if (!CastType::Cast(i) && !Force::Cast(i))
+                return false;
+            user = i;
+            v = i->arg(0).val();
+        }
+    }
+    if (ld->varName != st->varName || ld->env() != st->env())
+        return false;
+
+    for (auto it = b->bb()->atPosition(b) + 1; *it != st; ++it)
+        if ((*it)->hasStrongEffects() || (*it)->readsEnv())
+            return false;
+    return true;
+}
+
+// The cell of the binding of sym in the frame of a static env. R unbinds the
+// cell when the binding is removed, thus compiled code can hold on to it.
+static SEXP frameBindingCell(Value* env, SEXP sym) {
+    auto e = Env::Cast(env);
+    if (!Env::isStaticEnv(env) || !e->rho || TYPEOF(e->rho) != ENVSXP)
+        return nullptr;
+    auto rho = e->rho;
+    if (rho == R_BaseNamespace || rho == R_BaseEnv || OBJECT(rho))
+        return nullptr;
+    auto loc = R_findVarLocInFrame(rho, sym);
+    if (R_VARLOC_IS_NULL(loc) || IS_ACTIVE_BINDING(loc.cell))
+        return nullptr;
+    return loc.cell;
+}
+
+// Closures which are only ever called directly. Their identity is visible to
+// the callee through sys.function, but cannot be kept by the caller.
+static bool onlyCalled(MkFunCls* mk, Code* code) {
+    return Visitor::check(code->entry, [&](Instruction* i) {
+        bool ok = true;
+        i->eachArg([&](InstrArg& arg) {
+            if (arg.val() != mk || FrameState::Cast(i))
+                return;
+            if ((Call::Cast(i) || NamedCall::Cast(i) || StaticCall::Cast(i)) &&
+                &arg == &i->arg(1))
+                return;
+            ok = false;
+        });
+        return ok;
+    });
+}
+
+// The matrix primitives with a native kernel, see MatrixKernels
+static bool matrixKernel(int builtin, size_t nargs, NativeBuiltins::Id& id) {
+    if (builtin == blt("%*%") && nargs == 2)
+        id = NativeBuiltins::Id::matprod;
+    else if (builtin == blt("crossprod") && (nargs == 1 || nargs == 2))
+        id = NativeBuiltins::Id::crossprod;
+    else if (builtin == blt("t.default") && nargs == 1)
+        id = NativeBuiltins::Id::transpose;
+    else if (builtin == blt("rowSums") && nargs == 4)
+        id = NativeBuiltins::Id::rowSums;
+    else if (builtin == blt("colSums") && nargs == 4)
+        id = NativeBuiltins::Id::colSums;
+    else
+        return false;
+    return true;
+}
+
 void LowerFunctionLLVM::PhiBuilder::addInput(llvm::Value* v) {
     addInput(v, builder.GetInsertBlock());
 }
@@ -318,7 +402,9 @@ llvm::Value* LowerFunctionLLVM::callRBuiltin(SEXP builtin,
                                              const std::vector<Value*>& args,
                                              int srcIdx, CCODE builtinFun,
                                              llvm::Value* env) {
-    if (supportsFastBuiltinCall(builtin)) {
+    // standardGeneric goes through the interpreter for its dispatch cache
+    if (supportsFastBuiltinCall(builtin) ||
+        builtin->u.primsxp.offset == blt("standardGeneric")) {
         return withCallFrame(args, [&]() -> llvm::Value* {
             return call(NativeBuiltins::get(NativeBuiltins::Id::callBuiltin),
                         {
@@ -560,6 +646,165 @@ llvm::Value* LowerFunctionLLVM::computeAndCheckIndex(Value* index,
     return nativeIndex;
 }
 
+// Loads the dims of a matrix or array of the given rank as i64. If v has no
+// dims of that rank they are all zero, such that every index check fails.
+std::vector<llvm::Value*> LowerFunctionLLVM::loadArrayDims(llvm::Value* v,
+                                                           size_t rank) {
+    static int noDims[3] = {0, 0, 0};
+    assert(rank <= 3);
+    std::vector<llvm::Value*> res;
+    if (v->getType() != t::SEXP) {
+        res.resize(rank, c(0ul));
+        return res;
+    }
+
+    auto isDim = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto isArray = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto done = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto ptr = phiBuilder(t::IntPtr);
+    auto none = convertToPointer(noDims, t::Int, true);
+
+    // TAG and CAR of R_NilValue are R_NilValue, no need to check for it first
+    auto attrs = attr(v);
+    auto dim = car(attrs);
+    auto dimTag =
+        builder.CreateICmpEQ(tag(attrs), constant(R_DimSymbol, t::SEXP));
+    auto dimInt = builder.CreateICmpEQ(sexptype(dim), c(INTSXP));
+    ptr.addInput(none);
+    builder.CreateCondBr(builder.CreateAnd(dimTag, dimInt), isDim, done,
+                         branchMostlyTrue);
+
+    builder.SetInsertPoint(isDim);
+    auto rightRank = builder.CreateICmpEQ(vectorLength(dim), c(rank));
+    rightRank = builder.CreateAnd(builder.CreateNot(isAltrep(dim)), rightRank);
+    ptr.addInput(none);
+    builder.CreateCondBr(rightRank, isArray, done, branchMostlyTrue);
+
+    builder.SetInsertPoint(isArray);
+    ptr.addInput(builder.CreateBitCast(dataPtr(dim, false), t::IntPtr));
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    auto dims = ptr();
+    for (size_t k = 0; k < rank; ++k)
+        res.push_back(builder.CreateZExt(
+            builder.CreateLoad(builder.CreateInBoundsGEP(dims, c((int)k))),
+            t::i64));
+    return res;
+}
+
+std::vector<llvm::Value*>
+LowerFunctionLLVM::arrayDims(Value* vec, llvm::Value* v, size_t rank) {
+    auto cached = arrayDimsCache.find(vec);
+    if (cached == arrayDimsCache.end())
+        cached = arrayDimsCache.find(vec->followCasts());
+    if (cached != arrayDimsCache.end() && cached->second.size() == rank)
+        return cached->second;
+    return loadArrayDims(v, rank);
+}
+
+// Assigning elements does not change the dims of a non-object array
+void LowerFunctionLLVM::inheritArrayDims(Instruction* i, Value* vec) {
+    auto cached = arrayDimsCache.find(vec);
+    if (cached != arrayDimsCache.end() && !vec->type.maybeObj() &&
+        Representation::Of(i) == t::SEXP)
+        arrayDimsCache[i] = cached->second;
+}
+
+// The class of compact integer sequences is not exported by R, we take it
+// from an instance. ALTREP classes are never freed. Null if R does not use
+// compact sequences.
+static SEXP compactIntseqClass() {
+    static SEXP cls = []() {
+        auto from = PROTECT(Rf_ScalarInteger(1));
+        auto to = PROTECT(Rf_ScalarInteger(2));
+        auto call = PROTECT(Rf_lang3(Rf_install(":"), from, to));
+        auto seq = Rf_eval(call, R_BaseEnv);
+        UNPROTECT(3);
+        return ALTREP(seq) ? TAG(seq) : nullptr;
+    }();
+    return cls;
+}
+
+// Element access on ALTREP vectors is only compiled where the type feedback
+// has seen them, otherwise they go to the generic builtins.
+bool LowerFunctionLLVM::altrepAccessSupported(Value* vector) {
+    auto type = vector->type;
+    if (type.isScalar() ||
+        (!type.isA(PirType(RType::integer).orFastVecelt()) &&
+         !type.isA(PirType(RType::logical).orFastVecelt()) &&
+         !type.isA(PirType(RType::real).orFastVecelt())))
+        return false;
+    if (auto i = Instruction::Cast(vector))
+        if (i->typeFeedback.altrep)
+            return true;
+    if (auto i = Instruction::Cast(vector->followCastsAndForce()))
+        return i->typeFeedback.altrep;
+    return false;
+}
+
+// Reads an element of an ALTREP vector without materializing it. Elements of
+// unexpanded compact integer sequences are computed from the start and the
+// increment, other vectors go through their Elt method.
+llvm::Value* LowerFunctionLLVM::accessAltrepVector(Value* index,
+                                                   llvm::Value* vector,
+                                                   PirType type,
+                                                   BasicBlock* fallback) {
+    auto done = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto generic = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    bool isReal = type.isA(PirType(RType::real).orFastVecelt());
+    auto res = phiBuilder(isReal ? t::Double : t::Int);
+
+    auto cls = compactIntseqClass();
+    if (cls && type.isA(PirType(RType::integer).orFastVecelt())) {
+        // Once expanded, e.g. because its data pointer was taken and written,
+        // the elements are in data2 and the info is stale
+        auto compact = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+        auto unexpanded =
+            BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+        builder.CreateCondBr(
+            builder.CreateICmpEQ(tag(vector), convertToPointer(cls, true)),
+            compact,
+            generic, branchMostlyTrue);
+        builder.SetInsertPoint(compact);
+        builder.CreateCondBr(
+            builder.CreateICmpEQ(cdr(vector), constant(R_NilValue, t::SEXP)),
+            unexpanded, generic, branchMostlyTrue);
+        builder.SetInsertPoint(unexpanded);
+
+        // The info vector holds the length, the first element and the
+        // increment as doubles
+        auto info = builder.CreateBitCast(dataPtr(car(vector), false),
+                                          t::DoublePtr);
+        auto field = [&](int pos) {
+            return builder.CreateLoad(builder.CreateInBoundsGEP(info, c(pos)));
+        };
+        auto length = builder.CreateFPToUI(field(0), t::i64);
+        auto first = builder.CreateFPToSI(field(1), t::i64);
+        auto inc = builder.CreateFPToSI(field(2), t::i64);
+
+        auto pos = computeAndCheckIndex(index, vector, fallback, length);
+        res.addInput(builder.CreateTrunc(
+            builder.CreateAdd(first, builder.CreateMul(inc, pos)), t::Int));
+        builder.CreateBr(done);
+    } else {
+        builder.CreateBr(generic);
+    }
+
+    builder.SetInsertPoint(generic);
+    auto length =
+        call(NativeBuiltins::get(NativeBuiltins::Id::xlength), {vector});
+    auto pos = computeAndCheckIndex(index, vector, fallback, length);
+    res.addInput(call(NativeBuiltins::get(
+                          isReal ? NativeBuiltins::Id::altrepRealElt
+                                 : NativeBuiltins::Id::altrepIntElt),
+                      {vector, pos}));
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    return res();
+}
+
 void LowerFunctionLLVM::compilePopContext(Instruction* i) {
     auto popc = PopContext::Cast(i);
     auto data = contexts.at(popc->push());
@@ -591,6 +836,88 @@ void LowerFunctionLLVM::compilePopContext(Instruction* i) {
     setVal(i, Representation::Of(i) == t::SEXP ? boxedRet : ret);
 }
 
+LowerFunctionLLVM::SavedLocals
+LowerFunctionLLVM::saveLiveLocals(Instruction* i, ContextData& data) {
+    // SEXPs are stored as local vars, primitive values are placed in an
+    // alloca'd buffer
+    SavedLocals savedLocals;
+    for (auto& v : variables_) {
+        auto& var = v.second;
+        if (!var.initialized)
+            continue;
+        auto j = v.first;
+        if (liveness.live(i, j)) {
+            if (Representation::Of(j) == t::SEXP) {
+                savedLocals.push_back(
+                    {j, Variable::MutableRVariable(j, data.savedSexpPos.at(j),
+                                                   builder, basepointer)});
+            } else {
+                savedLocals.push_back(
+                    {j,
+                     Variable::Mutable(j, topAlloca(Representation::Of(j)))});
+            }
+        }
+    }
+    for (auto& v : savedLocals)
+        v.second.set(builder, getVariable(v.first));
+    return savedLocals;
+}
+
+void LowerFunctionLLVM::restoreSavedLocals(const SavedLocals& savedLocals) {
+    for (auto& v : savedLocals) {
+        auto loc = v.first;
+        auto val = v.second.get(builder);
+        if (LLVMDebugInfo() && diVariables_.count(loc)) {
+            DIB->insertDbgValueIntrinsic(val, diVariables_[loc],
+                                         DIB->createExpression(),
+                                         builder.getCurrentDebugLocation(),
+                                         builder.GetInsertBlock());
+        }
+        updateVariable(loc, val);
+    }
+
+    // Also clear all binding caches
+    for (const auto& be : bindingsCache)
+        for (const auto& b : be.second)
+            builder.CreateStore(
+                llvm::ConstantPointerNull::get(t::SEXP),
+                builder.CreateGEP(bindingsCacheBase, c(b.second)));
+}
+
+llvm::Value* LowerFunctionLLVM::contextSetjmp(ContextData& data) {
+    auto setjmp = NativeBuiltins::get(NativeBuiltins::Id::sigsetjmp);
+#ifdef __APPLE__
+    auto setjmpBuf = builder.CreateGEP(data.rcntxt, {c(0), c(2), c(0)});
+#else
+    auto setjmpBuf = builder.CreateGEP(data.rcntxt, {c(0), c(2)});
+#endif
+    return builder.CreateCall(getBuiltin(setjmp), {setjmpBuf, c(0)});
+}
+
+void LowerFunctionLLVM::compilePushLoopContext(Instruction* i) {
+    auto push = PushLoopContext::Cast(i);
+    auto& data = contexts[i];
+
+    call(NativeBuiltins::get(NativeBuiltins::Id::initLoopContext),
+         {data.rcntxt, loadSxp(push->env())});
+
+    // Non-local break and next need to continue with the values from before
+    // the iteration
+    auto savedLocals = saveLiveLocals(i, data);
+
+    auto didLongjmp = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto longjmp = contextSetjmp(data);
+    builder.CreateCondBr(builder.CreateICmpEQ(longjmp, c(0)),
+                         getBlock(push->bodyBB()), didLongjmp,
+                         branchAlwaysTrue);
+
+    // The landing pad remembers if it was a break or next
+    builder.SetInsertPoint(didLongjmp);
+    builder.CreateStore(longjmp, data.result);
+    restoreSavedLocals(savedLocals);
+    builder.CreateBr(getBlock(push->landingBB()));
+}
+
 void LowerFunctionLLVM::compilePushContext(Instruction* i) {
     auto ct = PushContext::Cast(i);
     auto ast = loadSxp(ct->ast());
@@ -621,47 +948,13 @@ void LowerFunctionLLVM::compilePushContext(Instruction* i) {
                   false);
 
     // Create a copy of all live variables to be able to restart
-    // SEXPs are stored as local vars, primitive values are placed in an
-    // alloca'd buffer
-    std::vector<std::pair<Instruction*, Variable>> savedLocals;
-    {
-        for (auto& v : variables_) {
-            auto& var = v.second;
-            if (!var.initialized)
-                continue;
-            auto j = v.first;
-            if (liveness.live(i, j)) {
-                if (Representation::Of(j) == t::SEXP) {
-                    savedLocals.push_back({j, Variable::MutableRVariable(
-                                                  j, data.savedSexpPos.at(j),
-                                                  builder, basepointer)});
-                } else {
-                    savedLocals.push_back(
-                        {j, Variable::Mutable(
-                                j, topAlloca(Representation::Of(j)))});
-                }
-            }
-        }
-        for (auto& v : savedLocals)
-            v.second.set(builder, getVariable(v.first));
-    }
+    auto savedLocals = saveLiveLocals(i, data);
 
     // Do a setjmp
     auto didLongjmp = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
     auto cont = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
-    {
-        auto setjmp = NativeBuiltins::get(NativeBuiltins::Id::sigsetjmp);
-#ifdef __APPLE__
-        auto setjmpBuf = builder.CreateGEP(data.rcntxt, {c(0), c(2), c(0)});
-#else
-        auto setjmpBuf = builder.CreateGEP(data.rcntxt, {c(0), c(2)});
-#endif
-        auto longjmp =
-            builder.CreateCall(getBuiltin(setjmp), {setjmpBuf, c(0)});
-
-        builder.CreateCondBr(builder.CreateICmpEQ(longjmp, c(0)), cont,
-                             didLongjmp);
-    }
+    builder.CreateCondBr(builder.CreateICmpEQ(contextSetjmp(data), c(0)), cont,
+                         didLongjmp);
 
     // Handle Incomming longjumps
     {
@@ -681,24 +974,7 @@ void LowerFunctionLLVM::compilePushContext(Instruction* i) {
         // preserved them before the setjmp and then continue
         // execution
         builder.SetInsertPoint(longjmpRestart);
-        for (auto& v : savedLocals) {
-            auto loc = v.first;
-            auto val = v.second.get(builder);
-            if (LLVMDebugInfo() && diVariables_.count(loc)) {
-                DIB->insertDbgValueIntrinsic(val, diVariables_[loc],
-                                             DIB->createExpression(),
-                                             builder.getCurrentDebugLocation(),
-                                             builder.GetInsertBlock());
-            }
-            updateVariable(loc, val);
-        }
-
-        // Also clear all binding caches
-        for (const auto& be : bindingsCache)
-            for (const auto& b : be.second)
-                builder.CreateStore(
-                    llvm::ConstantPointerNull::get(t::SEXP),
-                    builder.CreateGEP(bindingsCacheBase, c(b.second)));
+        restoreSavedLocals(savedLocals);
         builder.CreateBr(cont);
 
         // The longjump returned a value to return.
@@ -737,7 +1013,9 @@ bool LowerFunctionLLVM::vectorTypeSupport(Value* vector) {
     return type.isA(PirType(RType::vec).orFastVecelt()) ||
            type.isA(PirType(RType::integer).orFastVecelt()) ||
            type.isA(PirType(RType::logical).orFastVecelt()) ||
-           type.isA(PirType(RType::real).orFastVecelt());
+           type.isA(PirType(RType::real).orFastVecelt()) ||
+           type.isA(PirType(RType::cplx).orFastVecelt()) ||
+           type.isA(PirType(RType::raw).orFastVecelt());
 }
 
 llvm::Value* LowerFunctionLLVM::vectorPositionPtr(llvm::Value* vector,
@@ -752,6 +1030,15 @@ llvm::Value* LowerFunctionLLVM::vectorPositionPtr(llvm::Value* vector,
         nativeType = t::DoublePtr;
     } else if (type.isA(PirType(RType::vec).orAttribsOrObj().fastVecelt())) {
         nativeType = t::SEXP_ptr;
+    } else if (type.isA(PirType(RType::cplx).orAttribsOrObj().fastVecelt())) {
+        // Rcomplex is laid out as two consecutive doubles
+        auto pos = builder.CreateBitCast(dataPtr(vector), t::DoublePtr);
+        return builder.CreateInBoundsGEP(
+            pos, builder.CreateShl(builder.CreateZExt(position, t::i64), 1));
+    } else if (type.isA(PirType(RType::raw).orAttribsOrObj().fastVecelt())) {
+        nativeType = t::i8ptr;
+    } else if (type.isA(PirType(RType::str).orAttribsOrObj().fastVecelt())) {
+        nativeType = t::SEXP_ptr;
     } else {
         nativeType = t::SEXP_ptr;
         assert(false);
@@ -763,7 +1050,16 @@ llvm::Value* LowerFunctionLLVM::vectorPositionPtr(llvm::Value* vector,
 llvm::Value* LowerFunctionLLVM::accessVector(llvm::Value* vector,
                                              llvm::Value* position,
                                              PirType type) {
-    return builder.CreateLoad(vectorPositionPtr(vector, position, type));
+    auto pos = vectorPositionPtr(vector, position, type);
+    // Complex and raw elements are not unboxed, the result is a new scalar
+    if (type.isA(PirType(RType::cplx).orAttribsOrObj().fastVecelt()))
+        return boxComplex(
+            builder.CreateLoad(pos),
+            builder.CreateLoad(builder.CreateInBoundsGEP(pos, c(1, 64))));
+    if (type.isA(PirType(RType::raw).orAttribsOrObj().fastVecelt()))
+        return call(NativeBuiltins::get(NativeBuiltins::Id::newRaw),
+                    {builder.CreateZExt(builder.CreateLoad(pos), t::Int)});
+    return builder.CreateLoad(pos);
 }
 
 llvm::Value* LowerFunctionLLVM::assignVector(llvm::Value* vector,
@@ -771,8 +1067,20 @@ llvm::Value* LowerFunctionLLVM::assignVector(llvm::Value* vector,
                                              llvm::Value* value, PirType type) {
     insn_assert(builder.CreateNot(shared(vector)),
                 "assigning to shared vector");
-    return builder.CreateStore(value,
-                               vectorPositionPtr(vector, position, type));
+    auto pos = vectorPositionPtr(vector, position, type);
+    // For complex and raw vectors the value is a boxed scalar
+    if (type.isA(PirType(RType::cplx).orAttribsOrObj().fastVecelt())) {
+        auto src = builder.CreateBitCast(dataPtr(value), t::DoublePtr);
+        builder.CreateStore(builder.CreateLoad(src), pos);
+        return builder.CreateStore(
+            builder.CreateLoad(builder.CreateInBoundsGEP(src, c(1, 64))),
+            builder.CreateInBoundsGEP(pos, c(1, 64)));
+    }
+    if (type.isA(PirType(RType::raw).orAttribsOrObj().fastVecelt())) {
+        auto src = builder.CreateBitCast(dataPtr(value), t::i8ptr);
+        return builder.CreateStore(builder.CreateLoad(src), pos);
+    }
+    return builder.CreateStore(value, pos);
 }
 
 llvm::Value* LowerFunctionLLVM::unboxIntLgl(llvm::Value* v) {
@@ -1434,6 +1742,15 @@ llvm::Value* LowerFunctionLLVM::boxReal(llvm::Value* v, bool protect) {
         protectTemp(res);
     return res;
 }
+llvm::Value* LowerFunctionLLVM::boxComplex(llvm::Value* re, llvm::Value* im,
+                                           bool protect) {
+    assert(re->getType() == t::Double && im->getType() == t::Double);
+    auto res =
+        call(NativeBuiltins::get(NativeBuiltins::Id::newComplex), {re, im});
+    if (protect)
+        protectTemp(res);
+    return res;
+}
 llvm::Value* LowerFunctionLLVM::boxLgl(llvm::Value* v) {
     if (v->getType() == t::Int) {
         insn_assert(
@@ -1522,6 +1839,33 @@ void LowerFunctionLLVM::compileRelop(
     auto rhs = i->arg(1).val();
     auto lhsRep = Representation::Of(lhs);
     auto rhsRep = Representation::Of(rhs);
+
+    // Strings are equal if their interned CHARSXPs are the same, only if they
+    // differ we have to check the encodings
+    static const PirType stringScalar =
+        PirType::simpleScalarString().notObject();
+    if ((kind == BinopKind::EQ || kind == BinopKind::NE) &&
+        lhs->type.isA(stringScalar) && rhs->type.isA(stringScalar)) {
+        auto a = builder.CreateLoad(
+            vectorPositionPtr(loadSxp(lhs), c(0), lhs->type));
+        auto b = builder.CreateLoad(
+            vectorPositionPtr(loadSxp(rhs), c(0), rhs->type));
+        auto same = builder.CreateAnd(
+            builder.CreateICmpEQ(a, b),
+            builder.CreateICmpNE(a, constant(NA_STRING, t::SEXP)));
+        llvm::Value* res = createSelect2(
+            same, [&]() { return c(1); },
+            [&]() {
+                return call(NativeBuiltins::get(NativeBuiltins::Id::stringEq),
+                            {a, b});
+            });
+        if (kind == BinopKind::NE)
+            res = builder.CreateSelect(builder.CreateICmpEQ(res, c(NA_INTEGER)),
+                                       res, builder.CreateXor(res, c(1)));
+        setVal(i, rep == Representation::Sexp ? boxLgl(res) : res);
+        return;
+    }
+
     if (lhsRep == Representation::Sexp || rhsRep == Representation::Sexp) {
         auto a = loadSxp(lhs);
         auto b = loadSxp(rhs);
@@ -1588,6 +1932,39 @@ void LowerFunctionLLVM::compileBinop(
     auto lhsRep = Representation::Of(lhs);
     auto rhsRep = Representation::Of(rhs);
 
+    // Complex scalars stay boxed, but we can still avoid the generic binop
+    static const PirType complexScalar =
+        PirType::simpleScalarComplex().notObject();
+    if (rep == Representation::Sexp && lhs->type.isA(complexScalar) &&
+        rhs->type.isA(complexScalar) &&
+        (kind == BinopKind::ADD || kind == BinopKind::SUB ||
+         kind == BinopKind::MUL || kind == BinopKind::DIV)) {
+        auto a = builder.CreateBitCast(dataPtr(loadSxp(lhs)), t::DoublePtr);
+        auto b = builder.CreateBitCast(dataPtr(loadSxp(rhs)), t::DoublePtr);
+        auto ar = builder.CreateLoad(a);
+        auto ai = builder.CreateLoad(builder.CreateInBoundsGEP(a, c(1, 64)));
+        auto br = builder.CreateLoad(b);
+        auto bi = builder.CreateLoad(builder.CreateInBoundsGEP(b, c(1, 64)));
+
+        llvm::Value* res = nullptr;
+        switch (kind) {
+        case BinopKind::ADD:
+            res = boxComplex(builder.CreateFAdd(ar, br),
+                             builder.CreateFAdd(ai, bi), false);
+            break;
+        case BinopKind::SUB:
+            res = boxComplex(builder.CreateFSub(ar, br),
+                             builder.CreateFSub(ai, bi), false);
+            break;
+        default:
+            // Multiplication and division have special cases for infinities
+            res = call(NativeBuiltins::get(NativeBuiltins::Id::complexBinop),
+                       {ar, ai, br, bi, c((int)kind)});
+        }
+        setVal(i, res);
+        return;
+    }
+
     if (lhsRep == Representation::Sexp || rhsRep == Representation::Sexp ||
         (!fpInsert && (lhsRep != Representation::Integer ||
                        rhsRep != Representation::Integer))) {
@@ -1732,6 +2109,291 @@ void LowerFunctionLLVM::compileUnop(
     setVal(i, res());
 };
 
+void LowerFunctionLLVM::compileFusedVectorOp(FusedVectorOp* i) {
+    typedef FusedVectorOp::Reduction Reduction;
+    auto reduction = i->reduction;
+    bool lglResult = FusedVectorOp::isRelop(i->program.back().op);
+
+    // Scalar leaves are loaded once, vector leaves are accessed through their
+    // data pointer. The VectorFusion pass guards that all vectors have the
+    // same length.
+    std::vector<llvm::Value*> scalars(i->nargs(), nullptr);
+    std::vector<llvm::Value*> data(i->nargs(), nullptr);
+    llvm::Value* length = nullptr;
+    for (size_t j = 0; j < i->nargs(); ++j) {
+        auto leaf = i->arg(j).val();
+        if (leaf->type.isScalar()) {
+            scalars[j] = convert(load(leaf), PirType(RType::real).simpleScalar());
+            continue;
+        }
+        auto v = loadSxp(leaf);
+        auto ptrType = leaf->type.isA(PirType(RType::real)) ? t::DoublePtr
+                                                            : t::IntPtr;
+        if (!length)
+            length = createSelect2(
+                isAltrep(v),
+                [&]() {
+                    return call(NativeBuiltins::get(NativeBuiltins::Id::xlength),
+                                {v});
+                },
+                [&]() { return vectorLength(v); });
+        data[j] = createSelect2(
+            isAltrep(v),
+            [&]() {
+                return builder.CreateBitCast(
+                    call(NativeBuiltins::get(NativeBuiltins::Id::altrepDataPtr),
+                         {v}),
+                    ptrType);
+            },
+            [&]() { return builder.CreateBitCast(dataPtr(v, false), ptrType); });
+    }
+
+    // Allocated last, materializing ALTREP vectors can trigger a gc
+    llvm::Value* res = nullptr;
+    llvm::Value* resData = nullptr;
+    if (reduction == Reduction::None) {
+        res = call(NativeBuiltins::get(NativeBuiltins::Id::makeVector),
+                   {c(lglResult ? LGLSXP : REALSXP), length});
+        resData = builder.CreateBitCast(dataPtr(res, false),
+                                        lglResult ? t::IntPtr : t::DoublePtr);
+    }
+
+    auto asDouble = [&](llvm::Value* v) -> llvm::Value* {
+        if (v->getType() == t::Double)
+            return v;
+        return builder.CreateSelect(builder.CreateICmpEQ(v, c(NA_INTEGER)),
+                                    c(NA_REAL),
+                                    builder.CreateSIToFP(v, t::Double));
+    };
+
+    // Loop carried state of the reduction: the accumulator, whether an NA was
+    // seen and, for max and min, whether a NaN was seen. Real sums and
+    // products accumulate in long double, like rsum and rprod in summary.c.
+    llvm::Type* accType = t::Double;
+    llvm::Value* accInit = c(0.0);
+    switch (reduction) {
+    case Reduction::None:
+        break;
+    case Reduction::Sum:
+        if (lglResult) {
+            accType = t::i64;
+            accInit = c(0, 64);
+        } else {
+            accType = t::LongDouble;
+            accInit = llvm::ConstantFP::get(t::LongDouble, 0.0);
+        }
+        break;
+    case Reduction::Prod:
+        accType = t::LongDouble;
+        accInit = llvm::ConstantFP::get(t::LongDouble, 1.0);
+        break;
+    case Reduction::Max:
+        accInit = c(R_NegInf);
+        break;
+    case Reduction::Min:
+        accInit = c(R_PosInf);
+        break;
+    case Reduction::Any:
+    case Reduction::All:
+        accType = t::i1;
+        accInit = builder.getFalse();
+        break;
+    }
+
+    auto idx = phiBuilder(t::i64);
+    auto acc = phiBuilder(accType);
+    auto sawNa = phiBuilder(t::i1);
+    auto sawNaN = phiBuilder(t::i1);
+    idx.addInput(c(0, 64));
+    acc.addInput(accInit);
+    sawNa.addInput(builder.getFalse());
+    sawNaN.addInput(builder.getFalse());
+
+    auto loopH = BasicBlock::Create(PirJitLLVM::getContext(), "fused-loop-hd",
+                                    fun);
+    auto loopB = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    auto loopE = BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+    builder.CreateBr(loopH);
+
+    builder.SetInsertPoint(loopH);
+    auto idxPhi = idx(2);
+    auto accPhi = acc(2);
+    auto sawNaPhi = sawNa(2);
+    auto sawNaNPhi = sawNaN(2);
+    builder.CreateCondBr(builder.CreateICmpEQ(idxPhi, length), loopE, loopB);
+
+    builder.SetInsertPoint(loopB);
+    std::vector<llvm::Value*> results;
+    auto operand = [&](int o) -> llvm::Value* {
+        if (o < 0)
+            return asDouble(results.at(-1 - o));
+        if (scalars[o])
+            return scalars[o];
+        return asDouble(
+            builder.CreateLoad(builder.CreateInBoundsGEP(data[o], idxPhi)));
+    };
+    for (auto& step : i->program) {
+        auto a = operand(step.lhs);
+        if (step.op == Tag::Minus) {
+            results.push_back(builder.CreateFNeg(a));
+            continue;
+        }
+        auto b = operand(step.rhs);
+        llvm::Value* r = nullptr;
+        switch (step.op) {
+        case Tag::Add:
+            r = builder.CreateFAdd(a, b);
+            break;
+        case Tag::Sub:
+            r = builder.CreateFSub(a, b);
+            break;
+        case Tag::Mul:
+            r = builder.CreateFMul(a, b);
+            break;
+        case Tag::Div:
+            r = builder.CreateFDiv(a, b);
+            break;
+        case Tag::Pow:
+            r = builder.CreateIntrinsic(Intrinsic::pow, {t::Double}, {a, b});
+            break;
+        case Tag::Lt:
+            r = builder.CreateFCmpOLT(a, b);
+            break;
+        case Tag::Lte:
+            r = builder.CreateFCmpOLE(a, b);
+            break;
+        case Tag::Gt:
+            r = builder.CreateFCmpOGT(a, b);
+            break;
+        case Tag::Gte:
+            r = builder.CreateFCmpOGE(a, b);
+            break;
+        case Tag::Eq:
+            r = builder.CreateFCmpOEQ(a, b);
+            break;
+        case Tag::Neq:
+            r = builder.CreateFCmpONE(a, b);
+            break;
+        default:
+            assert(false);
+        }
+        if (FusedVectorOp::isRelop(step.op))
+            r = builder.CreateSelect(builder.CreateFCmpUNO(a, b),
+                                     c(NA_LOGICAL),
+                                     builder.CreateZExt(r, t::Int));
+        results.push_back(r);
+    }
+
+    // The body has no branches. This lets LLVM vectorize the elementwise loops
+    // and the integer and logical reductions. Real sum and prod are not
+    // vectorized: they accumulate sequentially in long double, to round
+    // exactly like GNU R.
+    auto value = results.back();
+    llvm::Value* nextAcc = accPhi;
+    llvm::Value* nextSawNa = sawNaPhi;
+    llvm::Value* nextSawNaN = sawNaNPhi;
+    llvm::Value* isNa = nullptr;
+    if (lglResult)
+        isNa = builder.CreateICmpEQ(value, c(NA_LOGICAL));
+    switch (reduction) {
+    case Reduction::None:
+        builder.CreateStore(value, builder.CreateInBoundsGEP(resData, idxPhi));
+        break;
+    case Reduction::Sum:
+        if (lglResult) {
+            nextAcc = builder.CreateAdd(
+                accPhi, builder.CreateZExt(
+                            builder.CreateSelect(isNa, c(0), value), t::i64));
+            nextSawNa = builder.CreateOr(sawNaPhi, isNa);
+        } else {
+            nextAcc = builder.CreateFAdd(
+                accPhi, builder.CreateFPExt(value, t::LongDouble));
+        }
+        break;
+    case Reduction::Prod:
+        nextAcc =
+            builder.CreateFMul(accPhi, builder.CreateFPExt(value, t::LongDouble));
+        break;
+    case Reduction::Max:
+    case Reduction::Min: {
+        // NA wins over NaN, as in GNU R
+        auto isNaN = builder.CreateFCmpUNO(value, value);
+        auto lowWord =
+            builder.CreateTrunc(builder.CreateBitCast(value, t::i64), t::Int);
+        nextSawNa = builder.CreateOr(
+            sawNaPhi,
+            builder.CreateAnd(isNaN, builder.CreateICmpEQ(lowWord, c(1954))));
+        nextSawNaN = builder.CreateOr(sawNaNPhi, isNaN);
+        auto better = reduction == Reduction::Max
+                          ? builder.CreateFCmpOGT(value, accPhi)
+                          : builder.CreateFCmpOLT(value, accPhi);
+        nextAcc = builder.CreateSelect(better, value, accPhi);
+        break;
+    }
+    case Reduction::Any:
+    case Reduction::All:
+        nextAcc = builder.CreateOr(
+            accPhi, builder.CreateICmpEQ(
+                        value, c(reduction == Reduction::Any ? 1 : 0)));
+        nextSawNa = builder.CreateOr(sawNaPhi, isNa);
+        break;
+    }
+    idx.addInput(builder.CreateAdd(idxPhi, c(1, 64)));
+    acc.addInput(nextAcc);
+    sawNa.addInput(nextSawNa);
+    sawNaN.addInput(nextSawNaN);
+    builder.CreateBr(loopH);
+
+    builder.SetInsertPoint(loopE);
+    // Results beyond the double range are infinite, as in rsum and rprod
+    auto toDouble = [&](llvm::Value* v) {
+        auto max = llvm::ConstantFP::get(t::LongDouble, DBL_MAX);
+        auto min = llvm::ConstantFP::get(t::LongDouble, -DBL_MAX);
+        return builder.CreateSelect(
+            builder.CreateFCmpOGT(v, max), c(R_PosInf),
+            builder.CreateSelect(builder.CreateFCmpOLT(v, min), c(R_NegInf),
+                                 builder.CreateFPTrunc(v, t::Double)));
+    };
+    llvm::Value* result = nullptr;
+    switch (reduction) {
+    case Reduction::None:
+        result = res;
+        break;
+    case Reduction::Sum:
+        if (lglResult) {
+            // GNU R warns about the overflow, which needs 2^31 elements
+            auto overflow =
+                builder.CreateICmpSGT(accPhi, c((long)R_INT_MAX, 64));
+            result = builder.CreateSelect(
+                builder.CreateOr(sawNaPhi, overflow), c(NA_INTEGER),
+                builder.CreateTrunc(accPhi, t::Int));
+        } else {
+            result = toDouble(accPhi);
+        }
+        break;
+    case Reduction::Prod:
+        result = toDouble(accPhi);
+        break;
+    case Reduction::Max:
+    case Reduction::Min:
+        result = builder.CreateSelect(
+            sawNaPhi, c(NA_REAL),
+            builder.CreateSelect(sawNaNPhi, c((double)R_NaN), accPhi));
+        break;
+    case Reduction::Any:
+        result = builder.CreateSelect(
+            accPhi, c(1),
+            builder.CreateSelect(sawNaPhi, c(NA_LOGICAL), c(0)));
+        break;
+    case Reduction::All:
+        result = builder.CreateSelect(
+            accPhi, c(0),
+            builder.CreateSelect(sawNaPhi, c(NA_LOGICAL), c(1)));
+        break;
+    }
+    setVal(i, convert(result, i->type));
+}
+
 void LowerFunctionLLVM::writeBarrier(llvm::Value* x, llvm::Value* y,
                                      std::function<void()> no,
                                      std::function<void()> yes) {
@@ -2161,6 +2823,21 @@ void LowerFunctionLLVM::compile() {
                             createVariable(j, true);
                     }
                 });
+            } else if (auto push = PushLoopContext::Cast(i)) {
+                // The result slot holds the reason of a longjmp
+                contexts[push] = {topAlloca(t::RCNTXT), topAlloca(t::Int),
+                                  nullptr};
+
+                // Everything which is live at the loop context needs to be
+                // mutable, to be able to restore on break or next
+                Visitor::run(code->entry, [&](Instruction* j) {
+                    if (allocator.needsAVariable(j) && liveness.live(push, j)) {
+                        if (Representation::Of(j) == t::SEXP)
+                            contexts[push].savedSexpPos[j] = numLocals++;
+                        if (!variables_.count(j))
+                            createVariable(j, true);
+                    }
+                });
             }
         });
         Visitor::run(code->entry, [&](Instruction* i) {
@@ -2170,6 +2847,33 @@ void LowerFunctionLLVM::compile() {
         });
     }
 
+    // Values restored by a longjmp could not keep their dims in registers
+    if (contexts.empty()) {
+        Visitor::run(code->entry, [&](Instruction* i) {
+            Value* vec = nullptr;
+            size_t rank = 2;
+            if (auto e = Extract1_2D::Cast(i))
+                vec = e->vec();
+            else if (auto e = Extract2_2D::Cast(i))
+                vec = e->vec();
+            else if (auto s = Subassign1_2D::Cast(i))
+                vec = s->vec();
+            else if (auto s = Subassign2_2D::Cast(i))
+                vec = s->vec();
+            else if (auto e = Extract1_3D::Cast(i))
+                vec = e->vec(), rank = 3;
+            else if (auto s = Subassign1_3D::Cast(i))
+                vec = s->vec(), rank = 3;
+            auto array = vec ? Instruction::Cast(vec) : nullptr;
+            if (!array || Representation::Of(array) != t::SEXP)
+                return;
+            // Indexed with different ranks, not worth loading both
+            auto r = arrayRanks.emplace(array, rank);
+            if (!r.second && r.first->second != rank)
+                r.first->second = 0;
+        });
+    }
+
     std::unordered_map<BB*, int> blockInPushContext;
     blockInPushContext[code->entry] = 0;
 
@@ -2305,6 +3009,27 @@ void LowerFunctionLLVM::compile() {
                 break;
             }
 
+            case Tag::PushLoopContext: {
+                compilePushLoopContext(i);
+                break;
+            }
+
+            case Tag::IsLoopBreak: {
+                auto& data = contexts.at(IsLoopBreak::Cast(i)->push());
+                auto reason = builder.CreateLoad(data.result);
+                setVal(i, builder.CreateZExt(
+                              builder.CreateICmpEQ(reason, c(CTXT_BREAK)),
+                              t::Int));
+                break;
+            }
+
+            case Tag::PopLoopContext: {
+                auto& data = contexts.at(PopLoopContext::Cast(i)->push());
+                call(NativeBuiltins::get(NativeBuiltins::Id::endLoopContext),
+                     {data.rcntxt});
+                break;
+            }
+
             case Tag::CastType: {
                 auto in = i->arg(0).val();
                 if (LdConst::Cast(i->followCasts()) || deadMove(in, i))
@@ -3178,6 +3903,21 @@ void LowerFunctionLLVM::compile() {
                         break;
                     }
                 }
+                if (isAppendToSelf(b)) {
+                    auto res = call(
+                        NativeBuiltins::get(NativeBuiltins::Id::appendInPlace),
+                        {loadSxp(b->callArg(0).val()),
+                         loadSxp(b->callArg(1).val())});
+                    setVal(i, createSelect2(
+                                  builder.CreateICmpEQ(
+                                      res,
+                                      llvm::ConstantPointerNull::get(t::SEXP)),
+                                  [&]() { return callTheBuiltin(); },
+                                  [&]() { return res; }));
+                    fixVisibility();
+                    break;
+                }
+
                 if (b->builtinId == blt("c") &&
                     (!b->type.maybeNotFastVecelt() ||
                      !b->type.maybeHasAttrs())) {
@@ -3213,6 +3953,58 @@ void LowerFunctionLLVM::compile() {
                     }
                 }
 
+                NativeBuiltins::Id kernel;
+                bool noObjArgs = true;
+                b->eachCallArg([&](Value* v) {
+                    if (v->type.maybeObj())
+                        noObjArgs = false;
+                });
+                if (noObjArgs &&
+                    matrixKernel(b->builtinId, b->nCallArgs(), kernel)) {
+                    // Returns nullptr if the arguments are not plain matrices
+                    std::vector<llvm::Value*> kernelArgs;
+                    b->eachCallArg(
+                        [&](Value* v) { kernelArgs.push_back(loadSxp(v)); });
+                    if (kernelArgs.size() == 1 &&
+                        kernel == NativeBuiltins::Id::crossprod)
+                        kernelArgs.push_back(constant(R_NilValue, t::SEXP));
+                    auto res = call(NativeBuiltins::get(kernel), kernelArgs);
+                    setVal(i, createSelect2(
+                                  builder.CreateICmpEQ(
+                                      res,
+                                      llvm::ConstantPointerNull::get(t::SEXP)),
+                                  [&]() { return callTheBuiltin(); },
+                                  [&]() { return res; }));
+                    fixVisibility();
+                    break;
+                }
+
+                if (b->builtinId == blt("match") && b->nCallArgs() == 4 &&
+                    !b->callArg(0).val()->type.maybeObj() &&
+                    !b->callArg(1).val()->type.maybeObj()) {
+                    // The hash index of the table is cached per call site
+                    auto cache = Rf_allocVector(VECSXP, 3);
+                    Pool::insert(cache);
+                    SET_VECTOR_ELT(cache, 2, Rf_allocVector(INTSXP, 2));
+                    INTEGER(VECTOR_ELT(cache, 2))[0] = 0;
+                    INTEGER(VECTOR_ELT(cache, 2))[1] = 0;
+                    auto res = call(
+                        NativeBuiltins::get(NativeBuiltins::Id::matchCached),
+                        {loadSxp(b->callArg(0).val()),
+                         loadSxp(b->callArg(1).val()),
+                         loadSxp(b->callArg(2).val()),
+                         loadSxp(b->callArg(3).val()),
+                         constant(cache, t::SEXP)});
+                    setVal(i, createSelect2(
+                                  builder.CreateICmpEQ(
+                                      res,
+                                      llvm::ConstantPointerNull::get(t::SEXP)),
+                                  [&]() { return callTheBuiltin(); },
+                                  [&]() { return res; }));
+                    fixVisibility();
+                    break;
+                }
+
                 if (b->builtinId == blt("list")) {
                     auto res = call(
                         NativeBuiltins::get(NativeBuiltins::Id::makeVector),
@@ -3353,6 +4145,46 @@ void LowerFunctionLLVM::compile() {
                     break;
                 }
 
+                // Recursive calls. The version is not in the dispatch table
+                // yet while we compile it, so we cannot look it up there.
+                if (target == bestTarget && target == code) {
+                    auto callee = target->owner()->rirClosure();
+                    if (args.size() == target->nargs() &&
+                        target->properties.includes(
+                            ClosureVersion::Property::NoReflection)) {
+                        // Reuse the code object we were called with
+                        llvm::Value* arglist = nodestackPtr();
+                        auto rr = withCallFrame(args, [&]() {
+                            return builder.CreateCall(
+                                fun, {paramCode(), arglist, loadSxp(i->env()),
+                                      constant(callee, t::SEXP)});
+                        });
+                        setVal(i, rr);
+                        break;
+                    }
+
+                    assert(asmpt.includes(Assumption::StaticallyArgmatched));
+                    auto idx = Pool::makeSpace();
+                    selfCallTargets.push_back(idx);
+                    auto res = withCallFrame(args, [&]() {
+                        return call(
+                            NativeBuiltins::get(
+                                NativeBuiltins::Id::nativeCallTrampoline),
+                            {
+                                c(callId),
+                                paramCode(),
+                                constant(callee, t::SEXP),
+                                c(idx),
+                                c(calli->srcIdx),
+                                loadSxp(calli->env()),
+                                c(args.size()),
+                                c(asmpt.toI()),
+                            });
+                    });
+                    setVal(i, res);
+                    break;
+                }
+
                 if (target == bestTarget) {
                     auto callee = target->owner()->rirClosure();
                     auto dt = DispatchTable::check(BODY(callee));
@@ -3487,8 +4319,11 @@ void LowerFunctionLLVM::compile() {
                     // in the rir deopt_ instruction are in stack order,
                     // from tos down.
                     for (auto fi = deopt->frames.rbegin();
-                         fi != deopt->frames.rend(); fi++)
+                         fi != deopt->frames.rend(); fi++) {
                         m->frames[i++] = *fi;
+                        if (fi->callee != R_NilValue)
+                            Pool::insert(fi->callee);
+                    }
                     Pool::insert(store);
                 }
 
@@ -4111,10 +4946,22 @@ void LowerFunctionLLVM::compile() {
                     constant(mkFunction->originalBody->container(), t::SEXP);
                 assert(DispatchTable::check(
                     mkFunction->originalBody->container()));
-                setVal(
-                    i,
-                    call(NativeBuiltins::get(NativeBuiltins::Id::createClosure),
-                         {body, formals, loadSxp(mkFunction->env()), srcRef}));
+                SEXP cache = R_NilValue;
+                if (onlyCalled(mkFunction, code)) {
+                    cache = Rf_allocVector(VECSXP, 3);
+                    Pool::insert(cache);
+                    SET_VECTOR_ELT(cache, 1, Rf_allocVector(INTSXP, 2));
+                    INTEGER(VECTOR_ELT(cache, 1))[0] = 0;
+                    INTEGER(VECTOR_ELT(cache, 1))[1] = 0;
+                    SET_VECTOR_ELT(cache, 2,
+                                   Rf_allocVector(RAWSXP, sizeof(SEXP)));
+                    *reinterpret_cast<SEXP*>(RAW(VECTOR_ELT(cache, 2))) =
+                        nullptr;
+                }
+                setVal(i, call(NativeBuiltins::get(
+                                   NativeBuiltins::Id::createClosureCached),
+                               {body, formals, loadSxp(mkFunction->env()),
+                                srcRef, constant(cache, t::SEXP)}));
                 break;
             }
 
@@ -4476,6 +5323,16 @@ void LowerFunctionLLVM::compile() {
                 break;
             }
 
+            case Tag::LdDDVar: {
+                auto ld = LdDDVar::Cast(i);
+                auto res =
+                    call(NativeBuiltins::get(NativeBuiltins::Id::ldddvar),
+                         {constant(ld->varName, t::SEXP), loadSxp(ld->env())});
+                res->setName(CHAR(PRINTNAME(ld->varName)));
+                setVal(i, res);
+                break;
+            }
+
             case Tag::LdDots:
             case Tag::LdVar: {
                 auto maybeLd = LdVar::Cast(i);
@@ -4510,6 +5367,9 @@ void LowerFunctionLLVM::compile() {
                 }
 
                 llvm::Value* res;
+                SEXP cell = needsLdVarForUpdate.count(i)
+                                ? nullptr
+                                : frameBindingCell(i->env(), varName);
                 if (bindingsCache.count(i->env())) {
                     auto phi = phiBuilder(t::SEXP);
                     auto offset = bindingsCache.at(i->env()).at(varName);
@@ -4554,6 +5414,18 @@ void LowerFunctionLLVM::compile() {
                     builder.CreateBr(done);
                     builder.SetInsertPoint(done);
                     res = phi();
+                } else if (cell) {
+                    res = car(constant(cell, t::SEXP));
+                    res = createSelect2(
+                        builder.CreateICmpNE(res,
+                                             constant(R_UnboundValue, t::SEXP)),
+                        [&]() { return res; },
+                        [&]() {
+                            return call(
+                                NativeBuiltins::get(NativeBuiltins::Id::ldvar),
+                                {constant(varName, t::SEXP),
+                                 loadSxp(i->env())});
+                        });
                 } else if (i->env() == Env::global()) {
                     res = call(
                         NativeBuiltins::get(NativeBuiltins::Id::ldvarGlobal),
@@ -4606,9 +5478,14 @@ void LowerFunctionLLVM::compile() {
                 auto extract = Extract1_1D::Cast(i);
                 auto vector = loadSxp(extract->vec());
 
+                // Complex and raw elements are boxed by accessVector
+                bool boxedElement =
+                    extract->vec()->type.isA(
+                        PirType(RType::cplx).orFastVecelt()) ||
+                    extract->vec()->type.isA(PirType(RType::raw).orFastVecelt());
                 bool fastcase = !extract->vec()->type.maybe(RType::vec) &&
                                 vectorTypeSupport(extract->vec()) &&
-                                extract->type.unboxable() &&
+                                (extract->type.unboxable() || boxedElement) &&
                                 extract->idx()->type.isA(
                                     PirType::intReal().notObject().scalar());
                 BasicBlock* done;
@@ -4623,20 +5500,34 @@ void LowerFunctionLLVM::compile() {
                     llvm::Value* vector = load(extract->vec());
 
                     if (Representation::Of(extract->vec()) == t::SEXP) {
-                        auto hit2 = BasicBlock::Create(PirJitLLVM::getContext(),
-                                                       "", fun);
-                        builder.CreateCondBr(isAltrep(vector), fallback, hit2,
-                                             branchMostlyFalse);
-                        builder.SetInsertPoint(hit2);
-
                         if (extract->vec()->type.maybeNotFastVecelt()) {
-                            auto hit3 = BasicBlock::Create(
+                            auto hit2 = BasicBlock::Create(
                                 PirJitLLVM::getContext(), "", fun);
                             builder.CreateCondBr(fastVeceltOkNative(vector),
-                                                 hit3, fallback,
+                                                 hit2, fallback,
                                                  branchMostlyTrue);
-                            builder.SetInsertPoint(hit3);
+                            builder.SetInsertPoint(hit2);
                         }
+
+                        auto hit3 = BasicBlock::Create(PirJitLLVM::getContext(),
+                                                       "", fun);
+                        if (altrepAccessSupported(extract->vec())) {
+                            auto altrep = BasicBlock::Create(
+                                PirJitLLVM::getContext(), "", fun);
+                            builder.CreateCondBr(isAltrep(vector), altrep,
+                                                 hit3);
+                            builder.SetInsertPoint(altrep);
+                            res.addInput(convert(
+                                accessAltrepVector(extract->idx(), vector,
+                                                   extract->vec()->type,
+                                                   fallback),
+                                i->type));
+                            builder.CreateBr(done);
+                        } else {
+                            builder.CreateCondBr(isAltrep(vector), fallback,
+                                                 hit3, branchMostlyFalse);
+                        }
+                        builder.SetInsertPoint(hit3);
                     }
 
                     llvm::Value* index =
@@ -4709,16 +5600,8 @@ void LowerFunctionLLVM::compile() {
                         }
                     }
 
-                    auto ncol = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNcols),
-                             {vector}),
-                        t::i64);
-                    auto nrow = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNrows),
-                             {vector}),
-                        t::i64);
+                    auto dims = arrayDims(extract->vec(), vector, 2);
+                    auto nrow = dims[0], ncol = dims[1];
                     llvm::Value* index1 = computeAndCheckIndex(
                         extract->idx1(), vector, fallback, nrow);
                     llvm::Value* index2 = computeAndCheckIndex(
@@ -4778,8 +5661,22 @@ void LowerFunctionLLVM::compile() {
                     llvm::Value* vector = load(extract->vec());
 
                     if (Representation::Of(extract->vec()) == t::SEXP) {
-                        builder.CreateCondBr(isAltrep(vector), fallback, hit2,
-                                             branchMostlyFalse);
+                        if (altrepAccessSupported(extract->vec())) {
+                            auto altrep = BasicBlock::Create(
+                                PirJitLLVM::getContext(), "", fun);
+                            builder.CreateCondBr(isAltrep(vector), altrep,
+                                                 hit2);
+                            builder.SetInsertPoint(altrep);
+                            res.addInput(convert(
+                                accessAltrepVector(extract->idx(), vector,
+                                                   extract->vec()->type,
+                                                   fallback),
+                                i->type));
+                            builder.CreateBr(done);
+                        } else {
+                            builder.CreateCondBr(isAltrep(vector), fallback,
+                                                 hit2, branchMostlyFalse);
+                        }
                         builder.SetInsertPoint(hit2);
                     }
 
@@ -4833,22 +5730,88 @@ void LowerFunctionLLVM::compile() {
 
             case Tag::Extract1_3D: {
                 auto extract = Extract1_3D::Cast(i);
+
+                auto scalarIndex = PirType::intReal().notObject().scalar();
+                bool fastcase = !extract->vec()->type.maybe(RType::vec) &&
+                                extract->type.unboxable() &&
+                                vectorTypeSupport(extract->vec()) &&
+                                extract->idx1()->type.isA(scalarIndex) &&
+                                extract->idx2()->type.isA(scalarIndex) &&
+                                extract->idx3()->type.isA(scalarIndex);
+
+                BasicBlock* done;
+                auto res = phiBuilder(Representation::Of(i));
+
+                if (fastcase) {
+                    auto fallback =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+                    done =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+
+                    llvm::Value* vector = load(extract->vec());
+
+                    if (Representation::Of(extract->vec()) == t::SEXP) {
+                        auto hit2 = BasicBlock::Create(PirJitLLVM::getContext(),
+                                                       "", fun);
+                        builder.CreateCondBr(isAltrep(vector), fallback, hit2,
+                                             branchMostlyFalse);
+                        builder.SetInsertPoint(hit2);
+
+                        if (extract->vec()->type.maybeNotFastVecelt()) {
+                            auto hit3 = BasicBlock::Create(
+                                PirJitLLVM::getContext(), "", fun);
+                            builder.CreateCondBr(fastVeceltOkNative(vector),
+                                                 hit3, fallback,
+                                                 branchMostlyTrue);
+                            builder.SetInsertPoint(hit3);
+                        }
+                    }
+
+                    auto dims = arrayDims(extract->vec(), vector, 3);
+                    llvm::Value* index1 = computeAndCheckIndex(
+                        extract->idx1(), vector, fallback, dims[0]);
+                    llvm::Value* index2 = computeAndCheckIndex(
+                        extract->idx2(), vector, fallback, dims[1]);
+                    llvm::Value* index3 = computeAndCheckIndex(
+                        extract->idx3(), vector, fallback, dims[2]);
+
+                    llvm::Value* index =
+                        builder.CreateMul(dims[1], index3, "", true, true);
+                    index = builder.CreateAdd(index, index2, "", true, true);
+                    index = builder.CreateMul(dims[0], index, "", true, true);
+                    index = builder.CreateAdd(index, index1, "", true, true);
+
+                    auto res0 =
+                        extract->vec()->type.isScalar()
+                            ? vector
+                            : accessVector(vector, index, extract->vec()->type);
+
+                    res.addInput(convert(res0, i->type));
+                    builder.CreateBr(done);
+
+                    builder.SetInsertPoint(fallback);
+                }
+
                 auto vector = loadSxp(extract->vec());
                 auto idx1 = loadSxp(extract->idx1());
                 auto idx2 = loadSxp(extract->idx2());
                 auto idx3 = loadSxp(extract->idx3());
 
-                // We should implement the fast cases (known and primitive
-                // types) speculatively here
                 auto env = constant(R_NilValue, t::SEXP);
                 if (extract->hasEnv())
                     env = loadSxp(extract->env());
 
-                auto res =
+                auto res0 =
                     call(NativeBuiltins::get(NativeBuiltins::Id::extract13),
                          {vector, idx1, idx2, idx3, env, c(extract->srcIdx)});
-                setVal(i, res);
 
+                res.addInput(convert(res0, i->type));
+                if (fastcase) {
+                    builder.CreateBr(done);
+
+                    builder.SetInsertPoint(done);
+                }
+                setVal(i, res());
                 break;
             }
 
@@ -4880,16 +5843,8 @@ void LowerFunctionLLVM::compile() {
                         builder.SetInsertPoint(hit2);
                     }
 
-                    auto ncol = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNcols),
-                             {vector}),
-                        t::i64);
-                    auto nrow = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNrows),
-                             {vector}),
-                        t::i64);
+                    auto dims = arrayDims(extract->vec(), vector, 2);
+                    auto nrow = dims[0], ncol = dims[1];
                     llvm::Value* index1 = computeAndCheckIndex(
                         extract->idx1(), vector, fallback, nrow);
                     llvm::Value* index2 = computeAndCheckIndex(
@@ -4953,36 +5908,141 @@ void LowerFunctionLLVM::compile() {
 
             case Tag::Subassign1_3D: {
                 auto subAssign = Subassign1_3D::Cast(i);
+
+                auto scalarIndex = PirType::intReal().notObject().scalar();
+                auto valType = subAssign->val()->type;
+                auto vecType = subAssign->vec()->type;
+
+                BasicBlock* done = nullptr;
+                auto res = phiBuilder(t::SEXP);
+
+                // Same cases as Subassign2_2D
+                auto fastcase =
+                    subAssign->idx1()->type.isA(scalarIndex) &&
+                    subAssign->idx2()->type.isA(scalarIndex) &&
+                    subAssign->idx3()->type.isA(scalarIndex) &&
+                    valType.isScalar() && !vecType.maybeObj() &&
+                    Representation::Of(subAssign->vec()) == t::SEXP &&
+                    Representation::Of(i) == t::SEXP &&
+                    ((vecType.isA(PirType(RType::integer).orFastVecelt()) &&
+                      valType.isA(RType::integer)) ||
+                     (vecType.isA(PirType(RType::real).orFastVecelt()) &&
+                      valType.isA(RType::real)));
+
+                if (fastcase) {
+                    auto fallback =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+                    done =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+
+                    llvm::Value* vector = load(subAssign->vec());
+                    if (!refcount.inPlace.includes(i))
+                        vector = cloneIfShared(vector);
+
+                    auto dims = arrayDims(subAssign->vec(), vector, 3);
+                    llvm::Value* index1 = computeAndCheckIndex(
+                        subAssign->idx1(), vector, fallback, dims[0]);
+                    llvm::Value* index2 = computeAndCheckIndex(
+                        subAssign->idx2(), vector, fallback, dims[1]);
+                    llvm::Value* index3 = computeAndCheckIndex(
+                        subAssign->idx3(), vector, fallback, dims[2]);
+
+                    llvm::Value* index =
+                        builder.CreateMul(dims[1], index3, "", true, true);
+                    index = builder.CreateAdd(index, index2, "", true, true);
+                    index = builder.CreateMul(dims[0], index, "", true, true);
+                    index = builder.CreateAdd(index, index1, "", true, true);
+                    assignVector(vector, index, load(subAssign->val()),
+                                 vecType);
+                    res.addInput(vector);
+                    builder.CreateBr(done);
+
+                    builder.SetInsertPoint(fallback);
+                }
+
                 auto vector = loadSxp(subAssign->vec());
                 auto val = loadSxp(subAssign->val());
                 auto idx1 = loadSxp(subAssign->idx1());
                 auto idx2 = loadSxp(subAssign->idx2());
                 auto idx3 = loadSxp(subAssign->idx3());
 
-                // We should implement the fast cases (known and primitive
-                // types) speculatively here
-                auto res =
+                res.addInput(
                     call(NativeBuiltins::get(NativeBuiltins::Id::subassign13),
                          {vector, idx1, idx2, idx3, val,
-                          loadSxp(subAssign->env()), c(subAssign->srcIdx)});
-                setVal(i, res);
+                          loadSxp(subAssign->env()), c(subAssign->srcIdx)}));
+                if (fastcase) {
+                    builder.CreateBr(done);
+                    builder.SetInsertPoint(done);
+                }
+                setVal(i, res());
+                inheritArrayDims(i, subAssign->vec());
                 break;
             }
 
             case Tag::Subassign1_2D: {
                 auto subAssign = Subassign1_2D::Cast(i);
+
+                auto scalarIndex = PirType::intReal().notObject().scalar();
+                auto valType = subAssign->val()->type;
+                auto vecType = subAssign->vec()->type;
+
+                BasicBlock* done = nullptr;
+                auto res = phiBuilder(t::SEXP);
+
+                // Same cases as Subassign2_2D
+                auto fastcase =
+                    subAssign->idx1()->type.isA(scalarIndex) &&
+                    subAssign->idx2()->type.isA(scalarIndex) &&
+                    valType.isScalar() && !vecType.maybeObj() &&
+                    Representation::Of(subAssign->vec()) == t::SEXP &&
+                    Representation::Of(i) == t::SEXP &&
+                    ((vecType.isA(PirType(RType::integer).orFastVecelt()) &&
+                      valType.isA(RType::integer)) ||
+                     (vecType.isA(PirType(RType::real).orFastVecelt()) &&
+                      valType.isA(RType::real)));
+
+                if (fastcase) {
+                    auto fallback =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+                    done =
+                        BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
+
+                    llvm::Value* vector = load(subAssign->vec());
+                    if (!refcount.inPlace.includes(i))
+                        vector = cloneIfShared(vector);
+
+                    auto dims = arrayDims(subAssign->vec(), vector, 2);
+                    llvm::Value* index1 = computeAndCheckIndex(
+                        subAssign->idx1(), vector, fallback, dims[0]);
+                    llvm::Value* index2 = computeAndCheckIndex(
+                        subAssign->idx2(), vector, fallback, dims[1]);
+
+                    llvm::Value* index =
+                        builder.CreateMul(dims[0], index2, "", true, true);
+                    index = builder.CreateAdd(index, index1, "", true, true);
+                    assignVector(vector, index, load(subAssign->val()),
+                                 vecType);
+                    res.addInput(vector);
+                    builder.CreateBr(done);
+
+                    builder.SetInsertPoint(fallback);
+                }
+
                 auto vector = loadSxp(subAssign->vec());
                 auto val = loadSxp(subAssign->val());
                 auto idx1 = loadSxp(subAssign->idx1());
                 auto idx2 = loadSxp(subAssign->idx2());
 
-                // We should implement the fast cases (known and primitive
-                // types) speculatively here
-                auto res =
+                res.addInput(
                     call(NativeBuiltins::get(NativeBuiltins::Id::subassign12),
                          {vector, idx1, idx2, val, loadSxp(subAssign->env()),
-                          c(subAssign->srcIdx)});
-                setVal(i, res);
+                          c(subAssign->srcIdx)}));
+                if (fastcase) {
+                    builder.CreateBr(done);
+                    builder.SetInsertPoint(done);
+                }
+                setVal(i, res());
+                inheritArrayDims(i, subAssign->vec());
                 break;
             }
 
@@ -5020,19 +6080,12 @@ void LowerFunctionLLVM::compile() {
                         BasicBlock::Create(PirJitLLVM::getContext(), "", fun);
 
                     llvm::Value* vector = load(subAssign->vec());
-                    if (Representation::Of(subAssign->vec()) == t::SEXP)
+                    if (Representation::Of(subAssign->vec()) == t::SEXP &&
+                        !refcount.inPlace.includes(i))
                         vector = cloneIfShared(vector);
 
-                    auto ncol = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNcols),
-                             {vector}),
-                        t::i64);
-                    auto nrow = builder.CreateZExt(
-                        call(NativeBuiltins::get(
-                                 NativeBuiltins::Id::matrixNrows),
-                             {vector}),
-                        t::i64);
+                    auto dims = arrayDims(subAssign->vec(), vector, 2);
+                    auto nrow = dims[0], ncol = dims[1];
                     llvm::Value* index1 = computeAndCheckIndex(
                         subAssign->idx1(), vector, fallback, nrow);
                     llvm::Value* index2 = computeAndCheckIndex(
@@ -5103,6 +6156,7 @@ void LowerFunctionLLVM::compile() {
                     builder.SetInsertPoint(done);
                 }
                 setVal(i, res());
+                inheritArrayDims(i, subAssign->vec());
 
                 break;
             }
@@ -5129,7 +6183,11 @@ void LowerFunctionLLVM::compile() {
                      (vecType.isA(PirType(RType::integer).orFastVecelt()) &&
                       valType.isA(RType::integer)) ||
                      (vecType.isA(PirType(RType::real).orFastVecelt()) &&
-                      valType.isA(RType::real)));
+                      valType.isA(RType::real)) ||
+                     (vecType.isA(PirType(RType::cplx).orFastVecelt()) &&
+                      valType.isA(RType::cplx)) ||
+                     (vecType.isA(PirType(RType::raw).orFastVecelt()) &&
+                      valType.isA(RType::raw)));
                 // Conversion from scalar to vector. eg. `a = 1; a[10] = 2`
                 if (Representation::Of(subAssign->vec()) != t::SEXP &&
                     Representation::Of(i) == t::SEXP)
@@ -5158,7 +6216,8 @@ void LowerFunctionLLVM::compile() {
                             builder.SetInsertPoint(hit2);
                         }
 
-                        vector = cloneIfShared(vector);
+                        if (!refcount.inPlace.includes(i))
+                            vector = cloneIfShared(vector);
                     }
 
                     llvm::Value* index = computeAndCheckIndex(subAssign->idx(),
@@ -5215,7 +6274,11 @@ void LowerFunctionLLVM::compile() {
                     ((vecType.isA(PirType(RType::integer).orFastVecelt()) &&
                       valType.isA(RType::integer)) ||
                      (vecType.isA(PirType(RType::real).orFastVecelt()) &&
-                      valType.isA(RType::real)));
+                      valType.isA(RType::real)) ||
+                     (vecType.isA(PirType(RType::cplx).orFastVecelt()) &&
+                      valType.isA(RType::cplx)) ||
+                     (vecType.isA(PirType(RType::raw).orFastVecelt()) &&
+                      valType.isA(RType::raw)));
                 // Conversion from scalar to vector. eg. `a = 1; a[10] = 2`
                 if (Representation::Of(subAssign->vec()) != t::SEXP &&
                     Representation::Of(i) == t::SEXP)
@@ -5234,7 +6297,8 @@ void LowerFunctionLLVM::compile() {
                         builder.CreateCondBr(isAltrep(vector), fallback, hit1,
                                              branchMostlyFalse);
                         builder.SetInsertPoint(hit1);
-                        vector = cloneIfShared(vector);
+                        if (!refcount.inPlace.includes(i))
+                            vector = cloneIfShared(vector);
                     }
 
                     llvm::Value* index = computeAndCheckIndex(subAssign->idx(),
@@ -5688,6 +6752,10 @@ void LowerFunctionLLVM::compile() {
                 break;
             }
 
+            case Tag::FusedVectorOp:
+                compileFusedVectorOp(FusedVectorOp::Cast(i));
+                break;
+
             case Tag::Names:
                 setVal(i, call(NativeBuiltins::get(NativeBuiltins::Id::names),
                                {loadSxp(i->arg(0).val())}));
@@ -5756,6 +6824,14 @@ void LowerFunctionLLVM::compile() {
             if (!Phi::Cast(i))
                 ensureNamedIfNeeded(i);
 
+            auto rank = arrayRanks.find(i);
+            if (rank != arrayRanks.end() && rank->second &&
+                !arrayDimsCache.count(i) && variables_.count(i) &&
+                variables_.at(i).initialized &&
+                !builder.GetInsertBlock()->getTerminator())
+                arrayDimsCache[i] =
+                    loadArrayDims(load(i), rank->second);
+
             if (Parameter::RIR_CHECK_PIR_TYPES > 0 && !i->type.isVoid() &&
                 variables_.count(i)) {
                 if (Representation::Of(i) == t::SEXP) {
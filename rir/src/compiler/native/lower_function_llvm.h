@@ -56,6 +56,11 @@ class LowerFunctionLLVM {
     std::vector<ArglistOrder::CallArglistOrder> argReordering;
 
     std::unordered_map<Value*, std::unordered_map<SEXP, size_t>> bindingsCache;
+
+    // Matrices (rank 2) and arrays (rank 3) indexed at scalar positions. Their
+    // dims are loaded once, right after they are defined.
+    std::unordered_map<Instruction*, size_t> arrayRanks;
+    std::unordered_map<Value*, std::vector<llvm::Value*>> arrayDimsCache;
     llvm::Value* bindingsCacheBase = nullptr;
 
     llvm::MDNode* branchAlwaysTrue;
@@ -73,6 +78,9 @@ class LowerFunctionLLVM {
 
   public:
     PirTypeFeedback* pirTypeFeedback = nullptr;
+    // Pool slots of recursive calls, to be patched with the rir::Function of
+    // the version once it exists
+    std::vector<BC::PoolIdx> selfCallTargets;
     llvm::Function* fun;
     MkEnv* myPromenv = nullptr;
 
@@ -384,6 +392,8 @@ class LowerFunctionLLVM {
     llvm::Value* box(llvm::Value* v, PirType t, bool protect = true);
     llvm::Value* boxInt(llvm::Value* v, bool protect = true);
     llvm::Value* boxReal(llvm::Value* v, bool protect = true);
+    llvm::Value* boxComplex(llvm::Value* re, llvm::Value* im,
+                            bool protect = true);
     llvm::Value* boxLgl(llvm::Value* v);
     llvm::Value* boxTst(llvm::Value* v);
     void insn_assert(llvm::Value* v, const char* msg, llvm::Value* p = nullptr);
@@ -395,12 +405,25 @@ class LowerFunctionLLVM {
     llvm::Value* computeAndCheckIndex(Value* index, llvm::Value* vector,
                                       llvm::BasicBlock* fallback,
                                       llvm::Value* max = nullptr);
+    bool altrepAccessSupported(Value* vector);
+    llvm::Value* accessAltrepVector(Value* index, llvm::Value* vector,
+                                    PirType type, llvm::BasicBlock* fallback);
+    std::vector<llvm::Value*> loadArrayDims(llvm::Value* v, size_t rank);
+    std::vector<llvm::Value*> arrayDims(Value* vec, llvm::Value* v,
+                                        size_t rank);
+    void inheritArrayDims(Instruction* i, Value* vec);
     bool compileDotcall(Instruction* i,
                         const std::function<llvm::Value*()>& callee,
                         const std::function<SEXP(size_t)>& names);
 
+    typedef std::vector<std::pair<Instruction*, Variable>> SavedLocals;
+    SavedLocals saveLiveLocals(Instruction* i, ContextData& data);
+    void restoreSavedLocals(const SavedLocals& savedLocals);
+    llvm::Value* contextSetjmp(ContextData& data);
+
     void compilePushContext(Instruction* i);
     void compilePopContext(Instruction* i);
+    void compilePushLoopContext(Instruction* i);
 
     void compileBinop(
         Instruction* i,
@@ -433,6 +456,7 @@ class LowerFunctionLLVM {
             intInsert,
         const std::function<llvm::Value*(llvm::Value*, llvm::Value*)>& fpInsert,
         BinopKind kind, bool testNa = true);
+    void compileFusedVectorOp(FusedVectorOp* i);
 
     void compile();
 
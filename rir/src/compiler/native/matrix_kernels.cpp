@@ -0,0 +1,279 @@
+#include "matrix_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef PIR_USE_BLAS
+#include <R_ext/BLAS.h>
+#ifndef FCONE
+#define FCONE
+#endif
+#endif
+
+namespace rir {
+namespace pir {
+
+static constexpr int BLOCK = 64;
+
+static bool plainMatrix(SEXP x, SEXPTYPE type, int& nrow, int& ncol) {
+    if (TYPEOF(x) != type || ALTREP(x) || OBJECT(x))
+        return false;
+    auto attr = ATTRIB(x);
+    if (attr == R_NilValue || TAG(attr) != R_DimSymbol ||
+        CDR(attr) != R_NilValue)
+        return false;
+    auto dim = CAR(attr);
+    if (TYPEOF(dim) != INTSXP || XLENGTH(dim) != 2)
+        return false;
+    nrow = INTEGER(dim)[0];
+    ncol = INTEGER(dim)[1];
+    return true;
+}
+
+// R computes products with NaN or Inf without BLAS, to get the propagation of
+// NA right. Those are left to R.
+static bool allFinite(SEXP x) {
+    auto d = REAL(x);
+    for (R_xlen_t i = 0, n = XLENGTH(x); i < n; ++i)
+        if (!std::isfinite(d[i]))
+            return false;
+    return true;
+}
+
+#ifndef PIR_USE_BLAS
+// z (n x m) = a (n x k) * b (k x m), rows are processed in blocks such that
+// the touched part of z stays in cache
+static void product(const double* a, const double* b, int n, int k, int m,
+                    double* z) {
+    std::fill(z, z + (R_xlen_t)n * m, 0.0);
+    for (int ii = 0; ii < n; ii += BLOCK) {
+        auto ie = std::min(n, ii + BLOCK);
+        for (int j = 0; j < m; ++j) {
+            auto zj = z + (R_xlen_t)n * j;
+            for (int p = 0; p < k; ++p) {
+                auto bpj = b[p + (R_xlen_t)k * j];
+                auto ap = a + (R_xlen_t)n * p;
+                for (int i = ii; i < ie; ++i)
+                    zj[i] += ap[i] * bpj;
+            }
+        }
+    }
+}
+
+// z (n x m) = t(a) * b, where a is k x n and b is k x m. Columns of both are
+// contiguous, every entry is a dot product.
+static void crossProduct(const double* a, const double* b, int n, int k, int m,
+                         double* z) {
+    for (int jj = 0; jj < m; jj += BLOCK) {
+        auto je = std::min(m, jj + BLOCK);
+        for (int i = 0; i < n; ++i) {
+            auto ai = a + (R_xlen_t)k * i;
+            for (int j = jj; j < je; ++j) {
+                auto bj = b + (R_xlen_t)k * j;
+                double sum = 0;
+                for (int p = 0; p < k; ++p)
+                    sum += ai[p] * bj[p];
+                z[i + (R_xlen_t)n * j] = sum;
+            }
+        }
+    }
+}
+#endif
+
+SEXP MatrixKernels::matprod(SEXP x, SEXP y) {
+    int nrx, ncx, nry, ncy;
+    if (!plainMatrix(x, REALSXP, nrx, ncx) ||
+        !plainMatrix(y, REALSXP, nry, ncy) || ncx != nry || !allFinite(x) ||
+        !allFinite(y))
+        return nullptr;
+
+    auto res = Rf_allocMatrix(REALSXP, nrx, ncy);
+    auto z = REAL(res);
+    if (nrx == 0 || ncx == 0 || ncy == 0) {
+        std::fill(z, z + (R_xlen_t)nrx * ncy, 0.0);
+        return res;
+    }
+#ifdef PIR_USE_BLAS
+    // Same calls as R's matprod, to get the same results
+    const char *transN = "N", *transT = "T";
+    double one = 1.0, zero = 0.0;
+    int ione = 1;
+    if (ncy == 1)
+        F77_CALL(dgemv)(transN, &nrx, &ncx, &one, REAL(x), &nrx, REAL(y),
+                        &ione, &zero, z, &ione FCONE);
+    else if (nrx == 1)
+        F77_CALL(dgemv)(transT, &nry, &ncy, &one, REAL(y), &nry, REAL(x),
+                        &ione, &zero, z, &ione FCONE);
+    else
+        F77_CALL(dgemm)(transN, transN, &nrx, &ncy, &ncx, &one, REAL(x), &nrx,
+                        REAL(y), &nry, &zero, z, &nrx FCONE FCONE);
+#else
+    product(REAL(x), REAL(y), nrx, ncx, ncy, z);
+#endif
+    return res;
+}
+
+SEXP MatrixKernels::crossprod(SEXP x, SEXP y) {
+    int nrx, ncx, nry, ncy;
+    bool sym = y == R_NilValue;
+    if (sym)
+        y = x;
+    if (!plainMatrix(x, REALSXP, nrx, ncx) ||
+        !plainMatrix(y, REALSXP, nry, ncy) || nrx != nry || !allFinite(x) ||
+        (!sym && !allFinite(y)))
+        return nullptr;
+
+    auto res = Rf_allocMatrix(REALSXP, ncx, ncy);
+    auto z = REAL(res);
+    if (nrx == 0 || ncx == 0 || ncy == 0) {
+        std::fill(z, z + (R_xlen_t)ncx * ncy, 0.0);
+        return res;
+    }
+#ifdef PIR_USE_BLAS
+    // Same calls as R's crossprod and symcrossprod
+    const char *transN = "N", *transT = "T", *uplo = "U";
+    double one = 1.0, zero = 0.0;
+    int ione = 1;
+    if (sym) {
+        F77_CALL(dsyrk)(uplo, transT, &ncx, &nrx, &one, REAL(x), &nrx, &zero,
+                        z, &ncx FCONE FCONE);
+        for (int i = 1; i < ncx; i++)
+            for (int j = 0; j < i; j++)
+                z[i + (R_xlen_t)ncx * j] = z[j + (R_xlen_t)ncx * i];
+    } else if (ncy == 1) {
+        F77_CALL(dgemv)(transT, &nrx, &ncx, &one, REAL(x), &nrx, REAL(y),
+                        &ione, &zero, z, &ione FCONE);
+    } else if (ncx == 1) {
+        F77_CALL(dgemv)(transT, &nry, &ncy, &one, REAL(y), &nry, REAL(x),
+                        &ione, &zero, z, &ione FCONE);
+    } else {
+        F77_CALL(dgemm)(transT, transN, &ncx, &ncy, &nrx, &one, REAL(x), &nrx,
+                        REAL(y), &nry, &zero, z, &ncx FCONE FCONE);
+    }
+#else
+    crossProduct(REAL(x), REAL(y), ncx, nrx, ncy, z);
+#endif
+    return res;
+}
+
+template <typename T>
+static void transpose(const T* x, int nrow, int ncol, T* z) {
+    for (int ii = 0; ii < nrow; ii += BLOCK) {
+        auto ie = std::min(nrow, ii + BLOCK);
+        for (int jj = 0; jj < ncol; jj += BLOCK) {
+            auto je = std::min(ncol, jj + BLOCK);
+            for (int i = ii; i < ie; ++i)
+                for (int j = jj; j < je; ++j)
+                    z[j + (R_xlen_t)ncol * i] = x[i + (R_xlen_t)nrow * j];
+        }
+    }
+}
+
+SEXP MatrixKernels::transpose(SEXP x) {
+    int nrow, ncol;
+    auto type = TYPEOF(x);
+    if (!plainMatrix(x, type, nrow, ncol) ||
+        (type != REALSXP && type != INTSXP && type != LGLSXP))
+        return nullptr;
+    auto res = Rf_allocMatrix(type, ncol, nrow);
+    if (type == REALSXP)
+        pir::transpose(REAL(x), nrow, ncol, REAL(res));
+    else
+        pir::transpose(INTEGER(x), nrow, ncol, INTEGER(res));
+    return res;
+}
+
+// The arguments of the rowSums and colSums internals. Anything R would
+// complain about is left to R.
+static bool sumsArgs(SEXP x, SEXP nSexp, SEXP pSexp, SEXP naRm, R_xlen_t& n,
+                     R_xlen_t& p, bool& keepNA) {
+    auto type = TYPEOF(x);
+    if ((type != REALSXP && type != INTSXP && type != LGLSXP) || ALTREP(x) ||
+        OBJECT(x))
+        return false;
+    auto size = [](SEXP s, R_xlen_t& res) {
+        if (XLENGTH(s) != 1)
+            return false;
+        double d;
+        if (TYPEOF(s) == INTSXP && INTEGER(s)[0] != NA_INTEGER)
+            d = INTEGER(s)[0];
+        else if (TYPEOF(s) == REALSXP)
+            d = REAL(s)[0];
+        else
+            return false;
+        if (!(d >= 0) || d != std::floor(d) || d > R_XLEN_T_MAX)
+            return false;
+        res = (R_xlen_t)d;
+        return true;
+    };
+    if (!size(nSexp, n) || !size(pSexp, p))
+        return false;
+    if (TYPEOF(naRm) != LGLSXP || XLENGTH(naRm) != 1 ||
+        LOGICAL(naRm)[0] == NA_LOGICAL)
+        return false;
+    keepNA = !LOGICAL(naRm)[0];
+    return (double)n * p <= XLENGTH(x);
+}
+
+// Accumulates in long double like R does, so the results are the same
+SEXP MatrixKernels::rowSums(SEXP x, SEXP nSexp, SEXP pSexp, SEXP naRm) {
+    R_xlen_t n, p;
+    bool keepNA;
+    if (!sumsArgs(x, nSexp, pSexp, naRm, n, p, keepNA))
+        return nullptr;
+    auto res = Rf_allocVector(REALSXP, n);
+    std::vector<long double> sums(n, 0);
+    for (R_xlen_t j = 0; j < p; ++j) {
+        if (TYPEOF(x) == REALSXP) {
+            auto col = REAL(x) + n * j;
+            for (R_xlen_t i = 0; i < n; ++i)
+                if (keepNA || !std::isnan(col[i]))
+                    sums[i] += col[i];
+        } else {
+            auto col = INTEGER(x) + n * j;
+            for (R_xlen_t i = 0; i < n; ++i)
+                if (col[i] != NA_INTEGER)
+                    sums[i] += col[i];
+                else if (keepNA)
+                    sums[i] = NA_REAL;
+        }
+    }
+    auto out = REAL(res);
+    for (R_xlen_t i = 0; i < n; ++i)
+        out[i] = (double)sums[i];
+    return res;
+}
+
+SEXP MatrixKernels::colSums(SEXP x, SEXP nSexp, SEXP pSexp, SEXP naRm) {
+    R_xlen_t n, p;
+    bool keepNA;
+    if (!sumsArgs(x, nSexp, pSexp, naRm, n, p, keepNA))
+        return nullptr;
+    auto res = Rf_allocVector(REALSXP, p);
+    auto out = REAL(res);
+    for (R_xlen_t j = 0; j < p; ++j) {
+        long double sum = 0;
+        if (TYPEOF(x) == REALSXP) {
+            auto col = REAL(x) + n * j;
+            for (R_xlen_t i = 0; i < n; ++i)
+                if (keepNA || !std::isnan(col[i]))
+                    sum += col[i];
+        } else {
+            auto col = INTEGER(x) + n * j;
+            for (R_xlen_t i = 0; i < n; ++i) {
+                if (col[i] != NA_INTEGER) {
+                    sum += col[i];
+                } else if (keepNA) {
+                    sum = NA_REAL;
+                    break;
+                }
+            }
+        }
+        out[j] = (double)sum;
+    }
+    return res;
+}
+
+} // namespace pir
+} // namespace rir
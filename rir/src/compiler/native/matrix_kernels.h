@@ -0,0 +1,30 @@
+#ifndef PIR_MATRIX_KERNELS_H
+#define PIR_MATRIX_KERNELS_H
+
+#include "R/r.h"
+
+namespace rir {
+namespace pir {
+
+// Native versions of the common matrix primitives. They only handle plain
+// matrices (no ALTREP, no attributes but dim) and return nullptr for anything
+// else, the caller then calls the R builtin. Products go to the BLAS linked
+// with R, the same way R does it, if rir is built with PIR_USE_BLAS.
+// Otherwise a blocked kernel is used.
+struct MatrixKernels {
+    // x %*% y on double matrices
+    static SEXP matprod(SEXP x, SEXP y);
+    // crossprod(x, y) on double matrices, y may be R_NilValue
+    static SEXP crossprod(SEXP x, SEXP y);
+    // The internal of t.default, on double, integer and logical matrices
+    static SEXP transpose(SEXP x);
+    // The internals of rowSums and colSums, arguments as in
+    // .Internal(rowSums(x, n, p, na.rm))
+    static SEXP rowSums(SEXP x, SEXP n, SEXP p, SEXP naRm);
+    static SEXP colSums(SEXP x, SEXP n, SEXP p, SEXP naRm);
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
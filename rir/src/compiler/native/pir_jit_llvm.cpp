@@ -430,6 +430,9 @@ void PirJitLLVM::compile(
         target->pirTypeFeedback(funCompiler.pirTypeFeedback);
     if (funCompiler.hasArgReordering())
         target->arglistOrder(ArglistOrder::New(funCompiler.getArgReordering()));
+    selfCallTargets.insert(selfCallTargets.end(),
+                           funCompiler.selfCallTargets.begin(),
+                           funCompiler.selfCallTargets.end());
     // can we use llvm::StringRefs?
     jitFixup.emplace(code,
                      std::make_pair(target, funCompiler.fun->getName().str()));
@@ -50,6 +50,10 @@ class PirJitLLVM {
                  const std::unordered_set<Instruction*>& needsLdVarForUpdate,
                  ClosureStreamLogger& log);
 
+    // Pool slots of recursive calls in the compiled versions. The backend
+    // patches them with the rir::Function of the version.
+    std::vector<BC::PoolIdx> selfCallTargets;
+
     using GetModule = std::function<llvm::Module&()>;
     using GetFunction = std::function<llvm::Function*(Code*)>;
     using GetBuiltin = std::function<llvm::Function*(const NativeBuiltin&)>;
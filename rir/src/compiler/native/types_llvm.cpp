@@ -10,6 +10,8 @@ void initializeTypes(LLVMContext& context) {
     t::i1 = IntegerType::get(context, 1);
     t::Int = IntegerType::get(context, 32);
     t::Double = Type::getDoubleTy(context);
+    // The LDOUBLE accumulator of R's real reductions
+    t::LongDouble = Type::getX86_FP80Ty(context);
 
     t::IntPtr = PointerType::get(t::Int, 0);
     t::DoublePtr = PointerType::get(t::Double, 0);
@@ -150,6 +152,7 @@ namespace t {
 Type* i1;
 Type* Int;
 Type* Double;
+Type* LongDouble;
 Type* Void;
 Type* VectorLength;
 
@@ -17,6 +17,7 @@ extern llvm::StructType* SEXP_u1;
 extern llvm::Type* i1;
 extern llvm::Type* Int;
 extern llvm::Type* Double;
+extern llvm::Type* LongDouble;
 extern llvm::Type* Void;
 extern llvm::PointerType* IntPtr;
 extern llvm::PointerType* DoublePtr;
@@ -0,0 +1,226 @@
+#include "vector_kernels.h"
+
+#include "R/r.h"
+#include "compiler/parameter.h"
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+unsigned Parameter::PARALLEL_THREADS =
+    getenv("PIR_PARALLEL_THREADS") ? atoi(getenv("PIR_PARALLEL_THREADS"))
+                                   : std::thread::hardware_concurrency();
+size_t Parameter::PARALLEL_THRESHOLD =
+    getenv("PIR_PARALLEL_THRESHOLD") ? atol(getenv("PIR_PARALLEL_THRESHOLD"))
+                                     : 1 << 18;
+
+static constexpr size_t CHUNK = 1 << 15;
+
+static ThreadPool& pool() {
+    // Never destroyed, the workers are idle until R exits
+    static auto pool = new ThreadPool(Parameter::PARALLEL_THREADS);
+    return *pool;
+}
+
+static size_t chunks(size_t n) { return (n + CHUNK - 1) / CHUNK; }
+
+// Calls body(begin, end, chunk) for every chunk of [0, n). The body runs on
+// the thread pool, so it may only touch raw vector data.
+template <typename F>
+static void chunked(size_t n, const F& body) {
+    pool().run(chunks(n), [&](size_t c) {
+        body(c * CHUNK, std::min(n, (c + 1) * CHUNK), c);
+    });
+}
+
+static inline double toReal(double x, int, double) { return x; }
+static inline double toReal(int x, int naInt, double naReal) {
+    return x == naInt ? naReal : (double)x;
+}
+
+// Sums and products accumulate sequentially in long double, like GNU R. Any
+// split into partial results would change the rounding, so the reductions do
+// not use the thread pool.
+template <typename Op>
+static long double reduce(const double* x, size_t n, long double init, Op op) {
+    auto res = init;
+    for (size_t i = 0; i < n; ++i)
+        res = op(res, x[i]);
+    return res;
+}
+
+// Integers are accumulated exactly, a NA anywhere makes the result NA
+template <typename Op>
+static bool reduce(const int* x, size_t n, long double init, Op op,
+                   long double& res) {
+    auto naInt = NA_INTEGER;
+    res = init;
+    for (size_t i = 0; i < n; ++i) {
+        if (x[i] == naInt)
+            return false;
+        res = op(res, x[i]);
+    }
+    return true;
+}
+
+// ALTREP vectors are read in chunks through Get_region instead of being
+// materialized by DATAPTR. The accumulator is carried over from one chunk to
+// the next.
+template <typename Op>
+static double reduceAltrep(SEXP v, long double init, Op op) {
+    auto n = XLENGTH(v);
+    auto res = init;
+    if (TYPEOF(v) == REALSXP) {
+        std::vector<double> buf(std::min((size_t)n, CHUNK));
+        for (R_xlen_t i = 0; i < n; i += CHUNK) {
+            auto got = REAL_GET_REGION(v, i, buf.size(), buf.data());
+            res = reduce(buf.data(), got, res, op);
+        }
+        return res;
+    }
+    assert(TYPEOF(v) == INTSXP);
+    std::vector<int> buf(std::min((size_t)n, CHUNK));
+    for (R_xlen_t i = 0; i < n; i += CHUNK) {
+        auto got = INTEGER_GET_REGION(v, i, buf.size(), buf.data());
+        if (!reduce(buf.data(), got, res, op, res))
+            return NA_REAL;
+    }
+    return res;
+}
+
+double VectorKernels::sum(SEXP v) {
+    auto n = XLENGTH(v);
+    auto add = [](long double a, long double b) { return a + b; };
+    if (ALTREP(v))
+        return reduceAltrep(v, 0, add);
+    if (TYPEOF(v) == REALSXP)
+        return reduce(REAL(v), n, 0, add);
+    assert(TYPEOF(v) == INTSXP);
+    long double res;
+    return reduce(INTEGER(v), n, 0, add, res) ? (double)res : NA_REAL;
+}
+
+double VectorKernels::prod(SEXP v) {
+    auto n = XLENGTH(v);
+    auto mul = [](long double a, long double b) { return a * b; };
+    if (ALTREP(v))
+        return reduceAltrep(v, 1, mul);
+    if (TYPEOF(v) == REALSXP)
+        return reduce(REAL(v), n, 1, mul);
+    assert(TYPEOF(v) == INTSXP);
+    long double res;
+    return reduce(INTEGER(v), n, 1, mul, res) ? (double)res : NA_REAL;
+}
+
+// Integers are converted like R does, NA becomes NA_REAL
+template <typename A, typename B, typename Op>
+static void elementwise(const A* a, size_t na, const B* b, size_t nb,
+                        size_t n, const Op& op) {
+    auto naInt = NA_INTEGER;
+    auto naReal = NA_REAL;
+    chunked(n, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+            op(i, toReal(a[na == 1 ? 0 : i], naInt, naReal),
+               toReal(b[nb == 1 ? 0 : i], naInt, naReal));
+    });
+}
+
+template <typename Op>
+static void elementwise(SEXP lhs, SEXP rhs, size_t n, const Op& op) {
+    size_t nl = XLENGTH(lhs), nr = XLENGTH(rhs);
+    if (TYPEOF(lhs) == REALSXP) {
+        if (TYPEOF(rhs) == REALSXP)
+            elementwise(REAL(lhs), nl, REAL(rhs), nr, n, op);
+        else
+            elementwise(REAL(lhs), nl, INTEGER(rhs), nr, n, op);
+    } else {
+        if (TYPEOF(rhs) == REALSXP)
+            elementwise(INTEGER(lhs), nl, REAL(rhs), nr, n, op);
+        else
+            elementwise(INTEGER(lhs), nl, INTEGER(rhs), nr, n, op);
+    }
+}
+
+template <typename Op>
+static SEXP arith(SEXP lhs, SEXP rhs, size_t n, const Op& op) {
+    auto res = Rf_allocVector(REALSXP, n);
+    auto out = REAL(res);
+    elementwise(lhs, rhs, n,
+                [=](size_t i, double a, double b) { out[i] = op(a, b); });
+    return res;
+}
+
+template <typename Cmp>
+static SEXP compare(SEXP lhs, SEXP rhs, size_t n, const Cmp& cmp) {
+    auto res = Rf_allocVector(LGLSXP, n);
+    auto out = LOGICAL(res);
+    auto naLgl = NA_LOGICAL;
+    elementwise(lhs, rhs, n, [=](size_t i, double a, double b) {
+        out[i] = std::isnan(a) || std::isnan(b) ? naLgl : cmp(a, b);
+    });
+    return res;
+}
+
+static bool isPlainNumeric(SEXP v) {
+    return (TYPEOF(v) == REALSXP || TYPEOF(v) == INTSXP) &&
+           ATTRIB(v) == R_NilValue && !ALTREP(v);
+}
+
+SEXP VectorKernels::binop(SEXP lhs, SEXP rhs, BinopKind kind) {
+    if (!isPlainNumeric(lhs) || !isPlainNumeric(rhs))
+        return nullptr;
+    size_t nl = XLENGTH(lhs), nr = XLENGTH(rhs);
+    auto n = std::max(nl, nr);
+    if (n < Parameter::PARALLEL_THRESHOLD || (nl != nr && nl != 1 && nr != 1))
+        return nullptr;
+    bool integer = TYPEOF(lhs) == INTSXP && TYPEOF(rhs) == INTSXP;
+
+    SEXP res = nullptr;
+    switch (kind) {
+    case BinopKind::ADD:
+        if (!integer)
+            res = arith(lhs, rhs, n, [](double a, double b) { return a + b; });
+        break;
+    case BinopKind::SUB:
+        if (!integer)
+            res = arith(lhs, rhs, n, [](double a, double b) { return a - b; });
+        break;
+    case BinopKind::MUL:
+        if (!integer)
+            res = arith(lhs, rhs, n, [](double a, double b) { return a * b; });
+        break;
+    case BinopKind::DIV:
+        res = arith(lhs, rhs, n, [](double a, double b) { return a / b; });
+        break;
+    case BinopKind::EQ:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a == b; });
+        break;
+    case BinopKind::NE:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a != b; });
+        break;
+    case BinopKind::LT:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a < b; });
+        break;
+    case BinopKind::LTE:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a <= b; });
+        break;
+    case BinopKind::GT:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a > b; });
+        break;
+    case BinopKind::GTE:
+        res = compare(lhs, rhs, n, [](double a, double b) { return a >= b; });
+        break;
+    default: {}
+    }
+    if (res)
+        R_Visible = (Rboolean) true;
+    return res;
+}
+
+} // namespace pir
+} // namespace rir
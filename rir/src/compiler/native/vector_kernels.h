@@ -0,0 +1,26 @@
+#ifndef PIR_VECTOR_KERNELS_H
+#define PIR_VECTOR_KERNELS_H
+
+#include "builtins.h"
+
+namespace rir {
+namespace pir {
+
+// Numeric kernels over the raw data of real and integer vectors.
+struct VectorKernels {
+    // Sequential, to round exactly like GNU R. ALTREP vectors are read through
+    // their Get_region method.
+    static double sum(SEXP v);
+    static double prod(SEXP v);
+
+    // Elementwise arithmetic and comparisons on attribute-free vectors with
+    // at least Parameter::PARALLEL_THRESHOLD elements. The vectors are split
+    // into chunks of a fixed size, which run on a thread pool. Returns nullptr
+    // for anything else, including integer arithmetic which might overflow.
+    static SEXP binop(SEXP lhs, SEXP rhs, BinopKind kind);
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
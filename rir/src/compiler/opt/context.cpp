@@ -1,20 +1,149 @@
 #include "../analysis/unnecessary_contexts.h"
 #include "../pir/pir_impl.h"
+#include "../util/bb_transform.h"
 #include "../util/visitor.h"
+#include "R/Symbols.h"
 #include "compiler/analysis/cfg.h"
 
 #include "R/r.h"
 #include "pass_definitions.h"
 
+#include <deque>
+#include <functional>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace rir {
 namespace pir {
 
+// Visits all instructions of an iteration of a loop with context, i.e.
+// everything reachable from the loop body until the context is popped. Deopt
+// branches are skipped, since the interpreter creates its own loop contexts.
+static void
+eachInIteration(PushLoopContext* push,
+                const std::function<void(Instruction*)>& apply) {
+    std::unordered_set<BB*> seen;
+    std::deque<BB*> todo = {push->bodyBB()};
+    while (!todo.empty()) {
+        auto bb = todo.front();
+        todo.pop_front();
+        if (seen.count(bb) || bb->isDeopt())
+            continue;
+        seen.insert(bb);
+        bool popped = false;
+        for (auto i : *bb) {
+            auto pop = PopLoopContext::Cast(i);
+            if (pop && pop->push() == push) {
+                popped = true;
+                break;
+            }
+            apply(i);
+        }
+        if (!popped)
+            for (auto n : bb->successors())
+                todo.push_back(n);
+    }
+}
+
+// Loops need a context only if an iteration can run code that does a
+// non-local break or next. Calls to break and next from inlined promises are
+// turned into regular jumps to the landing pad targets.
+static bool optimizeLoopContexts(Code* code) {
+    std::vector<PushLoopContext*> pushes;
+    Visitor::run(code->entry, [&](BB* bb) {
+        if (!bb->isEmpty())
+            if (auto push = PushLoopContext::Cast(bb->last()))
+                pushes.push_back(push);
+    });
+    if (pushes.empty())
+        return false;
+
+    bool anyChange = false;
+    std::unordered_set<BB*> dead;
+    std::unordered_set<LdFun*> ldfuns;
+    for (auto push : pushes) {
+        auto landing = push->landingBB();
+        auto isBreak = IsLoopBreak::Cast(*landing->begin());
+        auto branch = Branch::Cast(landing->last());
+        if (!isBreak || !branch || branch->arg(0).val() != isBreak)
+            continue;
+
+        bool nested = false;
+        std::vector<Call*> jumps;
+        eachInIteration(push, [&](Instruction* i) {
+            if (PushContext::Cast(i) || PushLoopContext::Cast(i))
+                nested = true;
+            if (auto call = Call::Cast(i)) {
+                auto ldfun = LdFun::Cast(call->cls()->followCasts());
+                if (call->nCallArgs() == 0 && ldfun &&
+                    ldfun->env() == push->env() &&
+                    call->env() == push->env() &&
+                    (ldfun->varName == symbol::Break ||
+                     ldfun->varName == symbol::Next))
+                    jumps.push_back(call);
+            }
+        });
+        if (nested)
+            continue;
+
+        for (auto call : jumps) {
+            auto ldfun = LdFun::Cast(call->cls()->followCasts());
+            auto target = ldfun->varName == symbol::Break
+                              ? landing->trueBranch()
+                              : landing->falseBranch();
+            if (!target->isEmpty() || !target->isJmp())
+                continue;
+
+            auto bb = call->bb();
+            dead.insert(BBTransform::split(code->nextBBId++, bb,
+                                           bb->atPosition(call), code));
+            bb->append(new PopLoopContext(push));
+            bb->overrideNext(target);
+            ldfuns.insert(ldfun);
+            anyChange = true;
+        }
+    }
+    BBTransform::removeDeadBlocks(code, dead);
+    Visitor::run(code->entry, [&](Instruction* i) {
+        i->eachArg([&](Value* v) {
+            if (auto ldfun = LdFun::Cast(v))
+                ldfuns.erase(ldfun);
+        });
+    });
+    for (auto ldfun : ldfuns)
+        ldfun->bb()->remove(ldfun);
+
+    for (auto push : pushes) {
+        bool needed = false;
+        std::vector<Instruction*> pops;
+        eachInIteration(push, [&](Instruction* i) {
+            if (i->effects.contains(Effect::ExecuteCode))
+                needed = true;
+        });
+        if (needed)
+            continue;
+
+        Visitor::run(code->entry, [&](Instruction* i) {
+            auto pop = PopLoopContext::Cast(i);
+            if (pop && pop->push() == push && pop->bb() != push->landingBB())
+                pops.push_back(pop);
+        });
+        for (auto pop : pops)
+            pop->eraseAndRemove();
+
+        auto bb = push->bb();
+        auto landing = push->landingBB();
+        bb->convertBranchToJmp(true);
+        BBTransform::removeDeadBlocks(code, {landing});
+        bb->remove(push);
+        anyChange = true;
+    }
+    return anyChange;
+}
+
 bool OptimizeContexts::apply(Compiler&, ClosureVersion* cls, Code* code,
                              LogStream& log) const {
-    bool anyChange = false;
+    bool anyChange = optimizeLoopContexts(code);
     Visitor::run(code->entry, [&](BB* bb) {
         for (auto it = bb->begin(); it != bb->end(); ++it) {
             if (auto ret = NonLocalReturn::Cast(*it)) {
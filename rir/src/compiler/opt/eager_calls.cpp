@@ -14,6 +14,20 @@
 namespace rir {
 namespace pir {
 
+// Evaluating the promise can be moved over any other code: it does not read
+// or write the environment, cannot fail or warn and does not run other code.
+// Speculation is fine, the deopt would only restart the promise.
+static bool commutes(Promise* prom) {
+    static const Effects allowed = Effects(Effect::Visibility) |
+                                   Effect::LeakArg | Effect::TriggerDeopt |
+                                   Effect::DependsOnAssume;
+    return Visitor::check(prom->entry, [&](Instruction* i) {
+        if (Deopt::Cast(i) || Checkpoint::Cast(i) || FrameState::Cast(i))
+            return true;
+        return allowed.includes(i->effects);
+    });
+}
+
 bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                        LogStream& log) const {
     AvailableCheckpoints checkpoint(cls, code, log);
@@ -40,12 +54,13 @@ bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
         // this is guaranteed to cause problems, since many variables are called
         // "c". Therefore we keep the ldfun in this case, unless we already know
         // that the function "c" comes from the global env.
-        // TODO: Implement this with a dependency on the binding cell instead of
-        // an eager check.
+        // If the lookup passes only locked frames the guard reads the binding
+        // where it is, which compiles to a load from the binding cell.
         auto funEnv = Env::Cast(ldfun->env());
         if (ldfun->varName != symbol::c ||
             (funEnv && funEnv->rho == R_GlobalEnv)) {
-            given = new LdVar(ldfun->varName, ldfun->env());
+            given = new LdVar(ldfun->varName,
+                              Env::bindingSite(ldfun->env(), ldfun->varName));
             ip = bb->insert(ip, given);
             ++ip;
         }
@@ -296,35 +311,46 @@ bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                     continue;
                 }
 
-                auto preEval = [&](Value* a, unsigned i) -> MkArg* {
-                    auto mk = MkArg::Cast(a);
-                    if (!mk)
-                        return nullptr;
+                // The arguments the callee certainly forces, in the order it
+                // forces them.
+                std::vector<size_t> forceOrder;
+                if (allEager) {
+                    for (size_t i = 0; i < call->nCallArgs(); ++i)
+                        forceOrder.push_back(i);
+                } else {
+                    forceOrder = version->properties.argumentForceOrder;
+                }
 
+                std::vector<MkArg*> args;
+                call->eachCallArg(
+                    [&](Value* a) { args.push_back(MkArg::Cast(a)); });
+
+                // Promises are evaluated here in the order the callee would
+                // force them. A promise we cannot evaluate (because it might
+                // observe the context) is left to the callee. The ones it
+                // forces later may only be moved before it if evaluating them
+                // commutes with anything, see commutes().
+                SmallSet<unsigned> preEval;
+                bool leftLazy = false;
+                for (auto a : forceOrder) {
+                    if (a >= args.size())
+                        break;
+                    auto mk = args[a];
+                    if (!mk)
+                        continue;
+                    if (mk->isEager()) {
+                        preEval.insert(a);
+                        continue;
+                    }
                     auto safe =
                         Visitor::check(mk->prom()->entry, [&](Instruction* i) {
                             return !i->mayObserveContext() || Deopt::Cast(i);
                         });
-                    if (!safe)
-                        return nullptr;
-
-                    if (allEager)
-                        return mk;
-                    unsigned count = 0;
-                    for (auto a : version->properties.argumentForceOrder) {
-                        // We know that a is forced before i, therefore we are
-                        // not in left-to-right order
-                        // TODO: support reordering of the evaluation
-                        if (count != a)
-                            return nullptr;
-                        // We found the argument in the list of certainly forced
-                        // promises
-                        if (a == i)
-                            return mk;
-                        i++;
-                    }
-                    return nullptr;
-                };
+                    if (safe && (!leftLazy || commutes(mk->prom())))
+                        preEval.insert(a);
+                    else
+                        leftLazy = true;
+                }
 
                 bool noMissing = true;
                 call->eachCallArg([&](Value* v) {
@@ -342,9 +368,11 @@ bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                 unsigned i = 0;
                 Context newAssumptions = availableAssumptions;
                 SmallSet<unsigned> eager;
+                std::unordered_map<unsigned, InstrArg*> toForce;
                 bool improved = false;
                 call->eachCallArg([&](InstrArg& arg) {
-                    if (auto mk = preEval(arg.val(), i)) {
+                    if (preEval.count(i)) {
+                        auto mk = args[i];
                         if (mk->isEager()) {
                             if (!mk->eagerArg()->type.maybeMissing()) {
                                 improved = true;
@@ -352,22 +380,7 @@ bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                             }
                         } else {
                             improved = true;
-                            auto asArg = new CastType(
-                                mk, CastType::Upcast, RType::prom,
-                                Query::returnType(mk->prom()).orLazy());
-                            auto forced = new Force(asArg, Env::elided(),
-                                                    Tombstone::framestate());
-                            if (forced->type.maybeMissing()) {
-                                auto upd = new MkArg(mk->prom(), forced,
-                                                     Env::elided());
-                                ip = bb->insert(ip, upd);
-                                arg.val() = upd;
-                            } else {
-                                arg.val() = forced;
-                            }
-                            ip = bb->insert(ip, forced);
-                            ip = bb->insert(ip, asArg);
-                            ip += forced->type.maybeMissing() ? 3 : 2;
+                            toForce[i] = &arg;
                         }
                         eager.insert(i);
                         if (!newAssumptions.isEager(i))
@@ -375,6 +388,28 @@ bool EagerCalls::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                     }
                     i++;
                 });
+                for (auto a : forceOrder) {
+                    auto f = toForce.find(a);
+                    if (f == toForce.end())
+                        continue;
+                    auto& arg = *f->second;
+                    auto mk = args[a];
+                    auto asArg = new CastType(
+                        mk, CastType::Upcast, RType::prom,
+                        Query::returnType(mk->prom()).orLazy());
+                    auto forced =
+                        new Force(asArg, Env::elided(), Tombstone::framestate());
+                    if (forced->type.maybeMissing()) {
+                        auto upd = new MkArg(mk->prom(), forced, Env::elided());
+                        ip = bb->insert(ip, upd);
+                        arg.val() = upd;
+                    } else {
+                        arg.val() = forced;
+                    }
+                    ip = bb->insert(ip, forced);
+                    ip = bb->insert(ip, asArg);
+                    ip += forced->type.maybeMissing() ? 3 : 2;
+                }
 
                 if (!improved) {
                     ip = next;
@@ -129,8 +129,9 @@ bool Inline::apply(Compiler&, ClosureVersion* cls, Code* code,
                     No,
                 };
 
-                // TODO: instead of blacklisting those, we could also create
-                // contexts for inlined functions.
+                // Inlinees observing the context get one. It is removed again
+                // if only deopt branches need it, deoptimization then
+                // synthesizes it from the inlined frame.
                 SafeToInline allowInline = SafeToInline::Yes;
                 std::function<void(Code*)> updateAllowInline = [&](Code* code) {
                     Visitor::check(code->entry, [&](Instruction* i) {
@@ -141,6 +142,16 @@ bool Inline::apply(Compiler&, ClosureVersion* cls, Code* code,
                                 allowInline = SafeToInline::No;
                                 return false;
                             }
+                            // Forcing a promise does not count as observing
+                            // the context, see mayObserveContext.
+                            if (SafeBuiltinsList::forInlineWithContext(n)) {
+                                if (code != inlinee) {
+                                    allowInline = SafeToInline::No;
+                                    return false;
+                                }
+                                if (allowInline == SafeToInline::Yes)
+                                    allowInline = SafeToInline::NeedsContext;
+                            }
                         }
                         if (auto call = CallBuiltin::Cast(i)) {
                             if (!SafeBuiltinsList::forInline(call->builtinId)) {
@@ -266,6 +277,11 @@ bool Inline::apply(Compiler&, ClosureVersion* cls, Code* code,
                             // with the frameStates after the call to the
                             // inlinee
                             if (!sp->next()) {
+                                sp->callAst = rir::Pool::get(theCall->srcIdx);
+                                if (StaticCall::Cast(theCall) &&
+                                    inlineeCls->closureEnv() !=
+                                        Env::notClosed())
+                                    sp->callee = inlineeCls->rirClosure();
                                 auto copyFromFs = callerFrameState;
                                 auto cloneSp =
                                     FrameState::Cast(copyFromFs->clone());
@@ -162,6 +162,23 @@ class PASS(Overflow, true, false);
  */
 class PASS(HoistInstruction, false, false);
 
+/*
+ * Fuses trees of elementwise arithmetic on attribute-free numeric vectors,
+ * optionally consumed by sum, prod, max, min, any or all, into a single
+ * FusedVectorOp. The lengths of the vectors are guarded by assumptions, so
+ * this pass needs checkpoints.
+ */
+class PASS(VectorFusion, false, false);
+
+/*
+ * Turns calls of a version to itself in tail position into jumps back to its
+ * start, with the arguments passed through phis. Only for versions without
+ * reflection and contexts, where the frames of the elided calls are not
+ * observable. A deopt in a later iteration continues in a single frame, which
+ * returns the same result the nested calls would.
+ */
+class PASS(TailRecursion, false, false);
+
 class PhaseMarker : public Pass {
   public:
     explicit PhaseMarker(const std::string& name) : Pass(name) {}
@@ -79,6 +79,11 @@ PassScheduler::PassScheduler() {
 
     nextPhase("Speculation post");
     addDefaultPostPhaseOpt();
+    // Fusion needs the speculated types and checkpoints for its guards
+    add<TypeInference>();
+    add<ElideEnv>();
+    add<VectorFusion>();
+    add<Cleanup>();
 
     // ==== Phase 3) Remove checkpoints we did not use
     //
@@ -111,6 +116,8 @@ PassScheduler::PassScheduler() {
     addDefaultOpt();
     add<ElideEnvSpec>();
     add<CleanupCheckpoints>();
+    // Calls have no framestates anymore, tail calls can become jumps
+    add<TailRecursion>();
 
     nextPhase("Final post");
     addDefaultPostPhaseOpt();
@@ -627,6 +627,10 @@ bool ScopeResolution::apply(Compiler&, ClosureVersion* cls, Code* code,
                         if (!MaterializeEnv::Cast(i->env()))
                             i->env(aLoad.env);
 
+                        // Past locked frames, go straight to the binding
+                        if (auto ld = LdVar::Cast(i))
+                            ld->env(Env::bindingSite(ld->env(), ld->varName));
+
                         // Assume bindings in base namespace stay unchanged
                         if (!bb->isDeopt()) {
                             if (auto env = Env::Cast(aLoad.env)) {
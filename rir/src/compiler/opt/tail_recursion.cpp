@@ -0,0 +1,124 @@
+#include "../pir/pir_impl.h"
+#include "../util/bb_transform.h"
+#include "../util/visitor.h"
+#include "pass_definitions.h"
+
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+// A call to the version itself, with the arguments in the order of its
+// parameters
+static bool isSelfCall(ClosureVersion* cls, StaticCall* call) {
+    if (call->tryDispatch() != cls || call->isReordered() ||
+        call->nCallArgs() != cls->effectiveNArgs())
+        return false;
+    bool ok = true;
+    call->eachCallArg([&](Value* v) {
+        if (v == MissingArg::instance() || DotsList::Cast(v) ||
+            ExpandDots::Cast(v))
+            ok = false;
+    });
+    return ok;
+}
+
+// The call is in tail position if its result is returned right away, either
+// directly or through the phi which merges all return sites. Returns the
+// instruction which consumes the result.
+static Instruction* tailUse(StaticCall* call) {
+    auto bb = call->bb();
+    auto pos = bb->atPosition(call) + 1;
+    if (pos != bb->end()) {
+        auto ret = Return::Cast(*pos);
+        if (ret && pos + 1 == bb->end() && ret->arg(0).val() == call)
+            return ret;
+        return nullptr;
+    }
+    if (!bb->isJmp())
+        return nullptr;
+    auto merge = bb->next();
+    if (merge->size() != 2)
+        return nullptr;
+    auto phi = Phi::Cast(merge->at(0));
+    auto ret = Return::Cast(merge->at(1));
+    if (!phi || !ret || ret->arg(0).val() != phi ||
+        call->hasSingleUse() != phi)
+        return nullptr;
+    return phi;
+}
+
+bool TailRecursion::apply(Compiler&, ClosureVersion* cls, Code* code,
+                          LogStream&) const {
+    if (code != cls)
+        return false;
+
+    bool ok = true;
+    std::vector<LdArg*> args;
+    std::vector<StaticCall*> calls;
+    Visitor::run(code->entry, [&](Instruction* i) {
+        // Jumping back out of a context would leave it on the stack
+        if (PushContext::Cast(i))
+            ok = false;
+        if (auto ld = LdArg::Cast(i)) {
+            if (ld->bb() != code->entry)
+                ok = false;
+            args.push_back(ld);
+        }
+        if (i->bb()->isDeopt())
+            return;
+        auto call = StaticCall::Cast(i);
+        if (call && isSelfCall(cls, call)) {
+            // Recursive calls can only reflect if the version itself does
+            if (tailUse(call))
+                calls.push_back(call);
+        } else if (i->effects.contains(Effect::Reflection)) {
+            // The frames of the elided calls must not be observable
+            ok = false;
+        }
+    });
+    if (!ok || calls.empty())
+        return false;
+
+    // The entry only loads the arguments, the rest of the function becomes
+    // the loop. Every iteration starts with a fresh environment.
+    auto entry = code->entry;
+    auto header =
+        BBTransform::split(code->nextBBId++, entry, entry->begin(), code);
+    for (auto ld : args)
+        header->moveToEnd(header->atPosition(ld), entry);
+
+    std::unordered_map<size_t, Phi*> params;
+    for (auto ld : args) {
+        auto& phi = params[ld->id];
+        if (!phi) {
+            phi = new Phi({{entry, ld}});
+            header->insert(header->begin(), phi);
+        }
+        ld->replaceUsesWith(phi, [](Instruction*, size_t) {},
+                            [&](Instruction* i) { return i != phi; });
+    }
+
+    for (auto call : calls) {
+        auto bb = call->bb();
+        auto use = tailUse(call);
+        if (auto ret = Return::Cast(use)) {
+            bb->remove(ret);
+            bb->setNext(header);
+        } else {
+            auto merge = bb->next();
+            Phi::Cast(use)->removeInputs({bb});
+            bb->replaceSuccessor(merge, header);
+        }
+        for (auto& p : params)
+            p.second->addInput(bb, call->callArg(p.first).val());
+        bb->remove(call);
+    }
+
+    for (auto& p : params)
+        p.second->updateTypeAndEffects();
+    return true;
+}
+
+} // namespace pir
+} // namespace rir
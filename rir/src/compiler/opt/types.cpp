@@ -121,6 +121,42 @@ bool TypeInference::apply(Compiler&, ClosureVersion* cls, Code* code,
                         break;
                     }
 
+                    if ("as.character" == name) {
+                        if (!getType(c->callArg(0).val()).maybeObj()) {
+                            inferred = PirType(RType::str);
+                            if (getType(c->callArg(0).val()).isSimpleScalar())
+                                inferred = inferred.simpleScalar();
+                        } else {
+                            inferred = i->inferType(getType);
+                        }
+                        break;
+                    }
+
+                    if ("nchar" == name || "substr" == name ||
+                        "startsWith" == name) {
+                        auto x = getType(c->callArg(0).val());
+                        if (!x.maybeObj()) {
+                            inferred = PirType("nchar" == name ? RType::integer
+                                               : "substr" == name
+                                                   ? RType::str
+                                                   : RType::logical);
+                            // startsWith drops attributes, the others keep
+                            // them
+                            bool scalar = x.isSimpleScalar();
+                            if ("startsWith" == name)
+                                scalar = scalar && getType(c->callArg(1).val())
+                                                       .isSimpleScalar();
+                            else if (x.maybeHasAttrs())
+                                inferred =
+                                    inferred.orAttribsOrObj().notObject();
+                            if (scalar)
+                                inferred = inferred.simpleScalar();
+                        } else {
+                            inferred = i->inferType(getType);
+                        }
+                        break;
+                    }
+
                     if ("typeof" == name) {
                         inferred = PirType(RType::str).simpleScalar();
                         break;
@@ -145,6 +181,17 @@ bool TypeInference::apply(Compiler&, ClosureVersion* cls, Code* code,
                         break;
                     }
 
+                    if ("any" == name || "all" == name) {
+                        auto m = PirType::bottom();
+                        for (size_t i = 0; i < c->nCallArgs(); ++i)
+                            m = m | getType(c->callArg(i).val());
+                        if (!m.maybeObj())
+                            inferred = PirType::simpleScalarLogical();
+                        else
+                            inferred = i->inferType(getType);
+                        break;
+                    }
+
                     static const std::unordered_set<std::string> tests = {
                         "is.vector",   "is.null",      "is.integer",
                         "is.double",   "is.complex",   "is.character",
@@ -153,8 +200,7 @@ bool TypeInference::apply(Compiler&, ClosureVersion* cls, Code* code,
                         "is.raw",      "is.object",    "isS4",
                         "is.numeric",  "is.matrix",    "is.array",
                         "is.atomic",   "is.recursive", "is.call",
-                        "is.language", "is.function",  "all",
-                        "any"};
+                        "is.language", "is.function"};
                     if (tests.count(name)) {
                         if (!getType(c->callArg(0).val()).maybeObj())
                             inferred = PirType(RType::logical)
@@ -0,0 +1,212 @@
+#include "../analysis/available_checkpoints.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/BuiltinIds.h"
+#include "R/r.h"
+#include "compiler/analysis/cfg.h"
+#include "compiler/util/bb_transform.h"
+#include "pass_definitions.h"
+
+#include <functional>
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+typedef FusedVectorOp::Reduction Reduction;
+
+// Leaves are loaded with a fixed element type, so unions are not supported
+static bool isLeaf(Value* v) {
+    return v->type.isA(PirType(RType::real)) ||
+           v->type.isA(PirType(RType::integer)) ||
+           v->type.isA(PirType(RType::logical));
+}
+
+static bool isFusable(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div:
+    case Tag::Pow:
+    case Tag::Minus:
+        if (!i->type.isA(PirType(RType::real)))
+            return false;
+        break;
+    case Tag::Lt:
+    case Tag::Lte:
+    case Tag::Gt:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq:
+        if (!i->type.isA(PirType(RType::logical)))
+            return false;
+        break;
+    default:
+        return false;
+    }
+    return !i->hasEnv() && i->allNonEnvArgs(isLeaf);
+}
+
+static Reduction reductionOf(Instruction* i, Instruction* tree) {
+    auto b = CallSafeBuiltin::Cast(i);
+    if (!b || b->nargs() != 1 || b->arg(0).val() != tree)
+        return Reduction::None;
+    bool real = tree->type.isA(PirType(RType::real));
+    switch (b->builtinId) {
+    case blt("sum"):
+        return Reduction::Sum;
+    case blt("prod"):
+        return real ? Reduction::Prod : Reduction::None;
+    case blt("max"):
+        return real ? Reduction::Max : Reduction::None;
+    case blt("min"):
+        return real ? Reduction::Min : Reduction::None;
+    case blt("any"):
+        return real ? Reduction::None : Reduction::Any;
+    case blt("all"):
+        return real ? Reduction::None : Reduction::All;
+    default: {}
+    }
+    return Reduction::None;
+}
+
+bool VectorFusion::apply(Compiler&, ClosureVersion* cls, Code* code,
+                         LogStream& log) const {
+    AvailableCheckpoints checkpoint(cls, code, log);
+    UsesTree uses(code);
+
+    // A fusable instruction is an inner node of a tree, if its only use is
+    // another node or a reduction in the same BB.
+    auto inner = [&](Instruction* i) {
+        if (!isFusable(i) || uses.at(i).size() != 1)
+            return false;
+        auto user = *uses.at(i).begin();
+        return user->bb() == i->bb() &&
+               (isFusable(user) || reductionOf(user, i) != Reduction::None);
+    };
+
+    struct Tree {
+        Instruction* root;
+        Reduction reduction;
+        Instruction* top;
+        Checkpoint* cp;
+    };
+    std::vector<Tree> trees;
+
+    Visitor::run(code->entry, [&](Instruction* i) {
+        Instruction* top = nullptr;
+        auto reduction = Reduction::None;
+        if (auto b = CallSafeBuiltin::Cast(i)) {
+            if (b->nargs() == 1) {
+                top = Instruction::Cast(b->arg(0).val());
+                if (top && inner(top))
+                    reduction = reductionOf(i, top);
+            }
+            if (reduction == Reduction::None)
+                return;
+        } else if (isFusable(i) && !inner(i)) {
+            top = i;
+        } else {
+            return;
+        }
+        if (auto cp = checkpoint.at(i))
+            trees.push_back({i, reduction, top, cp});
+    });
+
+    bool anyChange = false;
+    for (auto& tree : trees) {
+        auto bb = tree.root->bb();
+
+        std::vector<Value*> leaves;
+        std::vector<FusedVectorOp::Step> program;
+        std::vector<Instruction*> nodes;
+        std::unordered_map<Instruction*, int> steps;
+        std::function<int(Value*)> add = [&](Value* v) {
+            auto i = Instruction::Cast(v);
+            if (i && (i == tree.top || inner(i))) {
+                if (steps.count(i))
+                    return steps.at(i);
+                FusedVectorOp::Step step = {i->tag, add(i->arg(0).val()), 0};
+                if (i->tag != Tag::Minus)
+                    step.rhs = add(i->arg(1).val());
+                program.push_back(step);
+                nodes.push_back(i);
+                return steps[i] = -(int)program.size();
+            }
+            for (size_t l = 0; l < leaves.size(); ++l)
+                if (leaves[l] == v)
+                    return (int)l;
+            leaves.push_back(v);
+            return (int)leaves.size() - 1;
+        };
+        add(tree.top);
+
+        // Without a temporary vector to save, fusion does not pay off
+        if (program.size() < (tree.reduction == Reduction::None ? 2u : 1u))
+            continue;
+        std::vector<Value*> vectors;
+        for (auto l : leaves)
+            if (!l->type.isScalar())
+                vectors.push_back(l);
+        if (vectors.empty())
+            continue;
+
+        PirType type = tree.top->type;
+        switch (tree.reduction) {
+        case Reduction::None:
+            if (type.isScalar())
+                continue;
+            break;
+        case Reduction::Sum:
+            type = tree.top->type.isA(PirType(RType::real))
+                       ? PirType(RType::real).simpleScalar()
+                       : PirType(RType::integer).simpleScalar();
+            break;
+        case Reduction::Prod:
+        case Reduction::Max:
+        case Reduction::Min:
+            type = PirType(RType::real).simpleScalar();
+            break;
+        case Reduction::Any:
+        case Reduction::All:
+            type = PirType::simpleScalarLogical();
+            break;
+        }
+
+        // Deopt to the unfused code if the vectors would be recycled, or if
+        // max and min would warn about an empty argument
+        auto ip = bb->atPosition(tree.root);
+        auto len = new Length(vectors[0]);
+        ip = bb->insert(ip, len) + 1;
+        for (size_t v = 1; v < vectors.size(); ++v) {
+            auto other = new Length(vectors[v]);
+            ip = bb->insert(ip, other) + 1;
+            BBTransform::insertAssume(new Identical(len, other, PirType::val()),
+                                      tree.cp, bb, ip, true, nullptr);
+        }
+        if (tree.reduction == Reduction::Max ||
+            tree.reduction == Reduction::Min) {
+            auto zero = new LdConst(0);
+            ip = bb->insert(ip, zero) + 1;
+            BBTransform::insertAssume(new Identical(len, zero, PirType::val()),
+                                      tree.cp, bb, ip, false, nullptr);
+        }
+
+        auto fused = new FusedVectorOp(type, leaves, program, tree.reduction);
+        ip = bb->insert(ip, fused) + 1;
+        if (tree.root->effects.contains(Effect::Visibility))
+            bb->insert(ip, new Visible());
+        tree.root->replaceUsesWith(fused);
+
+        if (tree.root != tree.top)
+            tree.root->bb()->remove(tree.root);
+        for (auto n = nodes.rbegin(); n != nodes.rend(); ++n)
+            (*n)->bb()->remove(*n);
+        anyChange = true;
+    }
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
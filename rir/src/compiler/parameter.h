@@ -12,7 +12,10 @@ struct Parameter {
     static int DEOPT_CHAOS_SEED;
     static size_t MAX_INPUT_SIZE;
     static unsigned RIR_WARMUP;
+    static unsigned REGION_WARMUP;
+    static unsigned SPLIT_INNER_FEEDBACK;
     static unsigned DEOPT_ABANDON;
+    static unsigned DEOPT_DECAY;
 
     static size_t PROMISE_INLINER_MAX_SIZE;
 
@@ -29,6 +32,9 @@ struct Parameter {
     static unsigned PIR_LLVM_OPT_LEVEL;
 
     static bool ENABLE_PIR2RIR;
+
+    static unsigned PARALLEL_THREADS;
+    static size_t PARALLEL_THRESHOLD;
 };
 } // namespace pir
 } // namespace rir
@@ -150,5 +150,18 @@ Builder::Builder(ClosureVersion* fun, Promise* prom)
     add(ldenv);
     this->env = ldenv;
 }
+
+Builder::Builder(ClosureVersion* fun) : function(fun), code(fun), env(nullptr) {
+    createNextBB();
+    assert(!fun->entry);
+    fun->entry = bb;
+
+    // Create another BB to ensure that the entry BB has no predecessors.
+    createNextBB();
+
+    auto ldenv = new LdFunctionEnv();
+    add(ldenv);
+    this->env = ldenv;
+}
 } // namespace pir
 } // namespace rir
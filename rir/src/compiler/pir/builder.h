@@ -27,6 +27,8 @@ class Builder {
 
     Builder(ClosureVersion* fun, Promise* prom);
     Builder(ClosureVersion* fun, Value* enclos);
+    // For regions, which run in the environment passed by the caller
+    explicit Builder(ClosureVersion* fun);
 
     Value* buildDefaultEnv(ClosureVersion* fun);
 
@@ -1,5 +1,6 @@
 #include "env.h"
 #include "R/Printing.h"
+#include "interpreter/cache.h"
 #include "pir_impl.h"
 
 #include <cassert>
@@ -65,5 +66,29 @@ bool Env::isParentEnv(Value* a, Value* b) {
     }
     return false;
 }
+
+Value* Env::bindingSite(Value* env, SEXP sym) {
+    if (!isStaticEnv(env))
+        return env;
+    auto e = Cast(env);
+    while (e && e->rho && e->rho != R_EmptyEnv) {
+        auto rho = e->rho;
+        if (rho == R_BaseNamespace || rho == R_BaseEnv) {
+            if (SYMVALUE(sym) == R_UnboundValue || IS_ACTIVE_BINDING(sym))
+                return env;
+            return e;
+        }
+        // User databases do not have binding cells
+        if (OBJECT(rho))
+            return env;
+        auto loc = R_findVarLocInFrame(rho, sym);
+        if (!R_VARLOC_IS_NULL(loc))
+            return IS_ACTIVE_BINDING(loc.cell) ? env : e;
+        if (!FRAME_IS_LOCKED(rho))
+            return env;
+        e = e->parent;
+    }
+    return env;
+}
 } // namespace pir
 } // namespace rir
@@ -59,6 +59,12 @@ class Env : public Value {
     static bool isParentEnv(Value* a, Value* b);
     static Value* parentEnv(Value* e);
 
+    // The static env whose frame holds the binding a lookup of sym from env
+    // finds, if none of the frames searched before can gain a binding (they
+    // are all locked). A guard on that binding can read it directly, instead
+    // of repeating the lookup. Returns env otherwise.
+    static Value* bindingSite(Value* env, SEXP sym);
+
     virtual ~Env() {}
 };
 }
@@ -646,6 +646,11 @@ void LdVarSuper::printArgs(std::ostream& out, bool tty) const {
     out << ", ";
 }
 
+void LdDDVar::printArgs(std::ostream& out, bool tty) const {
+    out << CHAR(PRINTNAME(varName));
+    out << ", ";
+}
+
 void MkEnv::printArgs(std::ostream& out, bool tty) const {
     eachLocalVar([&](SEXP name, Value* v, bool miss) {
         out << CHAR(PRINTNAME(name));
@@ -734,6 +739,29 @@ void Phi::printArgs(std::ostream& out, bool tty) const {
     }
 }
 
+void FusedVectorOp::printArgs(std::ostream& out, bool tty) const {
+    static const char* reductions[] = {"",    "sum", "prod", "max",
+                                       "min", "any", "all"};
+    std::function<void(int)> printOperand = [&](int operand) {
+        if (operand >= 0) {
+            arg(operand).val()->printRef(out);
+            return;
+        }
+        auto& step = program.at(-1 - operand);
+        out << tagToStr(step.op) << "(";
+        printOperand(step.lhs);
+        if (step.op != Tag::Minus) {
+            out << ", ";
+            printOperand(step.rhs);
+        }
+        out << ")";
+    };
+    out << reductions[(size_t)reduction];
+    if (reduction != Reduction::None)
+        out << " ";
+    printOperand(-(int)program.size());
+}
+
 void PirCopy::print(std::ostream& out, bool tty) const {
     printPaddedIdTypeRef(out, this);
     arg(0).val()->printRef(out);
@@ -879,7 +907,8 @@ void ScheduledDeopt::consumeFrameStates(Deopt* deopt) {
     assert(!frameStates.back()->inPromise);
     for (auto spi = frameStates.rbegin(); spi != frameStates.rend(); spi++) {
         auto sp = *spi;
-        frames.emplace_back(sp->pc, sp->code, sp->stackSize, sp->inPromise);
+        frames.emplace_back(sp->pc, sp->code, sp->stackSize, sp->inPromise,
+                            sp->callAst, sp->callee);
         for (size_t i = 0; i < sp->stackSize; i++)
             pushArg(sp->arg(i).val());
         pushArg(sp->env());
@@ -1285,6 +1314,29 @@ void Checkpoint::printGraphBranches(std::ostream& out, size_t bbId) const {
 BB* Checkpoint::deoptBranch() { return bb()->falseBranch(); }
 BB* Checkpoint::nextBB() { return bb()->trueBranch(); }
 
+void PushLoopContext::printArgs(std::ostream& out, bool tty) const {
+    FixedLenInstructionWithEnvSlot::printArgs(out, tty);
+    out << " -> BB" << bb()->trueBranch()->id << " (body) | BB"
+        << bb()->falseBranch()->id << " (if break/next)";
+}
+
+void PushLoopContext::printGraphArgs(std::ostream& out, bool tty) const {
+    FixedLenInstructionWithEnvSlot::printArgs(out, tty);
+}
+
+void PushLoopContext::printGraphBranches(std::ostream& out,
+                                         size_t bbId) const {
+    auto trueBB = bb()->trueBranch();
+    auto falseBB = bb()->falseBranch();
+    out << "  BB" << bbId << " -> BB" << trueBB->uid() << ";  // -> BB"
+        << trueBB->id << "\n"
+        << "  BB" << bbId << " -> BB" << falseBB->uid()
+        << " [color=blue];  // -> BB" << falseBB->id << "\n";
+}
+
+BB* PushLoopContext::bodyBB() { return bb()->trueBranch(); }
+BB* PushLoopContext::landingBB() { return bb()->falseBranch(); }
+
 PirType Colon::inferType(const GetType& getType) const {
     auto convertsToInt = [](Value* a) {
         if (a->type.isA(RType::integer))
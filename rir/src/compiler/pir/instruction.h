@@ -142,6 +142,9 @@ enum class VisibilityFlag : uint8_t {
 
 struct TypeFeedback {
     PirType type = PirType::optimistic();
+    // ALTREP vectors were observed, native code should not assume a data
+    // pointer is available
+    bool altrep = false;
     Value* value = nullptr;
     rir::Code* srcCode = nullptr;
     Opcode* origin = nullptr;
@@ -867,12 +870,19 @@ class VLIE(FrameState,
     rir::Code* code;
     size_t stackSize;
     bool inPromise;
+    // For the frame of an inlined closure, the call that was inlined and the
+    // callee if it is static. Deoptimization needs them to synthesize the
+    // context, if the inlinee runs without one.
+    SEXP callAst = R_NilValue;
+    SEXP callee = R_NilValue;
 
     size_t gvnBase() const override {
         return hash_combine(
-            hash_combine(hash_combine(hash_combine(tagHash(), inlined), pc),
-                         code),
-            stackSize);
+            hash_combine(
+                hash_combine(hash_combine(hash_combine(tagHash(), inlined), pc),
+                             code),
+                stackSize),
+            callAst);
     }
 
     FrameState(Value* env, rir::Code* code, Opcode* pc, const RirStack& stack,
@@ -1066,6 +1076,20 @@ class FLIE(LdVarSuper, 1, Effects() | Effect::Error | Effect::ReadsEnv) {
     int minReferenceCount() const override { return 1; }
 };
 
+class FLIE(LdDDVar, 1, Effects() | Effect::Error | Effect::ReadsEnv) {
+  public:
+    LdDDVar(SEXP name, Value* env)
+        : FixedLenInstructionWithEnvSlot(PirType::any(), env), varName(name) {
+        assert(TYPEOF(name) == SYMSXP);
+    }
+
+    SEXP varName;
+
+    void printArgs(std::ostream& out, bool tty) const override;
+
+    int minReferenceCount() const override { return 1; }
+};
+
 class FLIE(StVar, 2, Effects(Effect::WritesEnv) | Effect::LeakArg) {
   public:
     bool isStArg = false;
@@ -1750,6 +1774,43 @@ class FLI(SetNames, 2, Effect::Error) {
     size_t gvnBase() const override { return tagHash(); }
 };
 
+/*
+ * A tree of elementwise arithmetic and comparisons over attribute-free numeric
+ * vectors, optionally folded by a reduction. It is created by the VectorFusion
+ * pass and lowered to a single loop without intermediate vectors. The
+ * arguments are the leaves of the tree, all of the non-scalar ones are guarded
+ * to have the same length.
+ */
+class VLI(FusedVectorOp, Effect::DependsOnAssume) {
+  public:
+    enum class Reduction : uint8_t { None, Sum, Prod, Max, Min, Any, All };
+
+    struct Step {
+        Tag op;
+        // Non-negative operands refer to leaves, negative ones to the result
+        // of step (-1 - operand). Unary minus only uses lhs.
+        int lhs;
+        int rhs;
+    };
+
+    std::vector<Step> program;
+    Reduction reduction;
+
+    FusedVectorOp(PirType type, const std::vector<Value*>& leaves,
+                  const std::vector<Step>& program, Reduction reduction)
+        : VarLenInstruction(type), program(program), reduction(reduction) {
+        for (auto l : leaves)
+            pushArg(l, PirType::val());
+    }
+
+    static bool isRelop(Tag op) {
+        return op == Tag::Lt || op == Tag::Lte || op == Tag::Gt ||
+               op == Tag::Gte || op == Tag::Eq || op == Tag::Neq;
+    }
+
+    void printArgs(std::ostream& out, bool tty) const override;
+};
+
 class FLI(PirCopy, 1, Effects::None()) {
   public:
     explicit PirCopy(Value* v)
@@ -2472,6 +2533,52 @@ class FLI(PopContext, 2, Effect::ChangesContexts) {
     Value* result() const { return arg<0>().val(); }
 };
 
+/*
+ *  Pushes a CTXT_LOOP context for one iteration of a loop, which needs a
+ *  context (see beginloop_). Must be the last instruction of a BB with two
+ *  childs. The first one continues with the loop body, the second one is the
+ *  landing pad for non-local break and next (e.g. from promises).
+ */
+class PushLoopContext
+    : public FixedLenInstructionWithEnvSlot<
+          Tag::PushLoopContext, PushLoopContext, 1,
+          static_cast<Effects::StoreType>(
+              Effects(Effect::ChangesContexts) | Effect::LeaksEnv),
+          HasEnvSlot::Yes, Controlflow::Branch> {
+  public:
+    explicit PushLoopContext(Value* env)
+        : FixedLenInstructionWithEnvSlot(NativeType::context, env) {}
+    void printArgs(std::ostream& out, bool tty) const override;
+    void printGraphArgs(std::ostream& out, bool tty) const override;
+    void printGraphBranches(std::ostream& out, size_t bbId) const override;
+    BB* bodyBB();
+    BB* landingBB();
+};
+
+// First instruction of the landing pad of a loop context. Distinguishes a
+// non-local break (true) from a next (false). Arbitrary code could have run
+// since the loop context was pushed, hence the effects.
+class FLIE(IsLoopBreak, 2, Effects::Any()) {
+  public:
+    IsLoopBreak(PushLoopContext* push, Value* env)
+        : FixedLenInstructionWithEnvSlot(PirType::test(),
+                                         {{NativeType::context}}, {{push}},
+                                         env) {}
+    PushLoopContext* push() const {
+        return PushLoopContext::Cast(arg<0>().val());
+    }
+};
+
+class FLI(PopLoopContext, 1, Effect::ChangesContexts) {
+  public:
+    explicit PopLoopContext(PushLoopContext* push)
+        : FixedLenInstruction(PirType::voyd(), {{NativeType::context}},
+                              {{push}}) {}
+    PushLoopContext* push() const {
+        return PushLoopContext::Cast(arg<0>().val());
+    }
+};
+
 class FLIE(LdDots, 1, Effect::ReadsEnv) {
   public:
     std::vector<SEXP> names;
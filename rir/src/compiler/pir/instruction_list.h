@@ -46,6 +46,7 @@
     V(LdDots)                                                                  \
     V(StVarSuper)                                                              \
     V(LdVarSuper)                                                              \
+    V(LdDDVar)                                                                 \
     V(StVar)                                                                   \
     V(Branch)                                                                  \
     V(Phi)                                                                     \
@@ -75,6 +76,9 @@
     V(MaterializeEnv)                                                          \
     V(PushContext)                                                             \
     V(PopContext)                                                              \
+    V(PushLoopContext)                                                         \
+    V(IsLoopBreak)                                                             \
+    V(PopLoopContext)                                                          \
     V(LdFunctionEnv)                                                           \
     V(LAnd)                                                                    \
     V(LOr)                                                                     \
@@ -99,6 +103,7 @@
     V(Invisible)                                                               \
     V(Names)                                                                   \
     V(SetNames)                                                                \
+    V(FusedVectorOp)                                                           \
     V(PirCopy)                                                                 \
     V(RecordDeoptReason)                                                       \
     V(Nop)
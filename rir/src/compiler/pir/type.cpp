@@ -184,7 +184,7 @@ void PirType::merge(const ObservedValues& other) {
 
     flags_.set(TypeFlags::maybeNAOrNaN);
     for (size_t i = 0; i < other.numTypes; ++i)
-        merge(other.seen[i]);
+        merge(other.seen(i));
 
     if (other.numTypes == ObservedValues::MaxTypes)
         *this = orSexpTypes(any());
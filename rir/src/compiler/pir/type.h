@@ -270,6 +270,10 @@ struct PirType {
         return PirType(RType::real).simpleScalar();
     }
 
+    static constexpr PirType simpleScalarComplex() {
+        return PirType(RType::cplx).simpleScalar();
+    }
+
     static constexpr PirType simpleScalarLogical() {
         return PirType(RType::logical).simpleScalar();
     }
@@ -12,6 +12,7 @@
 #include "compiler/util/arg_match.h"
 #include "compiler/util/visitor.h"
 #include "insert_cast.h"
+#include "interpreter/builtins.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 #include "runtime/ArglistOrder.h"
@@ -51,6 +52,18 @@ struct Matcher {
     }
 };
 
+// Loops which need a context (see beginloop_) get one loop context per
+// iteration. It is pushed as soon as the iteration is done modifying the stack
+// below the loop (e.g. incrementing the index of a for loop), such that a
+// non-local break or next can continue with the stack as it was when entering
+// the loop.
+struct LoopContext {
+    Opcode* header = nullptr; // Non-local next continues here
+    Opcode* exit = nullptr;   // Non-local break continues here
+    size_t stackSize = 0;
+    PushLoopContext* push = nullptr;
+};
+
 struct State {
     bool seen = false;
     BB* entryBB = nullptr;
@@ -60,7 +73,8 @@ struct State {
     State(State&&) = default;
     State(const State&) = delete;
     State(const State& other, bool seen, BB* entryBB, Opcode* entryPC)
-        : seen(seen), entryBB(entryBB), entryPC(entryPC), stack(other.stack){};
+        : seen(seen), entryBB(entryBB), entryPC(entryPC), stack(other.stack),
+          loopContexts(other.loopContexts){};
 
     void operator=(const State&) = delete;
     State& operator=(State&&) = default;
@@ -70,11 +84,13 @@ struct State {
 
     void clear() {
         stack.clear();
+        loopContexts.clear();
         entryBB = nullptr;
         entryPC = nullptr;
     }
 
     RirStack stack;
+    std::vector<LoopContext> loopContexts;
 };
 
 void State::createMergepoint(Builder& insert) {
@@ -90,6 +106,7 @@ void State::createMergepoint(Builder& insert) {
 
 void State::mergeIn(const State& incom, BB* incomBB) {
     assert(stack.size() == incom.stack.size());
+    assert(loopContexts.size() == incom.loopContexts.size());
 
     for (size_t i = 0; i < stack.size(); ++i) {
         Phi* p = Phi::Cast(stack.at(i));
@@ -134,6 +151,89 @@ std::unordered_set<Opcode*> findMergepoints(rir::Code* srcCode) {
     return mergepoints;
 }
 
+// Finds the positions where the contexts of the peeled and the regular
+// iterations of the loop starting at `beginloop` are pushed. Fails if the loop
+// might run arbitrary code before it is done modifying the stack below the
+// loop.
+bool findLoopContextEntries(rir::Code* code, Opcode* beginloop,
+                            LoopContext& loop, std::vector<Opcode*>& entries) {
+    auto noUserCode = [&](BC& bc, Opcode* pc) {
+        if (bc.isPure())
+            return true;
+        switch (bc.bc) {
+        case Opcode::stvar_:
+        case Opcode::stvar_cached_:
+        case Opcode::record_test_:
+        case Opcode::record_type_:
+            return true;
+        // The compiler emits the index arithmetic and the element access of
+        // for loops without an AST, since they cannot dispatch. The same
+        // instructions from user code have one and might run anything.
+        case Opcode::lt_:
+        case Opcode::le_:
+        case Opcode::ne_:
+        case Opcode::add_:
+        case Opcode::extract2_1_:
+            return src_pool_at(globalContext(),
+                               code->getSrcIdxAt(pc, true)) == R_NilValue;
+        default:
+            return false;
+        }
+    };
+
+    loop.exit = BC::jmpTarget(beginloop);
+    assert(*loop.exit == Opcode::endloop_);
+
+    // The last instruction of the loop jumps back to the header
+    auto start = BC::next(beginloop);
+    auto latch = start;
+    while (BC::next(latch) != loop.exit)
+        latch = BC::next(latch);
+    if (*latch != Opcode::br_)
+        return false;
+    loop.header = BC::jmpTarget(latch);
+    if (loop.header < start || loop.header >= loop.exit)
+        return false;
+
+    auto findEntry = [&](Opcode* pc, Opcode* stop) -> Opcode* {
+        auto entry = pc;
+        int height = 0;
+        bool userCode = false;
+        while (pc != stop) {
+            BC bc = BC::decodeShallow(pc);
+            if (bc.isExit())
+                break;
+            int pops = bc.popCount();
+            int pushes = bc.pushCount();
+            if (bc.bc == Opcode::pick_ || bc.bc == Opcode::put_)
+                pops = pushes = bc.immediate.i + 1;
+            if (height < pops) {
+                if (userCode)
+                    return nullptr;
+                entry = BC::next(pc);
+            }
+            height += pushes - pops;
+            userCode = userCode || !noUserCode(bc, pc);
+            if (bc.isJmp() && BC::jmpTarget(pc) != loop.exit)
+                break;
+            pc = BC::next(pc);
+        }
+        return entry;
+    };
+
+    if (start != loop.header) {
+        auto peeled = findEntry(start, loop.header);
+        if (!peeled)
+            return false;
+        entries.push_back(peeled);
+    }
+    auto regular = findEntry(loop.header, loop.exit);
+    if (!regular)
+        return false;
+    entries.push_back(regular);
+    return true;
+}
+
 } // namespace
 
 namespace rir {
@@ -201,7 +301,7 @@ checkCallTarget(Value* callee, rir::Code* srcCode,
     if (feedbackIt != callTargetFeedback.end()) {
         auto& feedback = std::get<ObservedCallees>(feedbackIt->second);
         result.taken = feedback.taken;
-        if (result.taken > 1) {
+        if (result.taken > 1 && !feedback.invalid) {
             if (feedback.numTargets == 1) {
                 result.monomorphic = feedback.getTarget(srcCode, 0);
                 result.stableEnv = true;
@@ -245,8 +345,8 @@ static Value* insertLdFunGuard(const TargetInfo& trg, Value* callee,
     // deopt unneccessarily. In the case of `c` this is guaranteed to
     // cause problems, since many variables are called "c". Therefore if
     // we have seen any variable c we keep the ldfun in this case.
-    // TODO: Implement this with a dependency on the binding cell
-    // instead of an eager check.
+    // Lookups through locked frames, e.g. from a namespace, read the binding
+    // where it was found (see Env::bindingSite).
     auto bb = cp->nextBB();
     auto pos = bb->begin();
 
@@ -254,7 +354,8 @@ static Value* insertLdFunGuard(const TargetInfo& trg, Value* callee,
     if (replaceLdfunWithLdVar) {
         auto ldfun = LdFun::Cast(callee);
         assert(ldfun);
-        auto ldvar = new LdVar(ldfun->varName, ldfun->env());
+        auto ldvar = new LdVar(ldfun->varName,
+                               Env::bindingSite(ldfun->env(), ldfun->varName));
         pos = bb->insert(pos, ldvar);
         pos++;
         calleeForGuard = ldvar;
@@ -389,6 +490,15 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         break;
     }
 
+    case Opcode::ldddvar_: {
+        auto ld = insert(new LdDDVar(bc.immediateConst(), env));
+        auto fs = inlining() ? (Value*)Tombstone::framestate()
+                             : insert.registerFrameState(srcCode, nextPos,
+                                                         stack, inPromise());
+        push(insert(new Force(ld, env, fs)));
+        break;
+    }
+
     case Opcode::stvar_:
     case Opcode::stvar_cached_:
         if (bc.immediateConst() == symbol::c)
@@ -527,6 +637,8 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
                 }
                 // TODO: deal with multiple locations
                 i->typeFeedback.type.merge(feedback);
+                i->typeFeedback.altrep =
+                    i->typeFeedback.altrep || feedback.altrep;
                 i->typeFeedback.srcCode = srcCode;
                 i->typeFeedback.origin = pos;
                 if (auto force = Force::Cast(i)) {
@@ -643,6 +755,10 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
 
         bool monomorphicClosure =
             ti.monomorphic && isValidClosureSEXP(ti.monomorphic);
+        // The interpreter runs tryCatch and friends without their closures,
+        // compiling a static call to them would bypass that
+        if (monomorphicClosure && supportsFastHandlerCall(ti.monomorphic))
+            monomorphicClosure = false;
         bool monomorphicInnerFunction = monomorphicClosure && !ti.stableEnv;
         bool monomorphicBuiltin = ti.monomorphic &&
                                   TYPEOF(ti.monomorphic) == BUILTINSXP &&
@@ -1180,6 +1296,10 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     case Opcode::clear_binding_cache_:
         break;
 
+    // The loop context was already popped when jumping here
+    case Opcode::endloop_:
+        break;
+
     // Currently unused opcodes:
     case Opcode::push_code_:
 
@@ -1193,13 +1313,11 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     case Opcode::br_:
     case Opcode::ret_:
     case Opcode::return_:
+    case Opcode::beginloop_:
         assert(false);
 
     // Unsupported opcodes:
     case Opcode::asast_:
-    case Opcode::beginloop_:
-    case Opcode::endloop_:
-    case Opcode::ldddvar_:
         log.unsupportedBC("Unsupported BC", bc);
         return false;
     }
@@ -1225,6 +1343,19 @@ bool Rir2Pir::tryCompile(rir::Code* srcCode, Builder& insert) {
     return false;
 }
 
+bool Rir2Pir::tryCompileRegion(Opcode* start, Opcode* end, size_t stackSize,
+                               Builder& insert) {
+    Region region = {start, end, {}};
+    for (size_t i = 0; i < stackSize; ++i)
+        region.stack.push_back(insert(new LdArg(i)));
+    if (auto res = tryTranslate(cls->owner()->rirFunction()->body(), insert,
+                                &region)) {
+        finalize(res, insert);
+        return true;
+    }
+    return false;
+}
+
 bool Rir2Pir::tryCompilePromise(rir::Code* prom, Builder& insert) {
     return PromiseRir2Pir(compiler, cls, log, name, outerFeedback, false)
         .tryCompile(prom, insert);
@@ -1235,7 +1366,8 @@ Value* Rir2Pir::tryInlinePromise(rir::Code* srcCode, Builder& insert) {
         .tryTranslate(srcCode, insert);
 }
 
-Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
+Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert,
+                             const Region* region) {
     assert(!finalized);
 
     CallTargetFeedback callTargetFeedback;
@@ -1245,12 +1377,19 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
     for (auto p : findMergepoints(srcCode))
         mergepoints.emplace(p, State());
 
+    std::unordered_map<Opcode*, LoopContext> loopContextEntries;
+
     std::deque<State> worklist;
     State cur;
     cur.seen = true;
 
     Opcode* end = srcCode->endCode();
     Opcode* finger = srcCode->code();
+    if (region) {
+        finger = region->start;
+        for (auto v : region->stack)
+            cur.stack.push(v);
+    }
 
     auto popWorklist = [&]() {
         assert(!worklist.empty());
@@ -1269,6 +1408,14 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
             finger = popWorklist();
         assert(finger != end);
 
+        // Leaving an iteration of a loop with context
+        while (!cur.loopContexts.empty() &&
+               (finger == cur.loopContexts.back().header ||
+                finger == cur.loopContexts.back().exit)) {
+            insert(new PopLoopContext(cur.loopContexts.back().push));
+            cur.loopContexts.pop_back();
+        }
+
         if (mergepoints.count(finger)) {
             State& other = mergepoints.at(finger);
             if (other.seen) {
@@ -1282,6 +1429,44 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
             cur.createMergepoint(insert);
             other = State(cur, true, insert.getCurrentBB(), finger);
         }
+
+        // Leaving the region, the interpreter continues from here
+        if (region && finger == region->end) {
+            assert(cur.stack.empty());
+            results.push_back(
+                ReturnSite(insert.getCurrentBB(), Nil::instance()));
+            finger = end;
+            continue;
+        }
+
+        // Entering an iteration of a loop with context
+        auto loopEntry = loopContextEntries.find(finger);
+        if (loopEntry != loopContextEntries.end()) {
+            auto loop = loopEntry->second;
+            loop.push = insert(new PushLoopContext(insert.env));
+            BB* body = insert.createBB();
+            BB* landing = insert.createBB();
+            insert.setBranch(body, landing);
+
+            insert.enterBB(landing);
+            auto isBreak = insert(new IsLoopBreak(loop.push, insert.env));
+            insert(new PopLoopContext(loop.push));
+            insert(new Branch(isBreak));
+            BB* onBreak = insert.createBB();
+            BB* onNext = insert.createBB();
+            insert.setBranch(onBreak, onNext);
+            for (auto target : {std::make_pair(onBreak, loop.exit),
+                                std::make_pair(onNext, loop.header)}) {
+                State landed(cur, false, target.first, target.second);
+                while (landed.stack.size() > loop.stackSize)
+                    landed.stack.pop();
+                worklist.push_back(std::move(landed));
+            }
+
+            insert.enterBB(body);
+            cur.loopContexts.push_back(loop);
+        }
+
         const auto pos = finger;
         BC bc = BC::advance(&finger, srcCode);
         const auto nextPos = finger;
@@ -1294,6 +1479,26 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
                 continue;
             }
 
+            if (bc.bc == Opcode::beginloop_) {
+                if (inPromise()) {
+                    log.warn("Cannot compile Promise. Unsupported beginloop bc");
+                    return nullptr;
+                }
+                LoopContext loop;
+                std::vector<Opcode*> entries;
+                if (!findLoopContextEntries(srcCode, pos, loop, entries)) {
+                    log.warn("Cannot compile Function. Unsupported loop with "
+                             "context");
+                    return nullptr;
+                }
+                loop.stackSize = cur.stack.size();
+                for (auto e : entries)
+                    loopContextEntries[e] = loop;
+                // Non-local breaks and regular exits merge after the loop
+                mergepoints.emplace(trg, State());
+                continue;
+            }
+
             bool swapTrueFalse = false;
             Instruction* deoptCondition = nullptr;
             Value* branchCondition;
@@ -1327,9 +1532,6 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
                 insert(new Branch(v));
                 break;
             }
-            case Opcode::beginloop_:
-                log.warn("Cannot compile Function. Unsupported beginloop bc");
-                return nullptr;
             default:
                 assert(false);
             }
@@ -1400,6 +1602,11 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
         }
 
         if (bc.isExit()) {
+            while (!cur.loopContexts.empty()) {
+                insert(new PopLoopContext(cur.loopContexts.back().push));
+                cur.loopContexts.pop_back();
+            }
+
             Value* tos;
             bool localReturn = true;
             switch (bc.bc) {
@@ -1411,7 +1618,7 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
                 // return. Therefore we can treat it as normal local return
                 // instruction. We just need to make sure to empty the stack.
                 tos = cur.stack.pop();
-                if (inPromise()) {
+                if (inPromise() || region) {
                     insert(new NonLocalReturn(tos, insert.env));
                     localReturn = false;
                 }
@@ -6,6 +6,7 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace rir {
 namespace pir {
@@ -21,6 +22,11 @@ class Rir2Pir {
 
     bool tryCompile(Builder& insert) __attribute__((warn_unused_result));
 
+    // Compiles a region of the closure body (see CodeRegions). The stack at
+    // start is passed in as arguments.
+    bool tryCompileRegion(Opcode* start, Opcode* end, size_t stackSize,
+                          Builder& insert) __attribute__((warn_unused_result));
+
     Value* tryCreateArg(rir::Code* prom, Builder& insert, bool eager)
         __attribute__((warn_unused_result));
 
@@ -39,7 +45,14 @@ class Rir2Pir {
     bool tryCompilePromise(rir::Code* prom, Builder& insert)
         __attribute__((warn_unused_result));
 
-    Value* tryTranslate(rir::Code* srcCode, Builder& insert)
+    struct Region {
+        Opcode* start;
+        Opcode* end;
+        std::vector<Value*> stack;
+    };
+
+    Value* tryTranslate(rir::Code* srcCode, Builder& insert,
+                        const Region* region = nullptr)
         __attribute__((warn_unused_result));
 
     void finalize(Value*, Builder& insert);
@@ -1,6 +1,9 @@
 #include "PirCheck.h"
 #include "../../ir/Compiler.h"
+#include "../analysis/loop_detection.h"
+#include "../analysis/ownership.h"
 #include "../analysis/query.h"
+#include "../analysis/reference_count.h"
 #include "../analysis/verifier.h"
 #include "../pir/pir_impl.h"
 #include "../util/visitor.h"
@@ -228,6 +231,44 @@ static bool testAnAddIsNotNAOrNaN(ClosureVersion* f) {
     return success;
 }
 
+// There is a subassign in a loop, and all of them update in place
+static bool testNoDuplicateInLoop(ClosureVersion* f) {
+    SimpleLogStream log;
+    StaticReferenceCount refcount(f, f, log);
+    refcount();
+    VectorOwnership ownership(f, refcount.getGlobalState());
+    bool found = false;
+    bool success = true;
+    LoopDetection loops(f);
+    for (auto& loop : loops) {
+        loop.check([&](Instruction* i) {
+            if (Subassign1_1D::Cast(i) || Subassign2_1D::Cast(i)) {
+                found = true;
+                if (!ownership.owned(i))
+                    success = false;
+            }
+            return true;
+        });
+    }
+    return found && success;
+}
+
+static bool testOneFusedVectorOp(ClosureVersion* f) {
+    int numFused = 0;
+    Visitor::run(f->entry, [&](Instruction* i) {
+        if (FusedVectorOp::Cast(i))
+            numFused++;
+    });
+    return numFused == 1;
+}
+
+static bool testNoSelfCall(ClosureVersion* f) {
+    return Visitor::check(f->entry, [&](Instruction* i) {
+        auto call = StaticCall::Cast(i);
+        return !call || call->tryDispatch() != f;
+    });
+}
+
 PirCheck::Type PirCheck::parseType(const char* str) {
 #define V(Check)                                                               \
     if (strcmp(str, #Check) == 0)                                              \
@@ -29,7 +29,10 @@ namespace rir {
     V(LazyCallArgs)                                                            \
     V(EagerCallArgs)                                                           \
     V(LdVarVectorInFirstBB)                                                    \
-    V(AnAddIsNotNAOrNaN)
+    V(AnAddIsNotNAOrNaN)                                                       \
+    V(NoDuplicateInLoop)                                                       \
+    V(OneFusedVectorOp)                                                        \
+    V(NoSelfCall)
 
 struct PirCheck {
     enum class Type : unsigned {
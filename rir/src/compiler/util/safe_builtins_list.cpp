@@ -311,16 +311,22 @@ bool SafeBuiltinsList::nonObject(int builtin) {
 
         blt("cumsum"),
         blt("colSums"),
+        blt("rowSums"),
+        blt("t.default"),
 
         blt("paste"),
         blt("nchar"),
+        blt("substr"),
+        blt("startsWith"),
         blt("pmatch"),
 
         blt("seq.int"),
         blt("rep.int"),
 
         blt("inherits"),
-        blt("anyNA")
+        blt("anyNA"),
+        blt("any"),
+        blt("all")
     };
 
     for (auto i : safeBuiltins)
@@ -446,13 +452,13 @@ bool SafeBuiltinsList::nonObjectIdempotent(int builtin) {
         blt("is.function"), blt("is.na"), blt("is.nan"), blt("is.finite"),
         blt("is.infinite"),
 
-        blt("cumsum"), blt("colSums"),
+        blt("cumsum"), blt("colSums"), blt("rowSums"), blt("t.default"),
 
         blt("match"),
 
         blt("seq.int"), blt("rep.int"),
 
-        blt("inherits"), blt("anyNA")};
+        blt("inherits"), blt("anyNA"), blt("any"), blt("all")};
 
     for (auto i : safeBuiltins)
         if (i == builtin)
@@ -480,18 +486,23 @@ bool SafeBuiltinsList::nonObjectIdempotent(SEXP builtin) {
     V(sys.parent)                                                              \
     V(sys.function)                                                            \
     V(sys.frame)                                                               \
-    V(sys.call)                                                                \
-    V(parent.frame)                                                            \
     V(UseMethod)                                                               \
     V(eval)                                                                    \
     V(topenv)                                                                  \
     V(pos.to.env)                                                              \
     V(standardGeneric)
 
+// Those only read the call and the caller from the context of the function
+// calling them. Both are known for inlined frames, even if the context is only
+// synthesized on deoptimization.
+#define CONTEXT_BUILTINS_FOR_INLINE(V)                                         \
+    V(sys.call)                                                                \
+    V(parent.frame)
+
 bool SafeBuiltinsList::forInline(int builtin) {
     static int unsafeBuiltins[] = {
 #define V(name) blt(#name),
-        UNSAFE_BUILTINS_FOR_INLINE(V)
+        UNSAFE_BUILTINS_FOR_INLINE(V) CONTEXT_BUILTINS_FOR_INLINE(V)
 #undef V
     };
 
@@ -514,6 +525,19 @@ bool SafeBuiltinsList::forInlineByName(SEXP name) {
     return true;
 }
 
+bool SafeBuiltinsList::forInlineWithContext(SEXP name) {
+    static SEXP contextBuiltins[] = {
+#define V(name) Rf_install(#name),
+        CONTEXT_BUILTINS_FOR_INLINE(V)
+#undef V
+    };
+
+    for (auto i : contextBuiltins)
+        if (i == name)
+            return true;
+    return false;
+}
+
 bool SafeBuiltinsList::assumeStableInBaseEnv(SEXP name) {
     return R_BindingIsLocked(name, R_BaseEnv) &&
            !R_BindingIsActive(name, R_BaseEnv);
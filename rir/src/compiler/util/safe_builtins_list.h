@@ -19,6 +19,7 @@ class SafeBuiltinsList {
     static bool nonObjectIdempotent(int builtin);
     static bool forInline(int builtin);
     static bool forInlineByName(SEXP name);
+    static bool forInlineWithContext(SEXP name);
     static bool assumeStableInBaseEnv(SEXP name);
 };
 
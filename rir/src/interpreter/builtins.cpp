@@ -1,13 +1,23 @@
 #include "builtins.h"
 #include "R/BuiltinIds.h"
 #include "R/Funtab.h"
+#include "R/Symbols.h"
 #include "interp.h"
 #include "runtime/LazyArglist.h"
+#include <R_ext/Rdynload.h>
 #include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 extern "C" {
 extern Rboolean R_Visible;
+extern SEXP Rf_NewEnvironment(SEXP, SEXP, SEXP);
+const char* R_curErrorBuf();
+SEXP R_data_class(SEXP, Rboolean);
+SEXP R_execMethod(SEXP, SEXP);
 }
 
 namespace rir {
@@ -198,28 +208,260 @@ SEXP tryFastSpecialCall(const CallContext& call, InterpreterInstance* ctx) {
     return nullptr;
 }
 
-SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
-    SLOWASSERT(!call.hasNames());
+namespace {
+// Methods of S4 generics by the classes of the dispatched arguments. Entries
+// point to the binding cell of the method in the methods table of the
+// generic, thus they see methods being replaced. Methods removed from the
+// table, e.g. the inherited ones when a new method is set, leave the cell
+// unbound and a new table gives a different key.
+class S4DispatchCache {
+  public:
+    static constexpr size_t MAXARGS = 4;
+
+    SEXP get(SEXP mtable, const SEXP* classes, size_t n) const {
+        auto& e = entries[slot(mtable, classes, n)];
+        if (e.mtable != mtable || e.n != n)
+            return nullptr;
+        for (size_t i = 0; i < n; ++i)
+            if (e.classes[i] != classes[i])
+                return nullptr;
+        return e.cell;
+    }
 
-    static constexpr size_t MAXARGS = 8;
-    SEXP args[MAXARGS];
-    auto nargs = call.suppliedArgs;
+    void set(SEXP mtable, const SEXP* classes, size_t n, SEXP cell) {
+        // The keys are kept alive, such that their addresses are not reused
+        auto s = store();
+        auto keep = Rf_allocVector(VECSXP, n + 2);
+        SET_VECTOR_ELT(keep, 0, mtable);
+        SET_VECTOR_ELT(keep, 1, cell);
+        auto i = slot(mtable, classes, n);
+        auto& e = entries[i];
+        e.mtable = mtable;
+        e.n = n;
+        e.cell = cell;
+        for (size_t j = 0; j < n; ++j) {
+            SET_VECTOR_ELT(keep, j + 2, classes[j]);
+            e.classes[j] = classes[j];
+        }
+        SET_VECTOR_ELT(s, i, keep);
+    }
+
+  private:
+    static constexpr size_t SIZE = 128;
+
+    struct Entry {
+        SEXP mtable = nullptr;
+        SEXP classes[MAXARGS];
+        size_t n = 0;
+        SEXP cell = nullptr;
+    };
+    Entry entries[SIZE];
+
+    static size_t slot(SEXP mtable, const SEXP* classes, size_t n) {
+        auto h = reinterpret_cast<uintptr_t>(mtable);
+        for (size_t i = 0; i < n; ++i)
+            h = h * 31 + reinterpret_cast<uintptr_t>(classes[i]);
+        return (h >> 4) % SIZE;
+    }
+
+    static SEXP store() {
+        static SEXP s = [] {
+            auto v = Rf_allocVector(VECSXP, SIZE);
+            R_PreserveObject(v);
+            return v;
+        }();
+        return s;
+    }
+};
+} // namespace
+
+// R_loadMethod of the methods package, for methods with only the usual
+// attributes. Binds them in the frame the method is called from.
+static bool loadS4Method(SEXP method, SEXP ev) {
+    for (auto a = ATTRIB(method); a != R_NilValue; a = CDR(a)) {
+        auto t = TAG(a);
+        if (t != R_ClassSymbol && t != symbol::targetAttr &&
+            t != symbol::definedAttr && t != symbol::nextMethodAttr &&
+            t != R_SrcrefSymbol && t != symbol::generic)
+            return false;
+    }
+    for (auto a = ATTRIB(method); a != R_NilValue; a = CDR(a)) {
+        auto t = TAG(a);
+        if (t == symbol::targetAttr)
+            Rf_defineVar(symbol::dotTarget, CAR(a), ev);
+        else if (t == symbol::definedAttr)
+            Rf_defineVar(symbol::dotDefined, CAR(a), ev);
+        else if (t == symbol::nextMethodAttr)
+            Rf_defineVar(symbol::dotNextMethod, CAR(a), ev);
+    }
+    Rf_defineVar(symbol::dotMethod, method, ev);
+    return true;
+}
+
+// The methods package installs R_dispatchGeneric as standardGeneric when its
+// table dispatch is on. Anything else, e.g. no dispatch at all or the old
+// R_standardGeneric, is left to R.
+static bool tableDispatchOn() {
+    static R_stdGen_ptr_t dispatchGeneric = nullptr;
+    auto current = R_get_standardGeneric_ptr();
+    if (!current)
+        return false;
+    if (!dispatchGeneric)
+        dispatchGeneric = (R_stdGen_ptr_t)R_FindSymbol("R_dispatchGeneric",
+                                                       "methods", nullptr);
+    return current == dispatchGeneric;
+}
 
-    if (nargs > MAXARGS)
+// R_data_class(arg, TRUE) without allocating the result vector, i.e. the first
+// class, or the implicit class of the type. Arrays and calls are left to R.
+static SEXP dispatchClass(SEXP arg) {
+    auto klass = Rf_getAttrib(arg, R_ClassSymbol);
+    if (TYPEOF(klass) == STRSXP && XLENGTH(klass) > 0)
+        return STRING_ELT(klass, 0);
+    if (Rf_getAttrib(arg, R_DimSymbol) != R_NilValue)
         return nullptr;
+    static SEXP function = [] {
+        auto c = Rf_mkChar("function");
+        R_PreserveObject(c);
+        return c;
+    }();
+    static SEXP numeric = [] {
+        auto c = Rf_mkChar("numeric");
+        R_PreserveObject(c);
+        return c;
+    }();
+    static SEXP name = [] {
+        auto c = Rf_mkChar("name");
+        R_PreserveObject(c);
+        return c;
+    }();
+    switch (TYPEOF(arg)) {
+    case CLOSXP:
+    case SPECIALSXP:
+    case BUILTINSXP:
+        return function;
+    case REALSXP:
+        return numeric;
+    case SYMSXP:
+        return name;
+    case LANGSXP:
+        return nullptr;
+    default:
+        return Rf_type2str(TYPEOF(arg));
+    }
+}
 
-    bool hasAttrib = false;
-    for (size_t i = 0; i < call.suppliedArgs; ++i) {
-        auto arg = call.stackArg(i);
-        if (TYPEOF(arg) == PROMSXP)
-            arg = evaluatePromise(arg);
-        if (arg == R_UnboundValue || arg == R_MissingArg)
+// standardGeneric called from the body of its generic, as the table dispatch
+// of the methods package (R_dispatchGeneric) does it, but finding the method
+// in S4DispatchCache instead of building the signature label. Methods which
+// are not yet in the table, e.g. inherited ones, and anything unusual go to R.
+static SEXP fastStandardGeneric(const CallContext& call, SEXP fname) {
+    if (TYPEOF(fname) != STRSXP || XLENGTH(fname) != 1 ||
+        STRING_ELT(fname, 0) == NA_STRING)
+        return nullptr;
+    auto ev = call.callerEnv;
+    if (TYPEOF(ev) != ENVSXP || !tableDispatchOn())
+        return nullptr;
+
+    SEXP fdef = nullptr;
+    for (RCNTXT* cptr = (RCNTXT*)R_GlobalContext; cptr != NULL;
+         cptr = cptr->nextcontext) {
+        if ((cptr->callflag & CTXT_FUNCTION) && cptr->cloenv == ev) {
+            fdef = cptr->callfun;
+            break;
+        }
+    }
+    if (!fdef || TYPEOF(fdef) != CLOSXP || !OBJECT(fdef))
+        return nullptr;
+    auto generic = Rf_getAttrib(fdef, symbol::generic);
+    if (TYPEOF(generic) != STRSXP || XLENGTH(generic) < 1 ||
+        STRING_ELT(generic, 0) != STRING_ELT(fname, 0))
+        return nullptr;
+
+    auto fenv = CLOENV(fdef);
+    auto mtable = Rf_findVarInFrame(fenv, symbol::AllMTable);
+    auto sigargs = Rf_findVarInFrame(fenv, symbol::SigArgs);
+    auto siglength = Rf_findVarInFrame(fenv, symbol::SigLength);
+    if (TYPEOF(mtable) != ENVSXP || TYPEOF(sigargs) != VECSXP ||
+        siglength == R_UnboundValue)
+        return nullptr;
+    auto n = Rf_asInteger(siglength);
+    if (n < 1 || (size_t)n > S4DispatchCache::MAXARGS ||
+        n > XLENGTH(sigargs))
+        return nullptr;
+
+    static SEXP missing = [] {
+        auto m = Rf_mkChar("missing");
+        R_PreserveObject(m);
+        return m;
+    }();
+    // The classes are CHARSXPs, which are interned and kept alive by the
+    // arguments or the preserved constants
+    SEXP classes[S4DispatchCache::MAXARGS];
+    for (int i = 0; i < n; ++i) {
+        auto sym = VECTOR_ELT(sigargs, i);
+        if (TYPEOF(sym) != SYMSXP || sym == R_DotsSymbol)
             return nullptr;
-        if (ATTRIB(arg) != R_NilValue)
-            hasAttrib = true;
-        args[i] = arg;
+        auto loc = R_findVarLocInFrame(ev, sym);
+        if (R_VARLOC_IS_NULL(loc))
+            return nullptr;
+        if (R_GetVarLocMISSING(loc)) {
+            classes[i] = missing;
+            continue;
+        }
+        // Usually the argument was already forced by an earlier dispatch
+        // or by the caller, only pending promises are evaluated
+        auto arg = R_GetVarLocValue(loc);
+        if (TYPEOF(arg) == PROMSXP && PRVALUE(arg) != R_UnboundValue) {
+            arg = PRVALUE(arg);
+        } else if (TYPEOF(arg) == PROMSXP || arg == R_MissingArg) {
+            // The argument is forced now, so R would not see an error again
+            int err;
+            arg = R_tryEvalSilent(sym, ev, &err);
+            if (err)
+                Rf_error("error in evaluating the argument '%s' in selecting "
+                         "a method for function '%s': %s",
+                         CHAR(PRINTNAME(sym)), CHAR(STRING_ELT(fname, 0)),
+                         R_curErrorBuf());
+        }
+        classes[i] = dispatchClass(arg);
+        if (!classes[i])
+            return nullptr;
+    }
+
+    static S4DispatchCache cache;
+    auto cell = cache.get(mtable, classes, n);
+    if (!cell || TYPEOF(CAR(cell)) != CLOSXP) {
+        std::string label;
+        for (int i = 0; i < n; ++i) {
+            if (i > 0)
+                label.push_back('#');
+            label.append(CHAR(classes[i]));
+        }
+        auto loc = R_findVarLocInFrame(mtable, Rf_install(label.c_str()));
+        if (R_VARLOC_IS_NULL(loc) || TYPEOF(CAR(loc.cell)) != CLOSXP)
+            return nullptr;
+        cell = loc.cell;
+        cache.set(mtable, classes, n, cell);
     }
 
+    auto method = CAR(cell);
+    if (Rf_inherits(method, "internalDispatchMethod") ||
+        (IS_S4_OBJECT(method) && !loadS4Method(method, ev)))
+        return nullptr;
+    PROTECT(method);
+    auto res = R_execMethod(method, ev);
+    UNPROTECT(1);
+    return res;
+}
+
+static constexpr size_t MAXFASTARGS = 8;
+
+// The fast builtins on the evaluated, positional arguments. naRm is the na.rm
+// argument of the summary builtins, which is only ever passed by name.
+static SEXP fastBuiltinCall(const CallContext& call, const SEXP* args,
+                            size_t nargs, bool hasAttrib, bool naRm,
+                            InterpreterInstance* ctx) {
     switch (call.callee->u.primsxp.offset) {
     case blt("is.logical"): {
         if (nargs != 1)
@@ -248,6 +490,12 @@ SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
     case blt("baseenv"): {
         return R_BaseEnv;
     }
+
+    case blt("standardGeneric"): {
+        if (nargs != 1)
+            return nullptr;
+        return fastStandardGeneric(call, args[0]);
+    }
     }
 
     if (hasAttrib)
@@ -471,32 +719,47 @@ SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
 
         auto combination = (TYPEOF(args[0]) << 8) + TYPEOF(args[1]);
 
-#define CMP(a, b) ((call.callee->u.primsxp.offset == 301) ? a < b : b < a)
+// True if b replaces a, ties keep the first argument as in GNU R
+#define CMP(a, b)                                                              \
+    ((call.callee->u.primsxp.offset == blt("min")) ? b < a : a < b)
 
+        // Without na.rm any NA makes the result NA, otherwise a NaN makes it
+        // NaN. Integer NAs become NA_real_ when mixed with doubles.
         switch (combination) {
         case (INTSXP << 8) + INTSXP:
             if (*INTEGER(a) == NA_INTEGER || *INTEGER(b) == NA_INTEGER)
                 return nullptr;
-            return CMP(*INTEGER(a), *INTEGER(b)) ? a : b;
+            return CMP(*INTEGER(a), *INTEGER(b)) ? b : a;
 
         case (INTSXP << 8) + REALSXP:
-            if (ISNAN(*REAL(b)))
-                return b;
+            if (naRm && (ISNAN(*REAL(b)) || *INTEGER(a) == NA_INTEGER))
+                return nullptr;
             if (*INTEGER(a) == NA_INTEGER)
                 return ScalarReal(NA_REAL);
-            return CMP(*INTEGER(a), *REAL(b)) ? ScalarReal(*INTEGER(a)) : b;
+            if (ISNAN(*REAL(b)))
+                return b;
+            return CMP(*INTEGER(a), *REAL(b)) ? b : ScalarReal(*INTEGER(a));
 
         case (REALSXP << 8) + INTSXP:
-            if (ISNAN(*REAL(a)))
-                return a;
+            if (naRm && (ISNAN(*REAL(a)) || *INTEGER(b) == NA_INTEGER))
+                return nullptr;
             if (*INTEGER(b) == NA_INTEGER)
                 return ScalarReal(NA_REAL);
-            return CMP(*REAL(a), *INTEGER(b)) ? a : ScalarReal(*INTEGER(b));
+            if (ISNAN(*REAL(a)))
+                return a;
+            return CMP(*REAL(a), *INTEGER(b)) ? ScalarReal(*INTEGER(b)) : a;
 
         case (REALSXP << 8) + REALSXP:
-            if (ISNAN(*REAL(a)) || ISNAN(*REAL(b)))
-                return a;
-            return CMP(*REAL(a), *REAL(b)) ? a : b;
+            if (ISNAN(*REAL(a)) || ISNAN(*REAL(b))) {
+                if (naRm)
+                    return nullptr;
+                if (R_IsNA(*REAL(a)))
+                    return a;
+                if (R_IsNA(*REAL(b)))
+                    return b;
+                return ISNAN(*REAL(a)) ? a : b;
+            }
+            return CMP(*REAL(a), *REAL(b)) ? b : a;
 
         default:
             return nullptr;
@@ -505,9 +768,47 @@ SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
 #undef CMP
     }
 
+    case blt("sum"): {
+        if (nargs != 1 || ALTREP(args[0]))
+            return nullptr;
+        auto x = args[0];
+        auto n = XLENGTH(x);
+        switch (TYPEOF(x)) {
+        case LGLSXP:
+        case INTSXP: {
+            auto px = TYPEOF(x) == INTSXP ? INTEGER(x) : LOGICAL(x);
+            int64_t s = 0;
+            for (R_xlen_t i = 0; i < n; ++i) {
+                if (px[i] != NA_INTEGER)
+                    s += px[i];
+                else if (!naRm)
+                    return ScalarInteger(NA_INTEGER);
+            }
+            // R warns about the overflow
+            if (s > INT_MAX || s < -INT_MAX)
+                return nullptr;
+            return ScalarInteger(s);
+        }
+        case REALSXP: {
+            auto px = REAL(x);
+            long double s = 0.0;
+            for (R_xlen_t i = 0; i < n; ++i)
+                if (!naRm || !ISNAN(px[i]))
+                    s += px[i];
+            if (s > DBL_MAX)
+                return ScalarReal(R_PosInf);
+            if (s < -DBL_MAX)
+                return ScalarReal(R_NegInf);
+            return ScalarReal(s);
+        }
+        default:
+            return nullptr;
+        }
+    }
+
     case blt("all"): {
         for (size_t i = 0; i < nargs; ++i) {
-            auto a = args[0];
+            auto a = args[i];
             if (IS_SIMPLE_SCALAR(a, LGLSXP)) {
                 if (LOGICAL(a)[0] == 0)
                     return R_FalseValue;
@@ -521,7 +822,7 @@ SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
 
     case blt("any"): {
         for (size_t i = 0; i < nargs; ++i) {
-            auto a = args[0];
+            auto a = args[i];
             if (IS_SIMPLE_SCALAR(a, LGLSXP)) {
                 if (LOGICAL(a)[0] == 1)
                     return R_TrueValue;
@@ -865,10 +1166,279 @@ SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
             return nullptr;
         return getAttrib(args[0], R_DimNamesSymbol);
     }
+
+    // The string builtins below only handle ASCII strings, where characters,
+    // bytes and display width agree and no translation is needed.
+
+    case blt("nchar"): {
+        // .Internal(nchar(x, type, allowNA, keepNA))
+        if (nargs != 4 || hasAttrib || TYPEOF(args[0]) != STRSXP ||
+            !IS_SIMPLE_SCALAR(args[1], STRSXP) ||
+            !IS_SIMPLE_SCALAR(args[3], LGLSXP))
+            return nullptr;
+        auto type = CHAR(STRING_ELT(args[1], 0));
+        bool bytes = strcmp(type, "bytes") == 0;
+        if (!bytes && strcmp(type, "chars") != 0 && strcmp(type, "width") != 0)
+            return nullptr;
+        auto x = args[0];
+        auto n = XLENGTH(x);
+        if (!bytes)
+            for (R_xlen_t i = 0; i < n; ++i) {
+                auto s = STRING_ELT(x, i);
+                if (s != NA_STRING && !IS_ASCII(s))
+                    return nullptr;
+            }
+        // As in do_nchar, keepNA = NA means NA for chars and bytes, and 2
+        // (the width of "NA") for width
+        auto keepNA = LOGICAL(args[3])[0];
+        bool width = strcmp(type, "width") == 0;
+        bool naIsNA = keepNA == NA_LOGICAL ? !width : keepNA;
+        auto res = Rf_allocVector(INTSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i) {
+            auto s = STRING_ELT(x, i);
+            if (s == NA_STRING)
+                INTEGER(res)[i] = naIsNA ? NA_INTEGER : 2;
+            else
+                INTEGER(res)[i] = LENGTH(s);
+        }
+        return res;
+    }
+
+    case blt("startsWith"): {
+        if (nargs != 2 || hasAttrib || TYPEOF(args[0]) != STRSXP ||
+            !IS_SIMPLE_SCALAR(args[1], STRSXP))
+            return nullptr;
+        auto x = args[0];
+        auto prefix = STRING_ELT(args[1], 0);
+        auto n = XLENGTH(x);
+        if (prefix != NA_STRING && !IS_ASCII(prefix))
+            return nullptr;
+        for (R_xlen_t i = 0; i < n; ++i) {
+            auto s = STRING_ELT(x, i);
+            if (s != NA_STRING && !IS_ASCII(s))
+                return nullptr;
+        }
+        auto res = Rf_allocVector(LGLSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i) {
+            auto s = STRING_ELT(x, i);
+            if (s == NA_STRING || prefix == NA_STRING)
+                LOGICAL(res)[i] = NA_LOGICAL;
+            else
+                LOGICAL(res)[i] =
+                    LENGTH(s) >= LENGTH(prefix) &&
+                    strncmp(CHAR(s), CHAR(prefix), LENGTH(prefix)) == 0;
+        }
+        return res;
+    }
+
+    case blt("substr"): {
+        // .Internal(substr(x, as.integer(start), as.integer(stop)))
+        if (nargs != 3 || hasAttrib || TYPEOF(args[0]) != STRSXP ||
+            TYPEOF(args[1]) != INTSXP || TYPEOF(args[2]) != INTSXP)
+            return nullptr;
+        auto x = args[0];
+        auto n = XLENGTH(x);
+        auto nstart = XLENGTH(args[1]);
+        auto nstop = XLENGTH(args[2]);
+        if (n > 0 && (nstart == 0 || nstop == 0))
+            return nullptr;
+        for (R_xlen_t i = 0; i < n; ++i) {
+            auto s = STRING_ELT(x, i);
+            if (s != NA_STRING && !IS_ASCII(s))
+                return nullptr;
+        }
+        auto res = PROTECT(Rf_allocVector(STRSXP, n));
+        for (R_xlen_t i = 0; i < n; ++i) {
+            auto s = STRING_ELT(x, i);
+            int start = INTEGER(args[1])[i % nstart];
+            int stop = INTEGER(args[2])[i % nstop];
+            if (s == NA_STRING || start == NA_INTEGER || stop == NA_INTEGER) {
+                SET_STRING_ELT(res, i, NA_STRING);
+                continue;
+            }
+            int len = LENGTH(s);
+            if (start < 1)
+                start = 1;
+            if (stop > len)
+                stop = len;
+            if (start > stop)
+                SET_STRING_ELT(res, i, R_BlankString);
+            else if (start == 1 && stop == len)
+                SET_STRING_ELT(res, i, s);
+            else
+                SET_STRING_ELT(res, i,
+                               Rf_mkCharLenCE(CHAR(s) + start - 1,
+                                              stop - start + 1, CE_NATIVE));
+        }
+        UNPROTECT(1);
+        return res;
+    }
+
+    case blt("paste0"): {
+        // .Internal(paste0(list(...), collapse, recycle0)) of strings and
+        // integers, without collapse
+        if (nargs != 3 || TYPEOF(args[0]) != VECSXP || args[1] != R_NilValue)
+            return nullptr;
+        auto parts = args[0];
+        auto nparts = XLENGTH(parts);
+        if (nparts == 0)
+            return nullptr;
+        R_xlen_t n = 0;
+        for (R_xlen_t j = 0; j < nparts; ++j) {
+            auto e = VECTOR_ELT(parts, j);
+            if (ATTRIB(e) != R_NilValue)
+                return nullptr;
+            if (TYPEOF(e) == STRSXP) {
+                for (R_xlen_t i = 0; i < XLENGTH(e); ++i) {
+                    auto s = STRING_ELT(e, i);
+                    if (s != NA_STRING && !IS_ASCII(s))
+                        return nullptr;
+                }
+            } else if (TYPEOF(e) != INTSXP) {
+                return nullptr;
+            }
+            // zero-length arguments depend on recycle0
+            if (XLENGTH(e) == 0)
+                return nullptr;
+            n = std::max(n, XLENGTH(e));
+        }
+        auto res = PROTECT(Rf_allocVector(STRSXP, n));
+        std::string buf;
+        char num[16];
+        for (R_xlen_t i = 0; i < n; ++i) {
+            buf.clear();
+            for (R_xlen_t j = 0; j < nparts; ++j) {
+                auto e = VECTOR_ELT(parts, j);
+                auto k = i % XLENGTH(e);
+                if (TYPEOF(e) == STRSXP) {
+                    auto s = STRING_ELT(e, k);
+                    if (s == NA_STRING)
+                        buf.append("NA");
+                    else
+                        buf.append(CHAR(s), LENGTH(s));
+                } else if (INTEGER(e)[k] == NA_INTEGER) {
+                    buf.append("NA");
+                } else {
+                    snprintf(num, sizeof(num), "%d", INTEGER(e)[k]);
+                    buf.append(num);
+                }
+            }
+            SET_STRING_ELT(res, i,
+                           Rf_mkCharLenCE(buf.data(), buf.size(), CE_NATIVE));
+        }
+        UNPROTECT(1);
+        return res;
+    }
     }
     return nullptr;
 }
 
+SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx) {
+    SLOWASSERT(!call.hasNames());
+
+    SEXP args[MAXFASTARGS];
+    auto nargs = call.suppliedArgs;
+
+    if (nargs > MAXFASTARGS)
+        return nullptr;
+
+    bool hasAttrib = false;
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        auto arg = call.stackArg(i);
+        if (TYPEOF(arg) == PROMSXP)
+            arg = evaluatePromise(arg);
+        if (arg == R_UnboundValue || arg == R_MissingArg)
+            return nullptr;
+        if (ATTRIB(arg) != R_NilValue)
+            hasAttrib = true;
+        args[i] = arg;
+    }
+
+    return fastBuiltinCall(call, args, nargs, hasAttrib, false, ctx);
+}
+
+namespace {
+// How the fast builtins match named arguments. Primitives do not match
+// arguments to formals, each checks the names it cares about itself.
+enum class NamedArgs {
+    // Not supported with names
+    None,
+    // The summaries take na.rm by its exact name and ignore all other names
+    NaRm,
+    // A single argument named by a prefix of x, as checked by check1arg
+    X,
+};
+} // namespace
+
+static NamedArgs namedArgs(SEXP b) {
+    switch (b->u.primsxp.offset) {
+    case blt("sum"):
+    case blt("min"):
+    case blt("max"):
+    case blt("all"):
+    case blt("any"):
+        return NamedArgs::NaRm;
+    case blt("length"):
+    case blt("abs"):
+    case blt("dim"):
+    case blt("is.logical"):
+    case blt("is.symbol"):
+    case blt("is.expression"):
+    case blt("is.object"):
+    case blt("is.numeric"):
+    case blt("is.matrix"):
+    case blt("is.array"):
+    case blt("is.atomic"):
+    case blt("is.call"):
+    case blt("is.function"):
+    case blt("is.na"):
+        return NamedArgs::X;
+    default: {}
+    }
+    return NamedArgs::None;
+}
+
+SEXP tryFastNamedBuiltinCall(const CallContext& call,
+                             InterpreterInstance* ctx) {
+    SLOWASSERT(call.hasNames());
+
+    auto kind = namedArgs(call.callee);
+    if (kind == NamedArgs::None || call.suppliedArgs > MAXFASTARGS)
+        return nullptr;
+
+    // Names the builtin rejects are left to R for the error
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        auto name = call.name(i, ctx);
+        if (kind == NamedArgs::X && name != R_NilValue &&
+            *CHAR(PRINTNAME(name)) && strcmp(CHAR(PRINTNAME(name)), "x") != 0)
+            return nullptr;
+    }
+
+    SEXP args[MAXFASTARGS];
+    size_t nargs = 0;
+    bool hasAttrib = false;
+    bool naRm = false;
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        auto arg = call.stackArg(i);
+        if (TYPEOF(arg) == PROMSXP)
+            arg = evaluatePromise(arg);
+        if (arg == R_UnboundValue || arg == R_MissingArg)
+            return nullptr;
+        if (kind == NamedArgs::NaRm && call.name(i, ctx) == R_NaRmSymbol) {
+            if (!IS_SIMPLE_SCALAR(arg, LGLSXP) ||
+                LOGICAL(arg)[0] == NA_LOGICAL)
+                return nullptr;
+            naRm = LOGICAL(arg)[0];
+            continue;
+        }
+        if (ATTRIB(arg) != R_NilValue)
+            hasAttrib = true;
+        args[nargs++] = arg;
+    }
+
+    return fastBuiltinCall(call, args, nargs, hasAttrib, naRm, ctx);
+}
+
 bool supportsFastBuiltinCall(SEXP b) {
     switch (b->u.primsxp.offset) {
     case blt("nargs"):
@@ -879,6 +1449,7 @@ bool supportsFastBuiltinCall(SEXP b) {
     case blt("abs"):
     case blt("min"):
     case blt("max"):
+    case blt("sum"):
     case blt("as.character"):
     case blt("as.integer"):
     case blt("stdin"):
@@ -911,10 +1482,366 @@ bool supportsFastBuiltinCall(SEXP b) {
     case blt("col"):
     case blt("row"):
     case blt("dim"):
+    case blt("nchar"):
+    case blt("startsWith"):
+    case blt("substr"):
+    case blt("paste0"):
         return true;
     default: {}
     }
     return false;
 }
 
+static SEXP baseTryCatch() {
+    static SEXP f = Rf_findFun(symbol::tryCatch, R_BaseNamespace);
+    return f;
+}
+
+static SEXP baseTry() {
+    static SEXP f = Rf_findFun(Rf_install("try"), R_BaseNamespace);
+    return f;
+}
+
+static SEXP baseWithCallingHandlers() {
+    static SEXP f =
+        Rf_findFun(Rf_install("withCallingHandlers"), R_BaseNamespace);
+    return f;
+}
+
+bool supportsFastHandlerCall(SEXP fun) {
+    return fun == baseTryCatch() || fun == baseTry() ||
+           fun == baseWithCallingHandlers();
+}
+
+namespace {
+// The arguments as passed to the call, expr stays a promise. Calls with more
+// arguments are left to R, such that nothing here needs a destructor when an
+// error unwinds the fast paths.
+struct SuppliedArgs {
+    SEXP values[MAXFASTARGS];
+    SEXP names[MAXFASTARGS];
+    size_t size = 0;
+
+    bool named(size_t i) const {
+        return names[i] != R_NilValue && *CHAR(PRINTNAME(names[i]));
+    }
+    // Would be matched to the expr formal (partially) by R
+    bool matchesExpr(size_t i) const {
+        if (!named(i))
+            return false;
+        auto n = CHAR(PRINTNAME(names[i]));
+        return strncmp(n, "expr", strlen(n)) == 0;
+    }
+};
+} // namespace
+
+static bool suppliedArgs(const CallContext& call, InterpreterInstance* ctx,
+                         SuppliedArgs& args) {
+    if (call.givenContext.includes(Assumption::StaticallyArgmatched))
+        return false;
+    if (call.arglist) {
+        for (auto a = call.arglist; a != R_NilValue; a = CDR(a)) {
+            if (args.size == MAXFASTARGS)
+                return false;
+            args.values[args.size] = CAR(a);
+            args.names[args.size++] = TAG(a);
+        }
+    } else if (call.stackArgs && call.passedArgs == call.suppliedArgs &&
+               call.suppliedArgs <= MAXFASTARGS) {
+        for (unsigned i = 0; i < call.suppliedArgs; ++i) {
+            args.values[args.size] = call.stackArg(i);
+            args.names[args.size++] =
+                call.hasNames() ? call.name(i, ctx) : R_NilValue;
+        }
+    } else {
+        return false;
+    }
+    for (size_t i = 0; i < args.size; ++i) {
+        auto v = args.values[i];
+        if (v == R_DotsSymbol || v == R_MissingArg || TYPEOF(v) == DOTSXP)
+            return false;
+    }
+    return true;
+}
+
+static SEXP forceArg(SEXP arg, InterpreterInstance* ctx) {
+    return TYPEOF(arg) == PROMSXP ? evaluatePromise(arg, ctx) : arg;
+}
+
+// Forces expr in a function context of its own, with the handlers pushed on
+// R's handler stack. The context takes the place of the frames the R version
+// creates. Exiting handlers jump back to it, result is then the result vector
+// of .addCondHands: the condition, its call and the handler.
+static bool evalWithHandlers(SEXP ast, SEXP expr, SEXP classes, SEXP handlers,
+                             bool calling, const CallContext& call,
+                             InterpreterInstance* ctx, SEXP& result) {
+    static SEXP addCondHands = getBuiltinFun(".addCondHands");
+    auto target = PROTECT(
+        Rf_NewEnvironment(R_NilValue, R_NilValue, CLOENV(call.callee)));
+    auto args = PROTECT(Rf_list5(classes, handlers, call.callerEnv,
+                                 calling ? R_NilValue : target,
+                                 calling ? R_TrueValue : R_FalseValue));
+
+    RCNTXT cntxt;
+    Rf_begincontext(&cntxt, CTXT_FUNCTION, ast, target, call.callerEnv,
+                    R_NilValue, call.callee);
+    bool caught;
+    if (SETJMP(cntxt.cjmpbuf)) {
+        caught = true;
+        result = R_ReturnedValue;
+    } else {
+        caught = false;
+        getBuiltin(addCondHands)(ast, addCondHands, args, call.callerEnv);
+        R_Visible = (Rboolean) true;
+        result = forceArg(expr, ctx);
+    }
+    PROTECT(result);
+    // Also restores the handler stack
+    cntxt.returnValue = result;
+    Rf_endcontext(&cntxt);
+    R_ReturnedValue = R_NilValue;
+    UNPROTECT(3);
+    return caught;
+}
+
+// Calls the handler which caught a condition, from the result vector of
+// evalWithHandlers. Errors signalled from C only store the message, the
+// condition object is created here, after the jump, like R does.
+static SEXP callExitingHandler(SEXP result, SEXP env) {
+    static SEXP simpleError =
+        Rf_findFun(Rf_install("simpleError"), R_BaseNamespace);
+    auto cond = VECTOR_ELT(result, 0);
+    if (cond == R_NilValue) {
+        auto msg = PROTECT(Rf_mkString(R_curErrorBuf()));
+        auto call = PROTECT(Rf_lang2(symbol::quote, VECTOR_ELT(result, 1)));
+        auto mk = PROTECT(Rf_lang3(simpleError, msg, call));
+        cond = Rf_eval(mk, R_BaseEnv);
+        UNPROTECT(3);
+    }
+    PROTECT(cond);
+    auto handlerCall = PROTECT(Rf_lang2(VECTOR_ELT(result, 2), cond));
+    auto res = Rf_eval(handlerCall, env);
+    UNPROTECT(2);
+    return res;
+}
+
+// The call R reports for conditions signalled directly in the expr of
+// tryCatch, and of try which calls tryCatch
+static SEXP doTryCatch() {
+    static SEXP ast = [] {
+        auto ast = Rf_lang5(Rf_install("doTryCatch"),
+                            Rf_lang2(Rf_install("return"), symbol::expr),
+                            Rf_install("name"), Rf_install("parentenv"),
+                            Rf_install("handler"));
+        R_PreserveObject(ast);
+        return ast;
+    }();
+    return ast;
+}
+
+// tryCatch(expr, class = handler) with at most one handler. R nests the
+// handlers of a call with several, such that a condition signalled by one
+// handler is caught by the next, those calls and finally clauses are left to
+// R.
+static SEXP fastTryCatch(const CallContext& call, InterpreterInstance* ctx) {
+    SuppliedArgs args;
+    if (!suppliedArgs(call, ctx, args))
+        return nullptr;
+    SEXP expr = nullptr, cls = nullptr, handler = nullptr;
+    for (size_t i = 0; i < args.size; ++i) {
+        if (!args.named(i) || args.names[i] == symbol::expr) {
+            if (expr)
+                return nullptr;
+            expr = args.values[i];
+        } else if (args.matchesExpr(i) || args.names[i] == symbol::finally ||
+                   handler) {
+            return nullptr;
+        } else {
+            cls = args.names[i];
+            handler = args.values[i];
+        }
+    }
+    if (!expr)
+        return nullptr;
+
+    SEXP classes = R_NilValue, handlers = R_NilValue;
+    if (handler) {
+        handler = PROTECT(forceArg(handler, ctx));
+        classes = PROTECT(Rf_mkString(CHAR(PRINTNAME(cls))));
+        handlers = PROTECT(Rf_allocVector(VECSXP, 1));
+        SET_VECTOR_ELT(handlers, 0, handler);
+    }
+    SEXP result;
+    auto caught = evalWithHandlers(doTryCatch(), expr, classes, handlers,
+                                   false, call, ctx, result);
+    PROTECT(result);
+    if (caught)
+        result = callExitingHandler(result, call.callerEnv);
+    UNPROTECT(handler ? 4 : 1);
+    return result;
+}
+
+static SEXP tryCallSym() {
+    static SEXP sym = Rf_install(".rirTryCall");
+    return sym;
+}
+
+// For conditions signalled directly in expr, the handler of try reports the
+// call of try, which it finds as sys.call(-4L) in the frames of tryCatch.
+// Those frames do not exist here, the call is replaced by a variable which is
+// bound to the call of try.
+static bool replaceTryCall(SEXP ast) {
+    bool found = false;
+    for (auto e = ast; TYPEOF(e) == LANGSXP || TYPEOF(e) == LISTSXP;
+         e = CDR(e)) {
+        auto a = CAR(e);
+        if (TYPEOF(a) != LANGSXP)
+            continue;
+        auto which = Rf_length(a) == 2 ? CADR(a) : R_NilValue;
+        if (CAR(a) == Rf_install("sys.call") &&
+            (IS_SIMPLE_SCALAR(which, INTSXP) ||
+             IS_SIMPLE_SCALAR(which, REALSXP)) &&
+            Rf_asInteger(which) == -4) {
+            SETCAR(e, tryCallSym());
+            found = true;
+        } else if (replaceTryCall(a)) {
+            found = true;
+        }
+    }
+    return found;
+}
+
+// try is tryCatch(expr, error = function(e) ...) where the handler refers to
+// the silent and outFile arguments. It is instantiated from the source of try,
+// in a frame with just those two and the call of try.
+static SEXP fastTry(const CallContext& call, InterpreterInstance* ctx) {
+    static SEXP handlerAst = []() -> SEXP {
+        auto body = BODY_EXPR(baseTry());
+        if (TYPEOF(body) != LANGSXP || CAR(body) != symbol::tryCatch ||
+            Rf_length(body) != 3 || TAG(CDDR(body)) != Rf_install("error") ||
+            TYPEOF(CADDR(body)) != LANGSXP ||
+            CAR(CADDR(body)) != symbol::Function)
+            return nullptr;
+        auto ast = Rf_duplicate(CADDR(body));
+        R_PreserveObject(ast);
+        return replaceTryCall(ast) ? ast : nullptr;
+    }();
+    if (!handlerAst)
+        return nullptr;
+
+    SuppliedArgs args;
+    if (!suppliedArgs(call, ctx, args))
+        return nullptr;
+    // Exact names or positions only, R would also match partially
+    auto formals = FORMALS(baseTry());
+    size_t nformals = Rf_length(formals);
+    if (nformals > MAXFASTARGS)
+        return nullptr;
+    SEXP matched[MAXFASTARGS] = {};
+    auto position = [&](SEXP name) {
+        size_t pos = 0;
+        for (auto f = formals; f != R_NilValue; f = CDR(f), pos++)
+            if (TAG(f) == name)
+                return pos;
+        return nformals;
+    };
+    for (size_t i = 0; i < args.size; ++i) {
+        if (!args.named(i))
+            continue;
+        auto pos = position(args.names[i]);
+        if (pos == nformals || matched[pos])
+            return nullptr;
+        matched[pos] = args.values[i];
+    }
+    size_t next = 0;
+    for (size_t i = 0; i < args.size; ++i) {
+        if (args.named(i))
+            continue;
+        while (next < nformals && matched[next])
+            next++;
+        if (next == nformals)
+            return nullptr;
+        matched[next] = args.values[i];
+    }
+    if (!matched[0])
+        return nullptr;
+
+    auto frame = PROTECT(
+        Rf_NewEnvironment(R_NilValue, R_NilValue, CLOENV(baseTry())));
+    size_t pos = 0;
+    for (auto f = formals; f != R_NilValue; f = CDR(f), pos++) {
+        if (pos == 0)
+            continue;
+        if (matched[pos]) {
+            Rf_defineVar(TAG(f), matched[pos], frame);
+        } else if (CAR(f) != R_MissingArg) {
+            auto prom = PROTECT(Rf_mkPROMISE(CAR(f), frame));
+            Rf_defineVar(TAG(f), prom, frame);
+            UNPROTECT(1);
+        }
+    }
+    Rf_defineVar(tryCallSym(), call.ast, frame);
+    auto handlers = PROTECT(Rf_allocVector(VECSXP, 1));
+    SET_VECTOR_ELT(handlers, 0, Rf_eval(handlerAst, frame));
+    auto classes = PROTECT(Rf_mkString("error"));
+
+    SEXP result;
+    auto caught = evalWithHandlers(doTryCatch(), matched[0], classes, handlers,
+                                   false, call, ctx, result);
+    PROTECT(result);
+    if (caught)
+        result = callExitingHandler(result, call.callerEnv);
+    UNPROTECT(4);
+    return result;
+}
+
+static SEXP fastWithCallingHandlers(const CallContext& call,
+                                    InterpreterInstance* ctx) {
+    SuppliedArgs args;
+    if (!suppliedArgs(call, ctx, args))
+        return nullptr;
+    SEXP expr = nullptr;
+    size_t exprPos = 0, n = 0;
+    for (size_t i = 0; i < args.size; ++i) {
+        if (!args.named(i) || args.names[i] == symbol::expr) {
+            if (expr)
+                return nullptr;
+            expr = args.values[i];
+            exprPos = i;
+        } else if (args.matchesExpr(i)) {
+            return nullptr;
+        } else {
+            n++;
+        }
+    }
+    if (!expr)
+        return nullptr;
+
+    // R forces all handlers before expr
+    auto classes = PROTECT(Rf_allocVector(STRSXP, n));
+    auto handlers = PROTECT(Rf_allocVector(VECSXP, n));
+    n = 0;
+    for (size_t i = 0; i < args.size; ++i) {
+        if (i == exprPos)
+            continue;
+        SET_STRING_ELT(classes, n, PRINTNAME(args.names[i]));
+        SET_VECTOR_ELT(handlers, n++, forceArg(args.values[i], ctx));
+    }
+    SEXP result;
+    evalWithHandlers(call.ast, expr, classes, handlers, true, call, ctx,
+                     result);
+    UNPROTECT(2);
+    return result;
+}
+
+SEXP tryFastHandlerCall(const CallContext& call, InterpreterInstance* ctx) {
+    if (call.callee == baseTryCatch())
+        return fastTryCatch(call, ctx);
+    if (call.callee == baseTry())
+        return fastTry(call, ctx);
+    if (call.callee == baseWithCallingHandlers())
+        return fastWithCallingHandlers(call, ctx);
+    return nullptr;
+}
+
 } // namespace rir
@@ -7,8 +7,33 @@ namespace rir {
 
 SEXP tryFastSpecialCall(const CallContext& call, InterpreterInstance* ctx);
 SEXP tryFastBuiltinCall(const CallContext& call, InterpreterInstance* ctx);
+// The fast builtins for calls with names, which are matched statically the way
+// each builtin matches them. Takes the arguments from the stack, no arglist is
+// created. Returns nullptr for builtins or names it does not support.
+SEXP tryFastNamedBuiltinCall(const CallContext& call,
+                             InterpreterInstance* ctx);
 bool supportsFastBuiltinCall(SEXP blt);
 
+// tryCatch, try and withCallingHandlers of base without the helper closures,
+// contexts and promises R sets up on every call. The handlers are pushed on
+// R's handler stack around forcing expr in one context. Returns nullptr for
+// calls that need the R version, e.g. with a finally clause.
+SEXP tryFastHandlerCall(const CallContext& call, InterpreterInstance* ctx);
+bool supportsFastHandlerCall(SEXP fun);
+
+// Equality of two CHARSXPs, as `==` on strings. CHARSXPs are interned, so
+// equal strings in the same encoding are the same object and ASCII strings
+// never need to be translated.
+inline int charsxpEq(SEXP a, SEXP b) {
+    if (a == NA_STRING || b == NA_STRING)
+        return NA_LOGICAL;
+    if (a == b)
+        return 1;
+    if (IS_ASCII(a) && IS_ASCII(b))
+        return 0;
+    return Rf_Seql(a, b);
+}
+
 } // namespace rir
 
 #endif
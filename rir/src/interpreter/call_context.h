@@ -65,6 +65,9 @@ struct CallContext {
     const SEXP callee;
     Context givenContext;
     SEXP arglist = nullptr;
+    // If the arguments were matched to the formals at runtime, this is the
+    // matched list of arguments, while arglist is the original one.
+    SEXP matchedArglist = nullptr;
 
     bool hasEagerCallee() const { return TYPEOF(callee) == BUILTINSXP; }
     bool hasNames() const { return names; }
@@ -47,6 +47,9 @@ InterpreterInstance* context_create() {
         return rirCompile(closure, R_NilValue);
     };
     c->closureOptimizer = [](SEXP f, const Context&, SEXP n) { return f; };
+    c->regionOptimizer = [](SEXP f, Opcode*, Opcode*, size_t) -> Function* {
+        return nullptr;
+    };
 
     if (pir && std::string(pir).compare("off") == 0) {
         // do nothing; use defaults
@@ -62,6 +65,7 @@ InterpreterInstance* context_create() {
         };
     } else {
         c->closureOptimizer = rirOptDefaultOpts;
+        c->regionOptimizer = rirOptRegionDefaultOpts;
     }
 
     return c;
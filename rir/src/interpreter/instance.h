@@ -27,6 +27,9 @@ typedef std::function<SEXP(SEXP closure, SEXP name)> ClosureCompiler;
 typedef std::function<SEXP(SEXP closure, const rir::Context& assumptions,
                            SEXP name)>
     ClosureOptimizer;
+typedef std::function<Function*(SEXP closure, Opcode* start, Opcode* end,
+                                size_t stackSize)>
+    RegionOptimizer;
 
 #define POOL_CAPACITY 4096
 #define STACK_CAPACITY 4096
@@ -62,6 +65,7 @@ struct InterpreterInstance {
     ExprCompiler exprCompiler;
     ClosureCompiler closureCompiler;
     ClosureOptimizer closureOptimizer;
+    RegionOptimizer regionOptimizer;
 };
 
 // TODO we might actually need to do more for the lengths (i.e. true length vs
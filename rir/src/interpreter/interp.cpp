@@ -6,6 +6,7 @@
 #include "compiler/compiler.h"
 #include "compiler/parameter.h"
 #include "ir/Deoptimization.h"
+#include "runtime/CodeRegions.h"
 #include "runtime/LazyArglist.h"
 #include "runtime/LazyEnvironment.h"
 #include "runtime/TypeFeedback_inl.h"
@@ -14,10 +15,12 @@
 #include "utils/measuring.h"
 
 #include <assert.h>
+#include <cstring>
 #include <deque>
 #include <libintl.h>
 #include <set>
 #include <unordered_set>
+#include <vector>
 
 #define NOT_IMPLEMENTED assert(false)
 
@@ -210,8 +213,8 @@ SEXP evaluatePromise(SEXP e, InterpreterInstance* ctx, Opcode* pc) {
         prstack.promise = e;
         prstack.next = R_PendingPromises;
         R_PendingPromises = &prstack;
-        val = evalRirCode(Code::unpack(PRCODE(e)), ctx, e->u.promsxp.env,
-                          nullptr, pc, nullptr);
+        val = evalRirCode(Code::unpack(PRCODE(e))->compiled(), ctx,
+                          e->u.promsxp.env, nullptr, pc, nullptr);
         R_PendingPromises = prstack.next;
         SET_PRSEEN(e, 0);
         SET_PRVALUE(e, val);
@@ -233,6 +236,108 @@ void jit(SEXP cls, SEXP name, InterpreterInstance* ctx) {
     SET_BODY(cls, BODY(cmp));
 }
 
+unsigned pir::Parameter::SPLIT_INNER_FEEDBACK =
+    getenv("PIR_SPLIT_INNER_FEEDBACK")
+        ? atoi(getenv("PIR_SPLIT_INNER_FEEDBACK"))
+        : 0;
+
+// Split instances of each function literal. A list of weak references keyed
+// on the shared dispatch table. Their values are vectors of weak references
+// from closure environments to instances.
+static const int MAX_INNER_INSTANCES = 8;
+static SEXP innerInstances(SEXP body) {
+    static SEXP holder = [] {
+        auto h = Rf_cons(R_NilValue, R_NilValue);
+        R_PreserveObject(h);
+        return h;
+    }();
+    SEXP prev = R_NilValue;
+    for (auto l = CAR(holder); l != R_NilValue; l = CDR(l)) {
+        auto key = R_WeakRefKey(CAR(l));
+        if (key == body)
+            return R_WeakRefValue(CAR(l));
+        if (key == R_NilValue) {
+            if (prev == R_NilValue)
+                SETCAR(holder, CDR(l));
+            else
+                SETCDR(prev, CDR(l));
+            continue;
+        }
+        prev = l;
+    }
+    auto instances = PROTECT(Rf_allocVector(VECSXP, MAX_INNER_INSTANCES));
+    auto ref = PROTECT(R_MakeWeakRef(body, instances, R_NilValue, FALSE));
+    SETCAR(holder, Rf_cons(ref, CAR(holder)));
+    UNPROTECT(2);
+    return instances;
+}
+
+// All closures created from one function literal share the dispatch table,
+// and thus the feedback. Once it is megamorphic, new closures get their own
+// copy of the function with fresh feedback, such that the instances can be
+// specialized separately. Closures created in the same environment share an
+// instance. At most MAX_INNER_INSTANCES are live per literal, later closures
+// share the original function again.
+SEXP innerFunctionInstance(SEXP body, SEXP formals, SEXP env,
+                           InterpreterInstance* ctx) {
+    auto baseline = DispatchTable::unpack(body)->baseline();
+    if (!baseline->flags.contains(Function::SplitFeedback) ||
+        TYPEOF(env) != ENVSXP)
+        return body;
+
+    auto instances = PROTECT(innerInstances(body));
+    // Slots whose environment was collected are reused
+    R_xlen_t free = -1;
+    for (R_xlen_t i = 0; i < XLENGTH(instances); ++i) {
+        auto ref = VECTOR_ELT(instances, i);
+        if (ref == R_NilValue) {
+            if (free == -1)
+                free = i;
+            break;
+        }
+        auto key = R_WeakRefKey(ref);
+        if (key == env) {
+            UNPROTECT(1);
+            return R_WeakRefValue(ref);
+        }
+        if (key == R_NilValue && free == -1)
+            free = i;
+    }
+    if (free == -1) {
+        UNPROTECT(1);
+        return body;
+    }
+
+    auto ast = src_pool_at(ctx, baseline->body()->src);
+    SEXP cls = Rf_allocSExp(CLOSXP);
+    PROTECT(cls);
+    SET_FORMALS(cls, formals);
+    SET_BODY(cls, ast);
+    SET_CLOENV(cls, env);
+    jit(cls, R_NilValue, ctx);
+    auto instance = BODY(cls);
+    if (!DispatchTable::check(instance)) {
+        UNPROTECT(2);
+        return body;
+    }
+    auto fun = DispatchTable::unpack(instance)->baseline();
+    fun->flags.set(Function::InnerFunction);
+    fun->inheritFlags(baseline);
+    SET_VECTOR_ELT(instances, free,
+                   R_MakeWeakRef(env, instance, R_NilValue, FALSE));
+    UNPROTECT(2);
+    return instance;
+}
+
+static void checkSplitFeedback(Function* fun) {
+    auto n = fun->invocationCount();
+    if (n < pir::Parameter::SPLIT_INNER_FEEDBACK || (n & (n - 1)) != 0 ||
+        fun->flags.contains(Function::SplitFeedback))
+        return;
+    if (fun->body()->hasMegamorphicFeedback())
+        fun->flags.set(Function::SplitFeedback);
+}
+
 static void closureDebug(SEXP call, SEXP op, SEXP rho, SEXP newrho,
                          RCNTXT* cntxt) {
     // TODO!!!
@@ -576,6 +681,7 @@ void recordDeoptReason(SEXP val, const DeoptReason& reason) {
     case DeoptReason::Typecheck: {
         assert(*pos == Opcode::record_type_);
         ObservedValues* feedback = (ObservedValues*)(pos + 1);
+        ObservedValues before = *feedback;
         feedback->record(val);
         if (TYPEOF(val) == PROMSXP) {
             if (PRVALUE(val) == R_UnboundValue &&
@@ -586,13 +692,22 @@ void recordDeoptReason(SEXP val, const DeoptReason& reason) {
                 feedback->stateBeforeLastForce =
                     ObservedValues::evaluatedPromise;
         }
+        // The failing check is not expressible in the feedback. Blacklist the
+        // site by saturating the observed types.
+        if (memcmp(&before, feedback, sizeof(ObservedValues)) == 0) {
+            while (feedback->numTypes < ObservedValues::MaxTypes)
+                feedback->addSeen(TYPEOF(val));
+        }
         break;
     }
     case DeoptReason::Calltarget: {
         assert(*pos == Opcode::record_call_);
         ObservedCallees* feedback = (ObservedCallees*)(pos + 1);
+        auto targets = feedback->numTargets;
         feedback->record(reason.srcCode, val);
         assert(feedback->taken > 0);
+        if (feedback->numTargets == targets)
+            feedback->invalid = true;
         break;
     }
     case DeoptReason::EnvStubMaterialized: {
@@ -630,6 +745,70 @@ static void loopTrampoline(Code* c, InterpreterInstance* ctx, SEXP env,
     Rf_endcontext(&cntxt);
 }
 
+unsigned pir::Parameter::REGION_WARMUP =
+    getenv("PIR_REGION_WARMUP") ? atoi(getenv("PIR_REGION_WARMUP")) : 1000;
+
+// Called on the back-edge to target in functions which are too big to be
+// optimized as a whole. Counts the back-edge towards the region around it and
+// compiles hot regions. If target is the start of a compiled region, the
+// region is executed and the pc where the interpreter continues is returned.
+static Opcode* runHotRegion(Code* c, InterpreterInstance* ctx, SEXP env,
+                            const CallContext* callCtxt, Opcode* backedge,
+                            Opcode* target) {
+    auto regions = c->regions();
+    if (!regions) {
+        regions = CodeRegions::New(c);
+        c->regions(regions);
+    }
+    if (regions->size() == 0)
+        return nullptr;
+    auto idx = regions->around(backedge - c->code());
+    if (idx == -1)
+        return nullptr;
+    auto& region = regions->region(idx);
+
+    auto fun = regions->compiled(idx);
+    if (fun && !fun->body()->nativeCode) {
+        // The region deoptimized
+        regions->compiled(idx, nullptr);
+        fun = nullptr;
+    }
+
+    if (!fun) {
+        if (++region.backedges < pir::Parameter::REGION_WARMUP ||
+            region.compilations >= pir::Parameter::DEOPT_ABANDON)
+            return nullptr;
+        region.backedges = 0;
+        // Only the body of the running closure can be compiled
+        if (!callCtxt || !callCtxt->callee ||
+            DispatchTable::unpack(BODY(callCtxt->callee))->baseline()->body() !=
+                c)
+            return nullptr;
+        region.compilations++;
+        fun = ctx->regionOptimizer(callCtxt->callee, c->code() + region.start,
+                                   c->code() + region.end, region.stackSize);
+        if (!fun) {
+            region.compilations = pir::Parameter::DEOPT_ABANDON;
+            return nullptr;
+        }
+        regions->compiled(idx, fun);
+    }
+
+    if (target != c->code() + region.start || !callCtxt || !callCtxt->callee)
+        return nullptr;
+
+    // The stack of the frame is passed as arguments and consumed by the region
+    auto body = fun->body();
+    fun->registerInvocation();
+    body->nativeCode(body,
+                     region.stackSize
+                         ? ostack_cell_at(ctx, region.stackSize - 1)
+                         : nullptr,
+                     env, callCtxt->callee);
+    ostack_popn(ctx, region.stackSize);
+    return c->code() + region.end;
+}
+
 static RIR_INLINE SEXP legacySpecialCall(CallContext& call,
                                          InterpreterInstance* ctx) {
     assert(call.ast != R_NilValue);
@@ -726,7 +905,7 @@ static SEXP closureArgumentAdaptor(const CallContext& call, SEXP arglist,
            assignments arguments increment REFCNT values */
         ENABLE_REFCNT(a);
 
-        Code* c = fun->defaultArg(pos++);
+        Code* c = fun->defaultArgLazy(pos++);
         if (CAR(f) != R_MissingArg) {
             if (CAR(a) == R_MissingArg) {
                 assert(c != nullptr && "No more compiled formals available.");
@@ -941,6 +1120,8 @@ unsigned pir::Parameter::RIR_WARMUP =
     getenv("PIR_WARMUP") ? atoi(getenv("PIR_WARMUP")) : 3;
 unsigned pir::Parameter::DEOPT_ABANDON =
     getenv("PIR_DEOPT_ABANDON") ? atoi(getenv("PIR_DEOPT_ABANDON")) : 10;
+unsigned pir::Parameter::DEOPT_DECAY =
+    getenv("PIR_DEOPT_DECAY") ? atoi(getenv("PIR_DEOPT_DECAY")) : 1000;
 
 static unsigned serializeCounter = 0;
 
@@ -956,7 +1137,12 @@ static SEXP rirCallCallerProvidedEnv(CallContext& call, Function* fun,
     // if it does not exist yet.
     SEXP frame;
     SEXP promargs;
-    if (call.arglist) {
+    if (call.matchedArglist) {
+        // Arguments were matched at runtime, the original arglist serves as
+        // promargs.
+        frame = call.matchedArglist;
+        promargs = call.arglist;
+    } else if (call.arglist) {
         promargs = frame = call.arglist;
     } else {
         // Wrap the passed args in a linked-list.
@@ -980,7 +1166,7 @@ static SEXP rirCallCallerProvidedEnv(CallContext& call, Function* fun,
         // some missing args might need to be supplied.
         if (!call.givenContext.includes(Assumption::NoExplicitlyMissingArgs) ||
             call.passedArgs != fun->nargs()) {
-            if (call.arglist) {
+            if (promargs == frame) {
                 promargs = Rf_shallow_duplicate(promargs);
                 PROTECT(promargs);
                 npreserved++;
@@ -1001,13 +1187,13 @@ static SEXP rirCallCallerProvidedEnv(CallContext& call, Function* fun,
                         assert(frame == R_NilValue);
                         SET_FRAME(env, a);
                     }
-                    if (auto dflt = fun->defaultArg(pos)) {
+                    if (auto dflt = fun->defaultArgLazy(pos)) {
                         SETCAR(a, createPromise(dflt, env));
                         SET_MISSING(a, 2);
                     }
                 } else if (CAR(a) == R_MissingArg) {
                     SET_MISSING(a, 1);
-                    if (auto dflt = fun->defaultArg(pos)) {
+                    if (auto dflt = fun->defaultArgLazy(pos)) {
                         SET_MISSING(a, 2);
                         SETCAR(a, createPromise(dflt, env));
                     }
@@ -1032,6 +1218,61 @@ static SEXP rirCallCallerProvidedEnv(CallContext& call, Function* fun,
     return res;
 }
 
+RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx);
+
+// Optimized versions of closures with `...` formals expect to be called
+// statically argmatched, ie. with the arguments in the order of the formals and
+// the `...` arguments packed into a DOTSXP. If the caller could not match the
+// arguments we do the shuffling here at runtime and pass the original
+// arguments as promargs.
+static SEXP rirCallRuntimeArgmatched(CallContext& call,
+                                     InterpreterInstance* ctx) {
+    SEXP promargs = call.arglist;
+    if (!promargs)
+        promargs = createPromargsFromStackValues(call, ctx);
+    PROTECT(promargs);
+
+    SEXP matched;
+    {
+        // Set up a context with the call in it so error has access to it
+        RCNTXT cntxt;
+        initClosureContext(call.ast, &cntxt, CLOENV(call.callee),
+                           call.callerEnv, promargs, call.callee);
+        matched = Rf_matchArgs(FORMALS(call.callee), promargs, call.ast);
+        endClosureContext(&cntxt, R_NilValue);
+    }
+    PROTECT(matched);
+
+    // Trailing missing arguments are not passed, same as for statically
+    // argmatched call sites.
+    size_t nargs = 0;
+    size_t pos = 0;
+    for (auto a = matched; a != R_NilValue; a = CDR(a)) {
+        pos++;
+        if (CAR(a) != R_MissingArg)
+            nargs = pos;
+    }
+    auto a = matched;
+    for (size_t i = 0; i < nargs; ++i) {
+        ostack_push(ctx, CAR(a));
+        a = CDR(a);
+    }
+
+    Context given;
+    given.add(Assumption::StaticallyArgmatched);
+    CallContext matchedCall(ArglistOrder::NOT_REORDERED, call.caller,
+                            call.callee, nargs, call.ast,
+                            ostack_cell_at(ctx, (long)nargs - 1), nullptr,
+                            call.callerEnv, given, ctx);
+    matchedCall.arglist = promargs;
+    matchedCall.matchedArglist = matched;
+
+    auto res = rirCall(matchedCall, ctx);
+    ostack_popn(ctx, matchedCall.passedArgs);
+    UNPROTECT(2);
+    return res;
+}
+
 // Call a RIR function. Arguments are still untouched.
 RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
     SEXP body = BODY(call.callee);
@@ -1049,9 +1290,29 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
 
     inferCurrentContext(call, table->baseline()->signature().formalNargs(),
                         ctx);
+
+    // Matching at runtime only pays off if there is (or is about to be) an
+    // optimized version, the baseline does not need it.
+    if (table->baseline()->signature().hasDotsFormals &&
+        !call.givenContext.includes(Assumption::StaticallyArgmatched) &&
+        !table->baseline()->flags.contains(Function::NotOptimizable) &&
+        (table->size() > 1 ||
+         table->baseline()->invocationCount() + 1 >=
+             pir::Parameter::RIR_WARMUP)) {
+        auto res = rirCallRuntimeArgmatched(call, ctx);
+        if (pir::Parameter::RIR_SERIALIZE_CHAOS) {
+            UNPROTECT(1);
+        }
+        return res;
+    }
+
     Function* fun = dispatch(call, table);
     fun->registerInvocation();
 
+    if (pir::Parameter::SPLIT_INNER_FEEDBACK && fun == table->baseline() &&
+        fun->flags.contains(Function::InnerFunction))
+        checkSplitFeedback(fun);
+
     if (!isDeoptimizing() && RecompileHeuristic(table, fun)) {
         Context given = call.givenContext;
         // addDynamicAssumptionForOneTarget compares arguments with the
@@ -1136,18 +1397,17 @@ class SlowcaseCounter {
 #endif
 
 SEXP builtinCall(CallContext& call, InterpreterInstance* ctx) {
-    if (!call.hasNames()) {
-        SEXP res = tryFastBuiltinCall(call, ctx);
-        if (res) {
-            int flag = getFlag(call.callee);
-            if (flag < 2)
-                R_Visible = static_cast<Rboolean>(flag != 1);
-            return res;
-        }
+    SEXP res = call.hasNames() ? tryFastNamedBuiltinCall(call, ctx)
+                               : tryFastBuiltinCall(call, ctx);
+    if (res) {
+        int flag = getFlag(call.callee);
+        if (flag < 2)
+            R_Visible = static_cast<Rboolean>(flag != 1);
+        return res;
+    }
 #ifdef DEBUG_SLOWCASES
-        SlowcaseCounter::count("builtin", call, ctx);
+    SlowcaseCounter::count("builtin", call, ctx);
 #endif
-    }
     return legacyCall(call, ctx);
 }
 
@@ -1171,6 +1431,8 @@ SEXP doCall(CallContext& call, InterpreterInstance* ctx) {
     case BUILTINSXP:
         return builtinCall(call, ctx);
     case CLOSXP: {
+        if (auto res = tryFastHandlerCall(call, ctx))
+            return res;
         if (TYPEOF(BODY(call.callee)) != EXTERNALSXP)
             return legacyCall(call, ctx);
         return rirCall(call, ctx);
@@ -1560,6 +1822,111 @@ SEXP seq_int(int n1, int n2) {
     return ans;
 }
 
+/*
+ * Vectors which are appended to one element at a time, e.g. with
+ * `x[[length(x) + 1]] <- v` in a loop, are reallocated with spare capacity.
+ * As in GNU R's EnlargeVector, the capacity is kept in TRUELENGTH and the
+ * vector is marked growable. The vector has to be unshared and must not have
+ * attributes. Returns the vector itself if it has enough capacity left.
+ */
+SEXP growVector(SEXP vector, R_xlen_t length) {
+    assert(!MAYBE_SHARED(vector) && ATTRIB(vector) == R_NilValue &&
+           !ALTREP(vector));
+    auto oldLength = XLENGTH(vector);
+    assert(length > oldLength);
+    if (IS_GROWABLE(vector) && XTRUELENGTH(vector) >= length) {
+        SET_STDVEC_LENGTH(vector, length);
+        return vector;
+    }
+
+    auto capacity = length + length / 2 + 4;
+    auto res = Rf_allocVector(TYPEOF(vector), capacity);
+    switch (TYPEOF(vector)) {
+    case LGLSXP:
+    case INTSXP:
+        memcpy(INTEGER(res), INTEGER(vector), oldLength * sizeof(int));
+        break;
+    case REALSXP:
+        memcpy(REAL(res), REAL(vector), oldLength * sizeof(double));
+        break;
+    case CPLXSXP:
+        memcpy(COMPLEX(res), COMPLEX(vector), oldLength * sizeof(Rcomplex));
+        break;
+    case RAWSXP:
+        memcpy(RAW(res), RAW(vector), oldLength);
+        break;
+    case STRSXP:
+        for (R_xlen_t i = 0; i < oldLength; ++i)
+            SET_STRING_ELT(res, i, STRING_ELT(vector, i));
+        break;
+    case VECSXP:
+        for (R_xlen_t i = 0; i < oldLength; ++i)
+            SET_VECTOR_ELT(res, i, VECTOR_ELT(vector, i));
+        break;
+    default:
+        assert(false);
+    }
+    SET_STDVEC_LENGTH(res, length);
+    SET_TRUELENGTH(res, capacity);
+    SET_GROWABLE_BIT(res);
+    return res;
+}
+
+// Fast case for `x[n + 1] <- v` and `x[[n + 1]] <- v` with a scalar v of the
+// same type, on an unshared vector of length n. Returns nullptr otherwise.
+SEXP appendScalar(SEXP vector, SEXP idx, SEXP val, bool subassign2) {
+    auto type = TYPEOF(vector);
+    if (MAYBE_SHARED(vector) || ATTRIB(vector) != R_NilValue ||
+        ALTREP(vector) ||
+        (type != LGLSXP && type != INTSXP && type != REALSXP &&
+         type != STRSXP && type != VECSXP))
+        return nullptr;
+
+    R_xlen_t pos;
+    if (IS_SIMPLE_SCALAR(idx, INTSXP) && INTEGER(idx)[0] != NA_INTEGER)
+        pos = INTEGER(idx)[0] - 1;
+    else if (IS_SIMPLE_SCALAR(idx, REALSXP) && !ISNAN(REAL(idx)[0]))
+        pos = (R_xlen_t)REAL(idx)[0] - 1;
+    else
+        return nullptr;
+    if (pos != XLENGTH(vector))
+        return nullptr;
+
+    if (type == VECSXP) {
+        // x[[i]] <- NULL deletes, and x[i] <- v assigns the elements of v
+        if (!subassign2 || val == R_NilValue || val == vector)
+            return nullptr;
+    } else if (ATTRIB(val) != R_NilValue || XLENGTH(val) != 1 ||
+               (TYPEOF(val) != type &&
+                !(type == REALSXP && TYPEOF(val) == INTSXP))) {
+        return nullptr;
+    }
+
+    vector = growVector(vector, pos + 1);
+    switch (type) {
+    case LGLSXP:
+    case INTSXP:
+        INTEGER(vector)[pos] = INTEGER(val)[0];
+        break;
+    case REALSXP:
+        if (TYPEOF(val) == INTSXP)
+            REAL(vector)[pos] = INTEGER(val)[0] == NA_INTEGER
+                                    ? NA_REAL
+                                    : (double)INTEGER(val)[0];
+        else
+            REAL(vector)[pos] = REAL(val)[0];
+        break;
+    case STRSXP:
+        SET_STRING_ELT(vector, pos, STRING_ELT(val, 0));
+        break;
+    case VECSXP:
+        ENSURE_NAMEDMAX(val);
+        SET_VECTOR_ELT(vector, pos, val);
+        break;
+    }
+    return vector;
+}
+
 bool isMissing(SEXP symbol, SEXP environment, Code* code, Opcode* pc) {
     SEXP val = R_findVarLocInFrame(environment, symbol).cell;
     if (val == NULL) {
@@ -1599,6 +1966,62 @@ bool isMissing(SEXP symbol, SEXP environment, Code* code, Opcode* pc) {
 // terrible, can't find out where in the evalRirCode function
 #pragma GCC diagnostic ignored "-Wstrict-overflow"
 
+// A loop which needs a context (see beginloop_)
+struct ContextLoop {
+    Opcode* body;
+    Opcode* end;      // the endloop_
+    size_t stackSize; // stack size of the frame when entering the loop
+};
+
+// Returns the loops with context around pc, outermost first
+static std::vector<ContextLoop> contextLoopsAround(Code* c, Opcode* pc) {
+    std::vector<ContextLoop> loops;
+    SEXP all = c->contextLoops();
+    auto entries = INTEGER(all);
+    for (R_xlen_t i = 0; i < XLENGTH(all); i += 3) {
+        auto body = c->code() + entries[i];
+        auto end = c->code() + entries[i + 1];
+        if (body <= pc && pc < end)
+            loops.push_back({body, end, (size_t)entries[i + 2]});
+    }
+    return loops;
+}
+
+// Continues execution at pc, after re-establishing the contexts of the loops
+// around pc, which the interpreter would have pushed at their beginloop_.
+static SEXP evalRirCodeInLoops(Code* c, InterpreterInstance* ctx, SEXP env,
+                               const CallContext* callCtxt, Opcode* pc,
+                               R_bcstack_t* stackBase,
+                               const std::vector<ContextLoop>& loops,
+                               size_t i) {
+    if (i == loops.size())
+        return evalRirCode(c, ctx, env, callCtxt, pc, nullptr);
+
+    auto& loop = loops[i];
+    RCNTXT cntxt;
+    Rf_begincontext(&cntxt, CTXT_LOOP, R_NilValue, env, R_BaseEnv, R_NilValue,
+                    R_NilValue);
+    // On break or next we continue with the stack from the loop entry
+    cntxt.nodestack = stackBase + loop.stackSize;
+
+    SEXP res;
+    if (int s = SETJMP(cntxt.cjmpbuf)) {
+        if (s == CTXT_BREAK) {
+            Rf_endcontext(&cntxt);
+            return evalRirCode(c, ctx, env, callCtxt, BC::next(loop.end),
+                               nullptr);
+        }
+        // continue case: do another iteration, as in loopTrampoline
+        res = evalRirCode(c, ctx, env, callCtxt, loop.body, nullptr);
+    } else {
+        res = evalRirCodeInLoops(c, ctx, env, callCtxt, pc, stackBase, loops,
+                                 i + 1);
+    }
+    assert(res == loopTrampolineMarker);
+    Rf_endcontext(&cntxt);
+    return evalRirCode(c, ctx, env, callCtxt, BC::next(loop.end), nullptr);
+}
+
 /*
  * This function takes some deopt metadata and stack frame contents on the
  * interpreter stack. It first recursively reconstructs a context for each
@@ -1646,12 +2069,12 @@ void deoptFramesWithContext(InterpreterInstance* ctx,
             // current function. Usually the reason is that a wrong environment
             // is stored in the context.
             assert(!outermostFrame && "Cannot find outermost function context");
-            // If the inlinee had no context, we need to synthesize one
-            // TODO: need to add ast and closure to the deopt metadata to create
-            // a complete context
+            // If the inlinee had no context, we need to synthesize one. The
+            // deopt metadata has the inlined call and, if it was static, the
+            // callee.
             cntxt = &fake;
-            initClosureContext(R_NilValue, cntxt, deoptEnv, sysparent,
-                               FRAME(sysparent), R_NilValue);
+            initClosureContext(f.ast, cntxt, deoptEnv, sysparent,
+                               FRAME(sysparent), f.callee);
         }
     }
 
@@ -1662,10 +2085,7 @@ void deoptFramesWithContext(InterpreterInstance* ctx,
     }
     assert(TYPEOF(deoptEnv) == ENVSXP);
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
     auto frameBaseSize = ostack_length(ctx) - excessStack;
-#pragma GCC diagnostic pop
 
     auto trampoline = [&]() {
         // 1. Set up our (outer) context
@@ -1720,7 +2140,9 @@ void deoptFramesWithContext(InterpreterInstance* ctx,
             UNPROTECT(1);
             return r;
         }
-        return evalRirCode(code, ctx, cntxt->cloenv, callCtxt, f.pc, nullptr);
+        auto loops = contextLoopsAround(code, f.pc);
+        return evalRirCodeInLoops(code, ctx, cntxt->cloenv, callCtxt, f.pc,
+                                  R_BCNodeStackBase + frameBaseSize, loops, 0);
     };
 
     SEXP res = trampoline();
@@ -1963,6 +2385,8 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 #endif
 
     assert(c->info.magic == CODE_MAGIC);
+    if (c->flags.contains(Code::Lazy))
+        Rf_error("RIR: stub of lazily compiled code executed directly");
 
     BindingCache* bindingCache;
     if (cache) {
@@ -2442,8 +2866,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             SEXP srcref = ostack_at(ctx, 0);
             SEXP body = ostack_at(ctx, 1);
             SEXP formals = ostack_at(ctx, 2);
-            res = Rf_allocSExp(CLOSXP);
             assert(DispatchTable::check(body));
+            if (pir::Parameter::SPLIT_INNER_FEEDBACK)
+                body = innerFunctionInstance(body, formals, env, ctx);
+            PROTECT(body);
+            res = Rf_allocSExp(CLOSXP);
+            UNPROTECT(1);
             SET_FORMALS(res, formals);
             SET_BODY(res, body);
             SET_CLOENV(res, env);
@@ -2474,7 +2902,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(mk_eager_promise_) {
             Immediate id = readImmediate();
             advanceImmediate();
-            SEXP prom = Rf_mkPROMISE(c->getPromise(id)->container(), env);
+            SEXP prom = Rf_mkPROMISE(c->getPromiseLazy(id)->container(), env);
             SEXP val = ostack_pop(ctx);
             assert(TYPEOF(val) != PROMSXP);
             ENSURE_NAMEDMAX(val);
@@ -2486,7 +2914,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(mk_promise_) {
             Immediate id = readImmediate();
             advanceImmediate();
-            SEXP prom = Rf_mkPROMISE(c->getPromise(id)->container(), env);
+            SEXP prom = Rf_mkPROMISE(c->getPromiseLazy(id)->container(), env);
             ostack_push(ctx, prom);
             NEXT();
         }
@@ -2512,7 +2940,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(push_code_) {
             Immediate n = readImmediate();
             advanceImmediate();
-            ostack_push(ctx, c->getPromise(n)->container());
+            ostack_push(ctx, c->getPromiseLazy(n)->container());
             NEXT();
         }
 
@@ -2797,7 +3225,14 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(eq_) {
             SEXP lhs = ostack_at(ctx, 1);
             SEXP rhs = ostack_at(ctx, 0);
-            DO_RELOP(==);
+            if (IS_SIMPLE_SCALAR(lhs, STRSXP) &&
+                IS_SIMPLE_SCALAR(rhs, STRSXP)) {
+                auto r = charsxpEq(STRING_ELT(lhs, 0), STRING_ELT(rhs, 0));
+                res = r == NA_LOGICAL ? R_LogicalNAValue
+                                      : r ? R_TrueValue : R_FalseValue;
+            } else {
+                DO_RELOP(==);
+            }
             ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
@@ -2831,7 +3266,14 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             assert(R_PPStackTop >= 0);
             SEXP lhs = ostack_at(ctx, 1);
             SEXP rhs = ostack_at(ctx, 0);
-            DO_RELOP(!=);
+            if (IS_SIMPLE_SCALAR(lhs, STRSXP) &&
+                IS_SIMPLE_SCALAR(rhs, STRSXP)) {
+                auto r = charsxpEq(STRING_ELT(lhs, 0), STRING_ELT(rhs, 0));
+                res = r == NA_LOGICAL ? R_LogicalNAValue
+                                      : r ? R_FalseValue : R_TrueValue;
+            } else {
+                DO_RELOP(!=);
+            }
             ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
@@ -3083,8 +3525,17 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             JumpOffset offset = readJumpOffset();
             advanceJump();
             checkUserInterrupt();
+            auto backedge = pc - sizeof(JumpOffset) - 1;
             pc += offset;
             PC_BOUNDSCHECK(pc, c);
+            if (offset < 0 && c->codeSize > pir::Parameter::MAX_INPUT_SIZE) {
+                if (auto next =
+                        runHotRegion(c, ctx, env, callCtxt, backedge, pc)) {
+                    // The region might have changed the bindings
+                    clearCache(bindingCache);
+                    pc = next;
+                }
+            }
             NEXT();
         }
 
@@ -3292,6 +3743,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             SEXP vec = ostack_at(ctx, 1);
             SEXP val = ostack_at(ctx, 2);
 
+            if (auto grown = appendScalar(vec, idx, val, false)) {
+                ostack_popn(ctx, 3);
+                ostack_push(ctx, grown);
+                NEXT();
+            }
+
             // Destructively modifies TOS, even if the refcount is 1. This is
             // intended, to avoid copying. Care need to be taken if `vec` is
             // used multiple times as a temporary.
@@ -3421,6 +3878,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             SEXP vec = ostack_at(ctx, 1);
             SEXP val = ostack_at(ctx, 2);
 
+            if (auto grown = appendScalar(vec, idx, val, true)) {
+                ostack_popn(ctx, 3);
+                ostack_push(ctx, grown);
+                NEXT();
+            }
+
             // Fast case
             if (NOT_SHARED(vec) && !isObject(vec)) {
                 SEXPTYPE vectorT = TYPEOF(vec);
@@ -3869,7 +4332,7 @@ SEXP rirEval(SEXP what, SEXP env) {
     // TODO: do we not need an RCNTXT here?
 
     if (auto code = Code::check(what)) {
-        return evalRirCodeExtCaller(code, globalContext(), env);
+        return evalRirCodeExtCaller(code->compiled(), globalContext(), env);
     }
 
     if (auto table = DispatchTable::check(what)) {
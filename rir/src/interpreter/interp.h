@@ -13,6 +13,8 @@
 
 #include <R/r.h>
 
+#include <algorithm>
+
 #undef length
 
 #if defined(__GNUC__) && (!defined(NO_THREADED_CODE))
@@ -23,6 +25,8 @@ namespace rir {
 SEXP dispatchApply(SEXP ast, SEXP obj, SEXP actuals, SEXP selector,
                    SEXP callerEnv, InterpreterInstance* ctx);
 bool isMissing(SEXP symbol, SEXP environment, Code* code, Opcode* op);
+SEXP growVector(SEXP vector, R_xlen_t length);
+SEXP appendScalar(SEXP vector, SEXP idx, SEXP val, bool subassign2);
 
 inline RCNTXT* getFunctionContext(size_t pos = 0,
                                   RCNTXT* cptr = (RCNTXT*)R_GlobalContext) {
@@ -53,15 +57,27 @@ inline RCNTXT* findFunctionContextFor(SEXP e) {
 inline bool RecompileHeuristic(DispatchTable* table, Function* fun,
                                unsigned factor = 1) {
     auto& flags = fun->flags;
-    return (!flags.contains(Function::NotOptimizable) &&
-            (flags.contains(Function::MarkOpt) ||
-             flags.contains(Function::Dead) ||
-             (fun->deoptCount() < pir::Parameter::DEOPT_ABANDON &&
-              ((fun != table->baseline() && fun->invocationCount() >= 2 &&
-                fun->invocationCount() <= pir::Parameter::RIR_WARMUP) ||
-               (fun->invocationCount() %
-                (factor * (fun->deoptCount() + pir::Parameter::RIR_WARMUP))) ==
-                   0))));
+    if (flags.contains(Function::NotOptimizable))
+        return false;
+    if (flags.contains(Function::MarkOpt) || flags.contains(Function::Dead))
+        return true;
+
+    auto deopts = fun->deoptCount();
+    if (deopts >= pir::Parameter::DEOPT_ABANDON) {
+        // Too many deopts, back off exponentially until the deopt count has
+        // decayed again. Starts from the linear period below, such that
+        // crossing the threshold never recompiles more often.
+        auto backoff =
+            std::min(deopts - pir::Parameter::DEOPT_ABANDON, (size_t)16);
+        auto period = (size_t)(pir::Parameter::DEOPT_ABANDON +
+                               pir::Parameter::RIR_WARMUP)
+                      << backoff;
+        return fun->invocationCount() % (factor * period) == 0;
+    }
+    return (fun != table->baseline() && fun->invocationCount() >= 2 &&
+            fun->invocationCount() <= pir::Parameter::RIR_WARMUP) ||
+           (fun->invocationCount() %
+            (factor * (deopts + pir::Parameter::RIR_WARMUP))) == 0;
 }
 
 inline bool RecompileCondition(DispatchTable* table, Function* fun,
@@ -117,6 +133,8 @@ void deoptFramesWithContext(InterpreterInstance* ctx,
                             RCNTXT* currentContext);
 void recordDeoptReason(SEXP val, const DeoptReason& reason);
 void jit(SEXP cls, SEXP name, InterpreterInstance* ctx);
+SEXP innerFunctionInstance(SEXP body, SEXP formals, SEXP env,
+                           InterpreterInstance* ctx);
 
 SEXP seq_int(int n1, int n2);
 bool doubleCanBeCastedToInteger(double n);
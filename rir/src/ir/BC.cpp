@@ -413,6 +413,8 @@ void BC::print(std::ostream& out) const {
             out << "*>, ";
         else
             out << prof.numTargets << ">" << (prof.numTargets ? ", " : " ");
+        if (prof.invalid)
+            out << "invalid, ";
         for (int i = 0; i < prof.numTargets; ++i)
             out << callFeedbackExtra().targets[i] << "("
                 << type2char(TYPEOF(callFeedbackExtra().targets[i])) << ") ";
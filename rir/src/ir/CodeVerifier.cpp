@@ -233,12 +233,13 @@ void CodeVerifier::verifyFunctionLayout(SEXP sexp, InterpreterInstance* ctx) {
         Rf_error("RIR Verifier: Invalid SEXPTYPE");
     Function* f = Function::unpack(sexp);
 
-    // get the code objects
+    // get the code objects, stubs of lazily compiled code are verified
+    // through their compiled code, without patching the function
     std::vector<Code*> objs;
     objs.push_back(f->body());
     for (size_t i = 0; i < f->nargs(); ++i)
-        if (f->defaultArg(i))
-            objs.push_back(f->defaultArg(i));
+        if (auto arg = f->defaultArgLazy(i))
+            objs.push_back(arg->compiled());
 
     if (f->size > XLENGTH(sexp))
         Rf_error("RIR Verifier: Reported size must be smaller than the size of "
@@ -328,7 +329,7 @@ void CodeVerifier::verifyFunctionLayout(SEXP sexp, InterpreterInstance* ctx) {
             if (*cptr == Opcode::mk_promise_ ||
                 *cptr == Opcode::mk_eager_promise_) {
                 unsigned* promidx = reinterpret_cast<Immediate*>(cptr + 1);
-                objs.push_back(c->getPromise(*promidx));
+                objs.push_back(c->getPromiseLazy(*promidx)->compiled());
             }
             if (*cptr == Opcode::named_call_) {
                 uint32_t nargs = *reinterpret_cast<Immediate*>(cptr + 1);
@@ -196,6 +196,7 @@ struct LoadArgsResult {
 
 Code* compilePromise(CompilerContext& ctx, SEXP exp);
 Code* compilePromiseNoRir(CompilerContext& ctx, SEXP exp);
+Code* compilePromiseLazy(CompilerContext& ctx, SEXP exp);
 // If we are in a void context, then compile expression will not leave a value
 // on the stack. For example in `{a; b}` the expression `a` is in a void
 // context, but `b` is not. In `while(...) {...}` all loop body expressions are
@@ -1686,7 +1687,7 @@ static void compileLoadOneArg(CompilerContext& ctx, SEXP arg, ArgType arg_type,
         prom = compilePromiseNoRir(ctx, CAR(arg));
     } else { // ArgType::PROMISE
         // Compile the expression as a promise.
-        prom = compilePromise(ctx, CAR(arg));
+        prom = compilePromiseLazy(ctx, CAR(arg));
     }
 
     size_t idx = cs.addPromise(prom);
@@ -1877,6 +1878,30 @@ Code* compilePromiseNoRir(CompilerContext& ctx, SEXP exp) {
     return ctx.pop();
 }
 
+bool containsLoopExit(SEXP exp) {
+    if (exp == symbol::Break || exp == symbol::Next)
+        return true;
+    if (TYPEOF(exp) != LANGSXP && TYPEOF(exp) != LISTSXP)
+        return false;
+    for (; exp != R_NilValue; exp = CDR(exp))
+        if (containsLoopExit(CAR(exp)))
+            return true;
+    return false;
+}
+
+/* Create a stub for a promise, which is only compiled when it is used for the
+   first time. A break or next in a promise needs a context for the enclosing
+   loop, such promises have to be compiled right away.
+*/
+Code* compilePromiseLazy(CompilerContext& ctx, SEXP exp) {
+    if (!Compiler::lazyPromises || TYPEOF(exp) != LANGSXP ||
+        (!ctx.code.empty() && ctx.inLoop() && containsLoopExit(exp)))
+        return compilePromise(ctx, exp);
+    auto stub = compilePromiseNoRir(ctx, exp);
+    stub->flags.set(Code::Lazy);
+    return stub;
+}
+
 }  // anonymous namespace
 
 SEXP Compiler::finalize() {
@@ -1891,7 +1916,7 @@ SEXP Compiler::finalize() {
         if (*arg == R_MissingArg) {
             function.addArgWithoutDefault();
         } else {
-            Code* compiled = compilePromise(ctx, *arg);
+            Code* compiled = compilePromiseLazy(ctx, *arg);
             function.addDefaultArg(compiled);
         }
         signature.pushFormal(*arg, arg.tag());
@@ -1921,4 +1946,15 @@ bool Compiler::profile =
 
 bool Compiler::loopPeelingEnabled = true;
 
+bool Compiler::lazyPromises =
+    !(getenv("RIR_LAZY_PROMISES") &&
+      std::string(getenv("RIR_LAZY_PROMISES")).compare("off") == 0);
+
+SEXP Compiler::compileLazyPromise(SEXP ast) {
+    FunctionWriter function;
+    Preserve preserve;
+    CompilerContext ctx(function, preserve);
+    return compilePromise(ctx, ast)->container();
+}
+
 } // namespace rir
@@ -42,9 +42,13 @@ class Compiler {
     static bool profile;
     static bool unsoundOpts;
     static bool loopPeelingEnabled;
+    static bool lazyPromises;
 
     SEXP finalize();
 
+    // Compiles the code of a lazy promise stub, see Code::compiled()
+    static SEXP compileLazyPromise(SEXP ast);
+
     static SEXP compileExpression(SEXP ast) {
 #if 0
         size_t count = 1;
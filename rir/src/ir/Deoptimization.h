@@ -16,10 +16,16 @@ struct FrameInfo {
     Code* code;
     size_t stackSize;
     bool inPromise;
+    // The call and callee of inlined frames, used to synthesize their
+    // contexts. R_NilValue if unknown.
+    SEXP ast;
+    SEXP callee;
 
     FrameInfo() {}
-    FrameInfo(Opcode* pc, Code* code, size_t stackSize, bool promise)
-        : pc(pc), code(code), stackSize(stackSize), inPromise(promise) {}
+    FrameInfo(Opcode* pc, Code* code, size_t stackSize, bool promise,
+              SEXP ast = R_NilValue, SEXP callee = R_NilValue)
+        : pc(pc), code(code), stackSize(stackSize), inPromise(promise),
+          ast(ast), callee(callee) {}
 };
 
 struct DeoptMetadata {
@@ -1,10 +1,13 @@
 #include "Code.h"
+#include "CodeRegions.h"
 #include "Function.h"
 #include "R/Printing.h"
 #include "R/Serialize.h"
 #include "ir/BC.h"
+#include "ir/Compiler.h"
 #include "utils/Pool.h"
 
+#include <deque>
 #include <iomanip>
 #include <sstream>
 
@@ -18,10 +21,10 @@ Code::Code(FunctionSEXP fun, SEXP src, unsigned srcIdx, unsigned cs,
           (intptr_t)&locals_ - (intptr_t)this,
           // GC area has only 1 pointer
           NumLocals),
-      nativeCode(nullptr), funInvocationCount(0), deoptCount(0), src(srcIdx),
-      trivialExpr(nullptr), stackLength(0), localsCount(localsCnt),
-      bindingCacheSize(bindingsCnt), codeSize(cs), srcLength(sourceLength),
-      extraPoolSize(0) {
+      nativeCode(nullptr), funInvocationCount(0), deoptCount(0), lastDeopt(0),
+      src(srcIdx), trivialExpr(nullptr), stackLength(0),
+      localsCount(localsCnt), bindingCacheSize(bindingsCnt), codeSize(cs),
+      srcLength(sourceLength), extraPoolSize(0) {
     setEntry(0, R_NilValue);
     if (src && TYPEOF(src) == SYMSXP)
         trivialExpr = src;
@@ -88,6 +91,105 @@ unsigned Code::getSrcIdxAt(const Opcode* pc, bool allowMissing) const {
     return sidx;
 }
 
+CodeRegions* Code::regions() const {
+    SEXP data = getEntry(3);
+    if (!data)
+        return nullptr;
+    return CodeRegions::unpack(data);
+}
+
+void Code::regions(CodeRegions* regions) { setEntry(3, regions->container()); }
+
+std::unordered_map<Opcode*, size_t> Code::stackSizes() const {
+    std::unordered_map<Opcode*, size_t> sizes;
+    std::deque<std::pair<Opcode*, size_t>> todo = {{code(), 0}};
+    while (!todo.empty()) {
+        auto pc = todo.back().first;
+        auto size = todo.back().second;
+        todo.pop_back();
+        while (pc != endCode() && !sizes.count(pc)) {
+            sizes[pc] = size;
+            BC bc = BC::decodeShallow(pc);
+            if (bc.isExit())
+                break;
+            size = size - bc.popCount() + bc.pushCount();
+            if (bc.isJmp()) {
+                todo.push_back({BC::jmpTarget(pc), size});
+                if (bc.isUncondJmp())
+                    break;
+            }
+            pc = BC::next(pc);
+        }
+    }
+    return sizes;
+}
+
+SEXP Code::contextLoops() {
+    SEXP loops = getEntry(4);
+    if (loops)
+        return loops;
+
+    size_t n = 0;
+    for (auto pc = code(); pc < endCode(); pc = BC::next(pc))
+        if (*pc == Opcode::beginloop_)
+            n++;
+    loops = Rf_allocVector(INTSXP, 3 * n);
+    setEntry(4, loops);
+    if (!n)
+        return loops;
+
+    auto sizes = stackSizes();
+    auto res = INTEGER(loops);
+    for (auto pc = code(); pc < endCode(); pc = BC::next(pc)) {
+        if (*pc == Opcode::beginloop_) {
+            auto body = BC::next(pc);
+            auto size = sizes.find(body);
+            *res++ = body - code();
+            *res++ = BC::jmpTarget(pc) - code();
+            // Unreachable loops cannot be around a deoptimization point
+            *res++ = size == sizes.end() ? 0 : size->second;
+        }
+    }
+    return loops;
+}
+
+void Code::compileLazy() {
+    assert(flags.contains(Lazy) && extraPoolSize == 0);
+    SEXP code =
+        Compiler::compileLazyPromise(src_pool_at(globalContext(), src));
+    PROTECT(code);
+    addExtraPoolEntry(code);
+    UNPROTECT(1);
+    // Promises are created from the stub, so it has to carry the flags which
+    // are checked on the promise code
+    if (unpack(code)->flags.contains(NoReflection))
+        flags.set(NoReflection);
+}
+
+bool Code::hasMegamorphicFeedback() const {
+    for (auto pc = code(); pc != endCode(); pc = BC::next(pc)) {
+        if (*pc == Opcode::record_type_) {
+            // Sites blacklisted after a deopt are saturated with repeats of
+            // one type, only distinct types are megamorphic
+            auto feedback = (ObservedValues*)(pc + 1);
+            if (feedback->numTypes < ObservedValues::MaxTypes)
+                continue;
+            bool distinct = true;
+            for (size_t i = 0; i < ObservedValues::MaxTypes; ++i)
+                for (size_t j = i + 1; j < ObservedValues::MaxTypes; ++j)
+                    if (feedback->seen(i) == feedback->seen(j))
+                        distinct = false;
+            if (distinct)
+                return true;
+        } else if (*pc == Opcode::record_call_) {
+            auto feedback = (ObservedCallees*)(pc + 1);
+            if (feedback->numTargets == ObservedCallees::MaxTargets)
+                return true;
+        }
+    }
+    return false;
+}
+
 Code* Code::deserialize(SEXP refTable, R_inpstream_t inp) {
     size_t size = InInteger(inp);
     SEXP store = Rf_allocVector(EXTERNALSXP, size);
@@ -96,6 +198,8 @@ Code* Code::deserialize(SEXP refTable, R_inpstream_t inp) {
     code->nativeCode = nullptr; // not serialized for now
     code->funInvocationCount = InInteger(inp);
     code->deoptCount = InInteger(inp);
+    code->lastDeopt = InInteger(inp);
+    code->flags = EnumSet<Flag>(InInteger(inp));
     code->src = InInteger(inp);
     bool hasTr = InInteger(inp);
     if (hasTr)
@@ -133,6 +237,8 @@ void Code::serialize(SEXP refTable, R_outpstream_t out) const {
     // Header
     OutInteger(out, funInvocationCount);
     OutInteger(out, deoptCount);
+    OutInteger(out, lastDeopt);
+    OutInteger(out, flags.to_i());
     OutInteger(out, src);
     OutInteger(out, trivialExpr != nullptr);
     if (trivialExpr)
@@ -252,8 +358,14 @@ void Code::disassemble(std::ostream& out, const std::string& prefix) const {
     }
 
     for (auto i : promises) {
-        auto c = getPromise(i);
+        auto c = getPromiseLazy(i);
+        if (c->flags.contains(Lazy) && c->extraPoolSize)
+            c = c->compiled();
         out << "\n[Prom (index " << prefix << i << ")]\n";
+        if (c->flags.contains(Lazy)) {
+            out << "lazy, not compiled yet\n";
+            continue;
+        }
         std::stringstream ss;
         ss << prefix << i << ".";
         c->disassemble(out, ss.str());
@@ -4,11 +4,13 @@
 #include "ArglistOrder.h"
 #include "PirTypeFeedback.h"
 #include "RirRuntimeObject.h"
+#include "compiler/parameter.h"
 #include "ir/BC_inc.h"
 
 #include <cassert>
 #include <cstdint>
 #include <ostream>
+#include <unordered_map>
 
 namespace rir {
 
@@ -42,13 +44,14 @@ typedef SEXP CodeSEXP;
 
 struct InterpreterInstance;
 struct Code;
+struct CodeRegions;
 typedef SEXP (*NativeCode)(Code*, void*, SEXP, SEXP);
 
 struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
     friend class FunctionWriter;
     friend class CodeVerifier;
-    // extra pool, pir type feedback, arg reordering info
-    static constexpr size_t NumLocals = 3;
+    // extra pool, pir type feedback, arg reordering info, hot regions, loops
+    static constexpr size_t NumLocals = 5;
 
     Code(FunctionSEXP fun, SEXP src, unsigned srcIdx, unsigned codeSize,
          unsigned sourceSize, size_t localsCnt, size_t bindingsCacheSize);
@@ -56,12 +59,15 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
 
   private:
     Code() : Code(NULL, 0, 0, 0, 0, 0, 0) {}
+    void compileLazy();
     /*
-     * This array contains the GC reachable pointers. Currently there are three
+     * This array contains the GC reachable pointers. Currently there are five
      * of them.
      * 0 : the extra pool for attaching additional GC'd object to the code
      * 1 : pir type feedback
      * 2 : call argument reordering metadata
+     * 3 : regions of a function body which can be compiled separately
+     * 4 : loops with a context, cached for deoptimization
      */
     SEXP locals_[NumLocals];
 
@@ -89,23 +95,38 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
             funInvocationCount++;
     }
 
+    // The deopt count halves every DEOPT_DECAY invocations without a deopt,
+    // such that a burst of deopts does not keep a function from being
+    // optimized forever.
+    unsigned decayedDeoptCount() const {
+        if (!pir::Parameter::DEOPT_DECAY || funInvocationCount < lastDeopt)
+            return deoptCount;
+        auto halvings =
+            (funInvocationCount - lastDeopt) / pir::Parameter::DEOPT_DECAY;
+        return halvings >= 32 ? 0 : deoptCount >> halvings;
+    }
+
     void registerDeopt() {
+        deoptCount = decayedDeoptCount();
         if (deoptCount < UINT_MAX)
             deoptCount++;
+        lastDeopt = funInvocationCount;
     }
 
     // number of invocations. only incremented if this code object is the body
     // of a function
     unsigned funInvocationCount;
     unsigned deoptCount;
+    unsigned lastDeopt; /// invocation count at the last deopt
 
     enum Flag {
         NeedsFullEnv,
         NoReflection,
         Reoptimise,
+        Lazy,
 
         FIRST = NeedsFullEnv,
-        LAST = Reoptimise
+        LAST = Lazy
     };
 
     EnumSet<Flag> flags;
@@ -160,10 +181,34 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
         return VECTOR_ELT(getEntry(0), i);
     }
 
+    // Returns the code of a promise, compiling it if it is still a stub
     Code* getPromise(size_t idx) const {
+        auto c = getPromiseLazy(idx);
+        if (c->flags.contains(Lazy)) {
+            c = c->compiled();
+            SET_VECTOR_ELT(getEntry(0), idx, c->container());
+        }
+        return c;
+    }
+
+    // Returns the code of a promise, which might still be a stub
+    Code* getPromiseLazy(size_t idx) const {
         return unpack(getExtraPoolEntry(idx));
     }
 
+    /*
+     * Promises and default arguments are compiled on their first use. Until
+     * then their code is a stub, flagged Lazy, which only knows the AST. Once
+     * compiled, the code is stored in the extra pool of the stub.
+     */
+    Code* compiled() {
+        if (!flags.contains(Lazy))
+            return this;
+        if (!extraPoolSize)
+            compileLazy();
+        return unpack(getExtraPoolEntry(0));
+    }
+
     PirTypeFeedback* pirTypeFeedback() const {
         SEXP map = getEntry(1);
         if (!map)
@@ -183,6 +228,21 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
     void arglistOrder(ArglistOrder* data) { setEntry(2, data->container()); }
     SEXP arglistOrderContainer() const { return getEntry(2); }
 
+    CodeRegions* regions() const;
+    void regions(CodeRegions* regions);
+
+    // The stack size of this frame before every reachable instruction
+    std::unordered_map<Opcode*, size_t> stackSizes() const;
+
+    // The loops with a context (see beginloop_) in code order, as an INTSXP
+    // of (body offset, endloop_ offset, stack size at the body) triples.
+    // Computed on first use.
+    SEXP contextLoops();
+
+    // True if some type or call feedback slot has seen more distinct types or
+    // targets than it can hold
+    bool hasMegamorphicFeedback() const;
+
     size_t size() const {
         return sizeof(Code) + pad4(codeSize) + srcLength * sizeof(SrclistEntry);
     }
@@ -0,0 +1,106 @@
+#include "CodeRegions.h"
+#include "Code.h"
+#include "Function.h"
+#include "ir/BC.h"
+
+#include <unordered_set>
+
+namespace rir {
+
+CodeRegions::CodeRegions(const std::vector<Region>& regions)
+    : RirRuntimeObject(sizeof(*this), regions.size()),
+      numRegions(regions.size()) {
+    for (size_t i = 0; i < numRegions; ++i)
+        this->regions()[i] = regions[i];
+}
+
+Function* CodeRegions::compiled(size_t i) const {
+    assert(i < numRegions);
+    auto fun = getEntry(i);
+    if (!fun)
+        return nullptr;
+    return Function::check(fun);
+}
+
+void CodeRegions::compiled(size_t i, Function* fun) {
+    assert(i < numRegions);
+    setEntry(i, fun ? fun->container() : R_NilValue);
+}
+
+CodeRegions* CodeRegions::New(Code* code) {
+    auto stackSizes = code->stackSizes();
+
+    std::vector<std::pair<Opcode*, Opcode*>> jumps;
+    for (auto pc = code->code(); pc != code->endCode(); pc = BC::next(pc))
+        if (BC::decodeShallow(pc).isJmp())
+            jumps.push_back({pc, BC::jmpTarget(pc)});
+
+    // Control enters only at the start and leaves only at the end
+    auto closed = [&](Opcode* start, Opcode* end) {
+        for (auto& j : jumps) {
+            bool inside = j.first >= start && j.first < end;
+            if (inside && (j.second < start || j.second > end))
+                return false;
+            if (!inside && j.second > start && j.second < end)
+                return false;
+        }
+        return true;
+    };
+
+    // Return from the function is handled as a non-local return. Loops with
+    // context have to be completely inside or outside of the region.
+    auto supported = [&](Opcode* start, Opcode* end) {
+        std::unordered_set<Opcode*> loopEnds;
+        for (auto pc = start; pc != end; pc = BC::next(pc)) {
+            switch (*pc) {
+            case Opcode::ret_:
+                return false;
+            case Opcode::beginloop_:
+                loopEnds.insert(BC::jmpTarget(pc));
+                break;
+            case Opcode::endloop_:
+                if (!loopEnds.count(pc))
+                    return false;
+                break;
+            default:
+                break;
+            }
+        }
+        return true;
+    };
+
+    std::vector<Region> regions;
+    for (auto& j : jumps) {
+        auto backedge = j.first;
+        auto header = j.second;
+        if (*backedge != Opcode::br_ || header > backedge ||
+            !stackSizes.count(header))
+            continue;
+        bool seen = false;
+        for (auto& r : regions)
+            if (code->code() + r.start == header)
+                seen = true;
+        if (seen)
+            continue;
+
+        for (auto end = BC::next(backedge); end != code->endCode();
+             end = BC::next(end)) {
+            auto size = stackSizes.find(end);
+            if (size == stackSizes.end() || size->second != 0 ||
+                !closed(header, end))
+                continue;
+            if (supported(header, end))
+                regions.push_back({(unsigned)(header - code->code()),
+                                   (unsigned)(end - code->code()),
+                                   (unsigned)stackSizes.at(header), 0, 0});
+            break;
+        }
+    }
+
+    size_t size = sizeof(CodeRegions) + regions.size() * sizeof(SEXP) +
+                  regions.size() * sizeof(Region);
+    SEXP cont = Rf_allocVector(EXTERNALSXP, size);
+    return new (DATAPTR(cont)) CodeRegions(regions);
+}
+
+} // namespace rir
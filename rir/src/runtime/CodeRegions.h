@@ -0,0 +1,87 @@
+#ifndef RIR_CODE_REGIONS_H
+#define RIR_CODE_REGIONS_H
+
+#include "RirRuntimeObject.h"
+#include "ir/BC_inc.h"
+
+#include <vector>
+
+namespace rir {
+
+#pragma pack(push)
+#pragma pack(1)
+
+constexpr static size_t CODE_REGIONS_MAGIC = 0x7e610000;
+
+struct Code;
+struct Function;
+
+/*
+ * Functions which are too big to be optimized as a whole can still have their
+ * hot loops compiled. A region starts at the header of a loop and ends at the
+ * first point after the loop where the stack of the frame is empty again. The
+ * stack at the loop header is passed to the compiled region as arguments, the
+ * environment is the one of the running function. Control can only leave a
+ * region at its end, or by a non-local transfer (return, break, deopt).
+ *
+ * The interpreter counts the back-edges taken inside every region and once it
+ * is hot, the region is compiled and entered the next time its header is
+ * reached through a back-edge.
+ */
+struct CodeRegions : public RirRuntimeObject<CodeRegions, CODE_REGIONS_MAGIC> {
+    struct Region {
+        unsigned start;     /// pc offset of the loop header
+        unsigned end;       /// pc offset where the interpreter continues
+        unsigned stackSize; /// stack size of the frame at the start
+        unsigned backedges; /// back-edges taken since the last compilation
+        unsigned compilations;
+    };
+
+    // Finds the regions of the code. If there are none, the result is empty,
+    // such that it can still be cached on the code.
+    static CodeRegions* New(Code* code);
+
+    size_t size() const { return numRegions; }
+
+    Region& region(size_t i) const {
+        assert(i < numRegions);
+        return regions()[i];
+    }
+
+    // Index of the innermost region around the pc offset, or -1
+    long around(unsigned pc) const {
+        long res = -1;
+        for (size_t i = 0; i < numRegions; ++i) {
+            auto& r = regions()[i];
+            if (r.start <= pc && pc < r.end &&
+                (res == -1 || r.start >= regions()[res].start))
+                res = i;
+        }
+        return res;
+    }
+
+    Function* compiled(size_t i) const;
+    void compiled(size_t i, Function* fun);
+
+  private:
+    explicit CodeRegions(const std::vector<Region>& regions);
+
+    Region* regions() const {
+        return reinterpret_cast<Region*>((uintptr_t)this + info.gc_area_start +
+                                         sizeof(SEXP) * info.gc_area_length);
+    }
+
+    size_t numRegions;
+
+    /*
+     * Layout of data[] is numRegions compiled functions (the gc area),
+     * followed by numRegions Region entries
+     */
+    uint8_t data[];
+};
+
+#pragma pack(pop)
+
+} // namespace rir
+
+#endif
@@ -0,0 +1,580 @@
+#include "FeedbackProfile.h"
+#include "R/Protect.h"
+#include "ir/BC.h"
+#include "interpreter/instance.h"
+#include "interpreter/interp_incl.h"
+#include "ir/Compiler.h"
+#include "runtime/DispatchTable.h"
+#include "runtime/TypeFeedback.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace rir {
+
+static const char* Magic = "rir-feedback";
+static const unsigned Version = 3;
+static const char* Global = "R_GlobalEnv";
+static const char* Namespace = "namespace:";
+
+namespace {
+// A feedback slot of a code object, tagged with the kind of its record
+// instruction
+struct Slot {
+    char kind;
+    uint32_t value;
+};
+typedef std::vector<Slot> Slots;
+
+// The slots of one code object. Promises that were never compiled have none.
+struct Record {
+    bool lazy;
+    Slots slots;
+};
+} // namespace
+
+static Slots slotsOf(Code* c) {
+    Slots res;
+    for (auto pc = c->code(); pc != c->endCode(); pc = BC::next(pc)) {
+        uint32_t value;
+        switch (*pc) {
+        case Opcode::record_type_:
+            memcpy(&value, pc + 1, sizeof(value));
+            res.push_back({'v', value});
+            break;
+        case Opcode::record_test_:
+            memcpy(&value, pc + 1, sizeof(value));
+            res.push_back({'t', value});
+            break;
+        case Opcode::record_call_:
+            res.push_back({'c', ((ObservedCallees*)(pc + 1))->taken});
+            break;
+        default: {}
+        }
+    }
+    return res;
+}
+
+// Feedback read from a file must be something the recording could have
+// produced. Unused bits are zero and only valid SEXPTYPEs are seen.
+static bool valid(const Slot& slot) {
+    switch (slot.kind) {
+    case 't': {
+        ObservedTest test;
+        memcpy(&test, &slot.value, sizeof(test));
+        return test.unused == 0;
+    }
+    case 'v': {
+        ObservedValues values;
+        memcpy(&values, &slot.value, sizeof(values));
+        if (values.unused != 0)
+            return false;
+        for (size_t i = 0; i < ObservedValues::MaxTypes; ++i) {
+            auto type = (values.seenTypes >> (i * ObservedValues::TypeBits)) &
+                        ((1u << ObservedValues::TypeBits) - 1);
+            if (i >= values.numTypes ? type != 0
+                                     : type > S4SXP || type == 11 ||
+                                           type == 12)
+                return false;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+// Slots read from a file are kept in a raw vector
+static const Slot* slotsIn(SEXP record, size_t& n) {
+    n = XLENGTH(record) / sizeof(Slot);
+    return (const Slot*)RAW(record);
+}
+
+static bool matches(Code* c, SEXP record) {
+    size_t n;
+    auto slots = slotsIn(record, n);
+    auto current = slotsOf(c);
+    if (current.size() != n)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+        if (current[i].kind != slots[i].kind || !valid(slots[i]))
+            return false;
+    return true;
+}
+
+static void restore(Code* c, SEXP record) {
+    size_t n;
+    auto slot = slotsIn(record, n);
+    auto end = slot + n;
+    for (auto pc = c->code(); pc != c->endCode(); pc = BC::next(pc)) {
+        switch (*pc) {
+        case Opcode::record_type_:
+        case Opcode::record_test_:
+            memcpy(pc + 1, &slot->value, sizeof(slot->value));
+            slot++;
+            break;
+        case Opcode::record_call_: {
+            auto feedback = (ObservedCallees*)(pc + 1);
+            uint32_t max = ObservedCallees::CounterOverflow;
+            auto taken = slot->value < max ? slot->value : max;
+            if (taken > feedback->taken)
+                feedback->taken = taken;
+            slot++;
+            break;
+        }
+        default: {}
+        }
+    }
+    assert(slot == end);
+}
+
+// Calls visit on the code, which might be a lazy stub, and on the promises it
+// creates. visit returns the compiled code to descend into, or nullptr.
+template <typename F>
+static void eachCode(Code* c, const F& visit) {
+    c = visit(c);
+    if (!c)
+        return;
+    std::vector<BC::FunIdx> promises;
+    for (auto pc = c->code(); pc != c->endCode(); pc = BC::next(pc))
+        BC::decodeShallow(pc).addMyPromArgsTo(promises);
+    for (auto i : promises)
+        eachCode(c->getPromiseLazy(i), visit);
+}
+
+template <typename F>
+static void eachCode(Function* fun, const F& visit) {
+    eachCode(fun->body(), visit);
+    for (size_t i = 0; i < fun->nargs(); ++i)
+        if (auto arg = fun->defaultArgLazy(i))
+            eachCode(arg, visit);
+}
+
+static bool isUncompiledStub(Code* c) {
+    return c->flags.contains(Code::Lazy) && !c->extraPoolSize;
+}
+
+namespace {
+struct Hash {
+    uint64_t h = 14695981039346656037ull;
+    void add(uint64_t x) { h = (h ^ x) * 1099511628211ull; }
+    void add(const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i)
+            add(((const uint8_t*)data)[i]);
+    }
+};
+} // namespace
+
+// Hashes an AST by value: symbols by name, constants by their contents
+static void hashAst(Hash& h, SEXP e) {
+    h.add(TYPEOF(e));
+    switch (TYPEOF(e)) {
+    case SYMSXP:
+        h.add(CHAR(PRINTNAME(e)), LENGTH(PRINTNAME(e)));
+        break;
+    case LISTSXP:
+    case LANGSXP:
+        for (; e != R_NilValue; e = CDR(e)) {
+            hashAst(h, TAG(e));
+            hashAst(h, CAR(e));
+        }
+        break;
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case RAWSXP:
+        h.add(XLENGTH(e));
+        h.add(DATAPTR(e), XLENGTH(e) * Rf_sizeofType(TYPEOF(e)));
+        break;
+    case STRSXP:
+        h.add(XLENGTH(e));
+        for (R_xlen_t i = 0; i < XLENGTH(e); ++i) {
+            auto s = STRING_ELT(e, i);
+            if (s == NA_STRING)
+                h.add(NA_INTEGER);
+            else
+                h.add(CHAR(s), LENGTH(s));
+        }
+        break;
+    case VECSXP:
+    case EXPRSXP:
+        h.add(XLENGTH(e));
+        for (R_xlen_t i = 0; i < XLENGTH(e); ++i)
+            hashAst(h, VECTOR_ELT(e, i));
+        break;
+    default: {}
+    }
+}
+
+// The opcodes of the body, and the source of the body and of the formals,
+// which includes all constants. Immediates are left out, they hold pool
+// indices which differ between runs.
+static uint64_t hash(SEXP cls) {
+    Hash h;
+    auto fun = DispatchTable::unpack(BODY(cls))->baseline();
+    auto body = fun->body();
+    for (auto pc = body->code(); pc != body->endCode(); pc = BC::next(pc))
+        h.add((uint8_t)*pc);
+    hashAst(h, src_pool_at(globalContext(), body->src));
+    hashAst(h, FORMALS(cls));
+    return h.h;
+}
+
+// The label of an environment in the file, nullptr for environments which
+// cannot be exported
+static SEXP envLabel(SEXP env) {
+    if (env == R_GlobalEnv)
+        return Rf_mkChar(Global);
+    if (!R_IsNamespaceEnv(env))
+        return nullptr;
+    auto spec = CHAR(STRING_ELT(R_NamespaceEnvSpec(env), 0));
+    auto label = R_alloc(strlen(Namespace) + strlen(spec) + 1, 1);
+    strcpy(label, Namespace);
+    strcat(label, spec);
+    return Rf_mkChar(label);
+}
+
+// Only namespaces which are already loaded are considered
+static SEXP envNamed(const char* label) {
+    if (!strcmp(label, Global))
+        return R_GlobalEnv;
+    if (strncmp(label, Namespace, strlen(Namespace)) != 0)
+        return nullptr;
+    auto ns = Rf_findVarInFrame(R_NamespaceRegistry,
+                                Rf_install(label + strlen(Namespace)));
+    return ns == R_UnboundValue ? nullptr : ns;
+}
+
+// Lazy loaded bindings are only forced if asked to. Errors while forcing are
+// caught, the binding then counts as not bound to a closure.
+static SEXP closureBoundTo(SEXP env, SEXP sym, bool force) {
+    auto v = Rf_findVarInFrame(env, sym);
+    if (TYPEOF(v) == PROMSXP) {
+        if (PRVALUE(v) != R_UnboundValue)
+            v = PRVALUE(v);
+        else if (force)
+            v = R_tryEvalSilent(v, env, nullptr);
+        else
+            return nullptr;
+    }
+    if (!v)
+        return nullptr;
+    return TYPEOF(v) == CLOSXP ? v : nullptr;
+}
+
+static void write(std::ostream& out, const char* env, SEXP name, SEXP cls) {
+    auto table = DispatchTable::unpack(BODY(cls));
+    auto fun = table->baseline();
+    std::vector<Record> records;
+    eachCode(fun, [&](Code* c) -> Code* {
+        if (isUncompiledStub(c)) {
+            records.push_back({true, {}});
+            return nullptr;
+        }
+        c = c->compiled();
+        records.push_back({false, slotsOf(c)});
+        return c;
+    });
+
+    out << "fun " << std::quoted(env) << " " << std::quoted(CHAR(name)) << " "
+        << std::hex << hash(cls) << std::dec << " "
+        << fun->body()->funInvocationCount << " " << records.size() << "\n";
+    for (auto& r : records) {
+        if (r.lazy) {
+            out << "lazy\n";
+            continue;
+        }
+        out << "code " << r.slots.size();
+        for (auto& s : r.slots)
+            out << " " << s.kind << std::hex << s.value << std::dec;
+        out << "\n";
+    }
+    out << "contexts " << table->size() - 1 << std::hex;
+    for (size_t i = 1; i < table->size(); ++i)
+        out << " " << table->get(i)->context().toI();
+    out << std::dec << "\n";
+}
+
+// Appends a fresh list of n elements to the pairlist ending in tail, which has
+// to be reachable, and returns it
+static SEXP append(SEXP& tail, R_xlen_t n) {
+    SETCDR(tail, Rf_cons(R_NilValue, R_NilValue));
+    tail = CDR(tail);
+    SETCAR(tail, Rf_allocVector(VECSXP, n));
+    return CAR(tail);
+}
+
+// Everything which needs R, i.e. listing the environments and looking up the
+// closures, is done before the file is opened. The closures to write are
+// collected as (environment label, name, closure) lists.
+const char* FeedbackProfile::exportTo(const char* path, SEXP envs,
+                                      size_t& written) {
+    Protect p;
+    if (TYPEOF(envs) == ENVSXP)
+        envs = p(Rf_list1(envs));
+    else if (TYPEOF(envs) == VECSXP)
+        envs = p(Rf_VectorToPairList(envs));
+    else
+        return "expected an environment or a list of environments";
+
+    SEXP entries = p(Rf_cons(R_NilValue, R_NilValue));
+    SEXP tail = entries;
+    for (SEXP e = envs; e != R_NilValue; e = CDR(e)) {
+        auto env = CAR(e);
+        if (TYPEOF(env) != ENVSXP)
+            return "expected an environment or a list of environments";
+        auto label = envLabel(env);
+        if (!label)
+            return "feedback can only be exported from namespaces and the "
+                   "global environment";
+        p(label);
+        auto syms = p(R_lsInternal3(env, TRUE, TRUE));
+        for (R_xlen_t i = 0; i < XLENGTH(syms); ++i) {
+            auto name = STRING_ELT(syms, i);
+            auto cls = closureBoundTo(env, Rf_installChar(name), false);
+            if (!cls || !DispatchTable::check(BODY(cls)))
+                continue;
+            auto entry = append(tail, 3);
+            SET_VECTOR_ELT(entry, 0, label);
+            SET_VECTOR_ELT(entry, 1, name);
+            SET_VECTOR_ELT(entry, 2, cls);
+        }
+    }
+
+    std::ofstream out(path);
+    if (!out)
+        return "couldn't open file at path";
+    out << Magic << " " << Version << "\n";
+    written = 0;
+    for (SEXP e = CDR(entries); e != R_NilValue; e = CDR(e)) {
+        auto entry = CAR(e);
+        write(out, CHAR(VECTOR_ELT(entry, 0)), VECTOR_ELT(entry, 1),
+              VECTOR_ELT(entry, 2));
+        written++;
+    }
+    return nullptr;
+}
+
+static bool readSlot(const std::string& token, Slot& slot) {
+    if (token.size() < 2 || !strchr("vtc", token[0]))
+        return false;
+    char* end;
+    auto value = strtoul(token.c_str() + 1, &end, 16);
+    if (*end || value > UINT32_MAX)
+        return false;
+    slot = {token[0], (uint32_t)value};
+    return true;
+}
+
+// A count in the file cannot be larger than the file itself
+static bool readCount(std::istream& in, size_t max, size_t& n) {
+    return (in >> n) && n <= max;
+}
+
+// The records are stored in a list, with a raw vector of slots per compiled
+// code object and NULL for lazy ones
+static bool readRecords(std::istream& in, size_t max, SEXP entry) {
+    size_t count;
+    if (!readCount(in, max, count))
+        return false;
+    SET_VECTOR_ELT(entry, 4, Rf_allocVector(VECSXP, count));
+    auto records = VECTOR_ELT(entry, 4);
+    for (size_t i = 0; i < count; ++i) {
+        std::string kind;
+        in >> kind;
+        if (kind == "lazy")
+            continue;
+        size_t n;
+        if (kind != "code" || !readCount(in, max, n))
+            return false;
+        SET_VECTOR_ELT(records, i, Rf_allocVector(RAWSXP, n * sizeof(Slot)));
+        auto slots = (Slot*)RAW(VECTOR_ELT(records, i));
+        for (size_t j = 0; j < n; ++j) {
+            std::string token;
+            if (!(in >> token) || !readSlot(token, slots[j]))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool readContexts(std::istream& in, size_t max, SEXP entry) {
+    std::string tag;
+    size_t n;
+    if (!(in >> tag) || tag != "contexts" || !readCount(in, max, n))
+        return false;
+    SET_VECTOR_ELT(entry, 5,
+                   Rf_allocVector(RAWSXP, n * sizeof(unsigned long)));
+    auto contexts = (unsigned long*)RAW(VECTOR_ELT(entry, 5));
+    for (size_t i = 0; i < n; ++i)
+        if (!(in >> std::hex >> contexts[i] >> std::dec))
+            return false;
+    return true;
+}
+
+// Reads the whole profile into a pairlist, which starts with a dummy cell.
+// Every function is a list of its environment label, its name, its hash and
+// invocation count as raw vectors, its records and its contexts. Restoring
+// calls into R, which must not happen while C++ objects are live.
+static SEXP readProfile(const char* path, FeedbackProfile::Stats& stats) {
+    SEXP entries = PROTECT(Rf_cons(R_NilValue, R_NilValue));
+    {
+        std::ifstream in(path);
+        if (!in) {
+            stats.error = "couldn't open file at path";
+            UNPROTECT(1);
+            return entries;
+        }
+        in.seekg(0, std::ios::end);
+        size_t max = in.tellg();
+        in.seekg(0);
+
+        std::string magic;
+        unsigned version;
+        if (!(in >> magic >> version) || magic != Magic ||
+            version != Version) {
+            stats.warning = "not a feedback profile of this rir version";
+            UNPROTECT(1);
+            return entries;
+        }
+
+        SEXP tail = entries;
+        std::string tag;
+        while (in >> tag) {
+            std::string label, name;
+            uint64_t h;
+            unsigned invocations;
+            if (tag != "fun" ||
+                !(in >> std::quoted(label) >> std::quoted(name) >>
+                  std::hex >> h >> std::dec >> invocations)) {
+                stats.warning = "malformed feedback profile, stopped reading";
+                break;
+            }
+            auto entry = append(tail, 6);
+            SET_VECTOR_ELT(entry, 0, Rf_mkChar(label.c_str()));
+            SET_VECTOR_ELT(entry, 1, Rf_mkChar(name.c_str()));
+            SET_VECTOR_ELT(entry, 2, Rf_allocVector(RAWSXP, sizeof(h)));
+            memcpy(RAW(VECTOR_ELT(entry, 2)), &h, sizeof(h));
+            SET_VECTOR_ELT(entry, 3,
+                           Rf_allocVector(RAWSXP, sizeof(invocations)));
+            memcpy(RAW(VECTOR_ELT(entry, 3)), &invocations,
+                   sizeof(invocations));
+            if (!readRecords(in, max, entry) ||
+                !readContexts(in, max, entry)) {
+                // Drop the incomplete entry
+                SETCAR(tail, R_NilValue);
+                stats.warning = "malformed feedback profile, stopped reading";
+                break;
+            }
+        }
+    }
+    UNPROTECT(1);
+    return entries;
+}
+
+// Matches the code objects of fun against the records, and restores them if
+// write is set. If a promise with recorded feedback was never compiled, it is
+// returned in stub and has to be compiled before matching again, because
+// compiling calls into R.
+static bool matchRecords(Function* fun, SEXP records, bool write,
+                         Code*& stub) {
+    bool ok = true;
+    R_xlen_t next = 0;
+    stub = nullptr;
+    eachCode(fun, [&](Code* c) -> Code* {
+        if (!ok || stub)
+            return nullptr;
+        if (next == XLENGTH(records)) {
+            ok = false;
+            return nullptr;
+        }
+        auto r = VECTOR_ELT(records, next++);
+        if (r == R_NilValue)
+            return nullptr;
+        if (isUncompiledStub(c)) {
+            stub = c;
+            return nullptr;
+        }
+        c = c->compiled();
+        if (!matches(c, r)) {
+            ok = false;
+            return nullptr;
+        }
+        if (write)
+            restore(c, r);
+        return c;
+    });
+    return ok && (stub || next == XLENGTH(records));
+}
+
+FeedbackProfile::Stats FeedbackProfile::importFrom(const char* path, SEXP env,
+                                                   bool optimize) {
+    Stats stats;
+    Protect p;
+    auto entries = p(readProfile(path, stats));
+
+    for (SEXP e = CDR(entries); e != R_NilValue; e = CDR(e)) {
+        auto entry = CAR(e);
+        if (entry == R_NilValue)
+            continue;
+        auto records = VECTOR_ELT(entry, 4);
+        uint64_t h;
+        unsigned invocations;
+        memcpy(&h, RAW(VECTOR_ELT(entry, 2)), sizeof(h));
+        memcpy(&invocations, RAW(VECTOR_ELT(entry, 3)), sizeof(invocations));
+
+        auto rho = envNamed(CHAR(VECTOR_ELT(entry, 0)));
+        if (env && rho != env)
+            continue;
+        auto sym = Rf_installChar(VECTOR_ELT(entry, 1));
+        auto cls = rho ? closureBoundTo(rho, sym, true) : nullptr;
+        if (!cls) {
+            stats.unbound++;
+            continue;
+        }
+        if (TYPEOF(BODY(cls)) != EXTERNALSXP)
+            Compiler::compileClosure(cls);
+        auto fun = DispatchTable::unpack(BODY(cls))->baseline();
+        if (hash(cls) != h) {
+            stats.stale++;
+            continue;
+        }
+
+        // Check everything before writing, a function is restored completely
+        // or not at all. Promises with feedback are compiled on the way.
+        Code* stub;
+        bool ok;
+        while ((ok = matchRecords(fun, records, false, stub)) && stub)
+            stub->compiled();
+        if (!ok) {
+            stats.stale++;
+            continue;
+        }
+        matchRecords(fun, records, true, stub);
+        auto body = fun->body();
+        if (invocations > body->funInvocationCount)
+            body->funInvocationCount = invocations;
+        stats.restored++;
+
+        if (!optimize)
+            continue;
+        auto before = DispatchTable::unpack(BODY(cls))->size();
+        auto contexts = VECTOR_ELT(entry, 5);
+        for (size_t i = 0; i < XLENGTH(contexts) / sizeof(unsigned long);
+             ++i) {
+            unsigned long context;
+            memcpy(&context, RAW(contexts) + i * sizeof(context),
+                   sizeof(context));
+            globalContext()->closureOptimizer(cls, Context(context), sym);
+        }
+        stats.optimized += DispatchTable::unpack(BODY(cls))->size() - before;
+    }
+    return stats;
+}
+
+} // namespace rir
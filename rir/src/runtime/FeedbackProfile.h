@@ -0,0 +1,51 @@
+#ifndef RIR_FEEDBACK_PROFILE_H
+#define RIR_FEEDBACK_PROFILE_H
+
+#include "R/r.h"
+
+#include <cstddef>
+
+namespace rir {
+
+/*
+ * Type feedback and invocation counts of baseline code, written to a text file
+ * such that a later process can start out with the profile of an earlier run
+ * instead of warming up again.
+ *
+ * Functions are identified by the namespace (or the global environment) they
+ * are bound in, their name and a hash of their bytecode and source. Importing
+ * compiles the bound closures and copies the recorded feedback into their
+ * fresh baseline code. Entries whose function changed in between, or whose
+ * feedback is not valid, are skipped.
+ *
+ * The file is read or written in one go, without calling into R, and the
+ * closures are looked up, compiled and restored without C++ objects being
+ * live. Problems are reported in the result, for the caller to raise.
+ *
+ * Observed call targets point into the pools of the exporting process, for
+ * callees only the call counts are kept. The contexts of the optimized
+ * versions are recorded too, such that they can be compiled right away.
+ */
+struct FeedbackProfile {
+    struct Stats {
+        size_t restored = 0;
+        size_t stale = 0;
+        size_t unbound = 0;
+        size_t optimized = 0;
+        // Set if nothing could be read, or reading stopped early
+        const char* error = nullptr;
+        const char* warning = nullptr;
+    };
+
+    // Writes the profiles of all rir closures bound in envs, which is an
+    // environment or a list of them. Returns an error message on failure.
+    static const char* exportTo(const char* path, SEXP envs, size_t& written);
+    // Only the entries of env are restored if it is given. With optimize set,
+    // the restored closures are also compiled for their recorded contexts.
+    static Stats importFrom(const char* path, SEXP env = nullptr,
+                            bool optimize = false);
+};
+
+} // namespace rir
+
+#endif
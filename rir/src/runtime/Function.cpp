@@ -44,10 +44,10 @@ void Function::serialize(SEXP refTable, R_outpstream_t out) const {
     HashAdd(container(), refTable);
     body()->serialize(refTable, out);
     for (unsigned i = 0; i < numArgs_; i++) {
-        Code* arg = defaultArg(i);
+        Code* arg = defaultArgLazy(i);
         OutInteger(out, (int)(arg != NULL));
         if (arg != NULL)
-            defaultArg(i)->serialize(refTable, out);
+            arg->serialize(refTable, out);
     }
     OutInteger(out, flags.to_i());
 }
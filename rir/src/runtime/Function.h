@@ -62,7 +62,19 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     void serialize(SEXP refTable, R_outpstream_t out) const;
     void disassemble(std::ostream&);
 
+    // Returns the code of a default argument, compiling it if needed
     Code* defaultArg(size_t i) const {
+        auto c = defaultArgLazy(i);
+        if (c && c->flags.contains(Code::Lazy)) {
+            c = c->compiled();
+            const_cast<Function*>(this)->setEntry(NUM_PTRS + i,
+                                                  c->container());
+        }
+        return c;
+    }
+
+    // Returns the code of a default argument, which might still be a stub
+    Code* defaultArgLazy(size_t i) const {
         assert(i < numArgs_);
         if (!defaultArg_[i])
             return nullptr;
@@ -73,7 +85,7 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     void registerInvocation() { body()->registerInvocation(); }
     size_t invocationCount() { return body()->funInvocationCount; }
     void registerDeopt() { body()->registerDeopt(); }
-    size_t deoptCount() { return body()->deoptCount; }
+    size_t deoptCount() { return body()->decayedDeoptCount(); }
 
     unsigned size; /// Size, in bytes, of the function and its data
 
@@ -89,7 +101,8 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     V(InnerFunction)                                                           \
     V(DisableAllSpecialization)                                                \
     V(DisableArgumentTypeSpecialization)                                       \
-    V(DisableNumArgumentsSpezialization)
+    V(DisableNumArgumentsSpezialization)                                       \
+    V(SplitFeedback)
 
     enum Flag {
 #define V(F) F,
@@ -97,7 +110,7 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
 #undef V
 
             FIRST = Deopt,
-        LAST = DisableNumArgumentsSpezialization
+        LAST = SplitFeedback
     };
     EnumSet<Flag> flags;
 
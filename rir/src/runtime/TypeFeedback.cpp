@@ -17,6 +17,7 @@ void ObservedCallees::record(Code* caller, SEXP callee) {
         if (i == numTargets) {
             auto idx = caller->addExtraPoolEntry(callee);
             targets[numTargets++] = idx;
+            invalid = false;
         }
     }
 }
@@ -15,7 +15,10 @@ struct Code;
 #pragma pack(1)
 
 struct ObservedCallees {
-    static constexpr unsigned CounterBits = 30;
+    // One bit of the counter went to the invalid flag, as the feedback has to
+    // stay the size of the record_call_ immediate. Saturating at 2^29 calls
+    // is no loss, the count is only compared against small thresholds.
+    static constexpr unsigned CounterBits = 29;
     static constexpr unsigned CounterOverflow = (1 << CounterBits) - 1;
     static constexpr unsigned TargetBits = 2;
     static constexpr unsigned MaxTargets = (1 << TargetBits) - 1;
@@ -27,6 +30,10 @@ struct ObservedCallees {
     // Effectively this means we have seen MaxTargets or more.
     uint32_t numTargets : TargetBits;
     uint32_t taken : CounterBits;
+    // Set if a speculation on these targets failed without adding a new
+    // target, speculating again would fail the same way. Cleared when a new
+    // target is seen.
+    uint32_t invalid : 1;
 
     void record(Code* caller, SEXP callee);
     SEXP getTarget(const Code* code, size_t pos) const;
@@ -80,14 +87,29 @@ struct ObservedValues {
     };
 
     static constexpr unsigned MaxTypes = 3;
-    uint8_t numTypes : 2;
-    uint8_t stateBeforeLastForce : 2;
-    uint8_t notScalar : 1;
-    uint8_t attribs : 1;
-    uint8_t object : 1;
-    uint8_t notFastVecelt : 1;
+    uint32_t numTypes : 2;
+    uint32_t stateBeforeLastForce : 2;
+    uint32_t notScalar : 1;
+    uint32_t attribs : 1;
+    uint32_t object : 1;
+    uint32_t notFastVecelt : 1;
+    uint32_t altrep : 1;
+
+    // SEXPTYPEs fit into the 5 bits R reserves for them in the sxpinfo
+    static constexpr unsigned TypeBits = 5;
+    uint32_t seenTypes : MaxTypes * TypeBits;
+    uint32_t unused : 8;
+
+    SEXPTYPE seen(size_t i) const {
+        assert(i < numTypes);
+        return (seenTypes >> (i * TypeBits)) & ((1u << TypeBits) - 1);
+    }
 
-    std::array<uint8_t, MaxTypes> seen;
+    void addSeen(SEXPTYPE type) {
+        assert(numTypes < MaxTypes && type < (1u << TypeBits));
+        seenTypes |= type << (numTypes * TypeBits);
+        numTypes++;
+    }
 
     ObservedValues() {
         // implicitly happens when writing bytecode stream...
@@ -99,12 +121,13 @@ struct ObservedValues {
     void print(std::ostream& out) const {
         if (numTypes) {
             for (size_t i = 0; i < numTypes; ++i) {
-                out << Rf_type2char(seen[i]);
+                out << Rf_type2char(seen(i));
                 if (i != (unsigned)numTypes - 1)
                     out << ", ";
             }
             out << " (" << (object ? "o" : "") << (attribs ? "a" : "")
-                << (notFastVecelt ? "v" : "") << (!notScalar ? "s" : "") << ")";
+                << (notFastVecelt ? "v" : "") << (!notScalar ? "s" : "")
+                << (altrep ? "r" : "") << ")";
             if (stateBeforeLastForce !=
                 ObservedValues::StateBeforeLastForce::unknown) {
                 out << " | "
@@ -137,16 +160,17 @@ struct ObservedValues {
         object = object || isObject(e);
         attribs = attribs || object || ATTRIB(e) != R_NilValue;
         notFastVecelt = notFastVecelt || !fastVeceltOk(e);
+        altrep = altrep || ALTREP(e);
 
-        uint8_t type = TYPEOF(e);
+        SEXPTYPE type = TYPEOF(e);
         if (numTypes < MaxTypes) {
-            int i = 0;
+            unsigned i = 0;
             for (; i < numTypes; ++i) {
-                if (seen[i] == type)
+                if (seen(i) == type)
                     break;
             }
             if (i == numTypes)
-                seen[numTypes++] = type;
+                addSeen(type);
         }
     }
 };
@@ -0,0 +1,79 @@
+#include "ThreadPool.h"
+
+#include <unistd.h>
+
+namespace rir {
+
+ThreadPool::ThreadPool(size_t threads)
+    : queues(new Queue[threads ? threads : 1]), owner(getpid()) {
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back([this, i]() { work(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+void ThreadPool::run(size_t tasks, const std::function<void(size_t)>& body) {
+    if (workers.empty() || tasks < 2 || getpid() != owner) {
+        for (size_t t = 0; t < tasks; ++t)
+            body(t);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto n = size();
+        for (size_t q = 0; q < n; ++q) {
+            queues[q].next = tasks * q / n;
+            queues[q].end = tasks * (q + 1) / n;
+        }
+        this->body = &body;
+        busy = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0, body);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return busy == 0; });
+    this->body = nullptr;
+}
+
+void ThreadPool::work(size_t self) {
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&]() { return stop || generation != seen; });
+        if (stop)
+            return;
+        seen = generation;
+        auto& body = *this->body;
+
+        lock.unlock();
+        drain(self, body);
+        lock.lock();
+
+        if (--busy == 0)
+            finished.notify_one();
+    }
+}
+
+void ThreadPool::drain(size_t self, const std::function<void(size_t)>& body) {
+    auto n = size();
+    // Start with our own queue, then steal from the others
+    for (size_t i = 0; i < n; ++i) {
+        auto& q = queues[(self + i) % n];
+        for (auto t = q.next++; t < q.end; t = q.next++)
+            body(t);
+    }
+}
+
+} // namespace rir
@@ -0,0 +1,65 @@
+#ifndef RIR_THREAD_POOL_H
+#define RIR_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace rir {
+
+// A pool of worker threads for data parallel loops. The tasks of a loop are
+// distributed evenly over the workers and the calling thread, and whoever runs
+// out of work steals tasks from the others.
+//
+// Tasks run outside of the main thread, so they must not allocate on the R
+// heap or call into the R API.
+class ThreadPool {
+  public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads running tasks, including the caller
+    size_t size() const { return workers.size() + 1; }
+
+    // Calls body for each task in [0, tasks) and returns when all of them
+    // are done. Only one loop can run at a time.
+    void run(size_t tasks, const std::function<void(size_t)>& body);
+
+  private:
+    struct Queue {
+        std::atomic<size_t> next;
+        size_t end;
+        // Keep the counters of different threads on different cache lines
+        char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+
+    void work(size_t self);
+    void drain(size_t self, const std::function<void(size_t)>& body);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues;
+    // Forked children do not inherit the workers, loops run serially there.
+    // The pool must not be destroyed in a child either.
+    pid_t owner;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(size_t)>* body = nullptr;
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stop = false;
+};
+
+} // namespace rir
+
+#endif